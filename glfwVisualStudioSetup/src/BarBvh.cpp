@@ -0,0 +1,62 @@
+#include "BarBvh.h"
+
+static const uint32_t kMaxLeafItems = 4;
+
+void BarBvh::build(const std::vector<glm::vec2>& centers, float halfSize, float baseZ, const std::vector<float>& topZ) {
+    clear();
+    const uint32_t count = (uint32_t)centers.size();
+    if (count == 0) return;
+    order.resize(count);
+    for (uint32_t i = 0; i < count; ++i) order[i] = i;
+    nodes.reserve(2 * (count / kMaxLeafItems + 1));
+    nodes.push_back(Node{ glm::vec3(0.0f), 0, glm::vec3(0.0f), count });
+
+    // Median split along the longer XY axis of the centroid bounds, depth first with an explicit
+    // stack so children always come after their parent (refit relies on that)
+    std::vector<uint32_t> pending = { 0 };
+    while (!pending.empty()) {
+        uint32_t index = pending.back();
+        pending.pop_back();
+        uint32_t first = nodes[index].first, itemCount = nodes[index].count;
+        glm::vec2 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+        float top = baseZ;
+        for (uint32_t i = first; i < first + itemCount; ++i) {
+            lo = glm::min(lo, centers[order[i]]);
+            hi = glm::max(hi, centers[order[i]]);
+            top = std::max(top, topZ[order[i]]);
+        }
+        nodes[index].min = glm::vec3(lo - halfSize, baseZ);
+        nodes[index].max = glm::vec3(hi + halfSize, top);
+        if (itemCount <= kMaxLeafItems) continue;
+
+        int axis = (hi.x - lo.x) >= (hi.y - lo.y) ? 0 : 1;
+        uint32_t half = itemCount / 2;
+        std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + itemCount,
+                         [&](uint32_t a, uint32_t b) { return centers[a][axis] < centers[b][axis]; });
+        uint32_t left = (uint32_t)nodes.size();
+        nodes.push_back(Node{ glm::vec3(0.0f), first, glm::vec3(0.0f), half });
+        nodes.push_back(Node{ glm::vec3(0.0f), first + half, glm::vec3(0.0f), itemCount - half });
+        nodes[index].first = left;
+        nodes[index].count = 0;
+        pending.push_back(left + 1);
+        pending.push_back(left);
+    }
+}
+
+void BarBvh::refit(const std::vector<float>& topZ) {
+    for (size_t n = nodes.size(); n-- > 0;) {
+        Node& node = nodes[n];
+        if (node.count > 0) {
+            float top = node.min.z;
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) top = std::max(top, topZ[order[i]]);
+            node.max.z = top;
+        } else {
+            node.max.z = std::max(nodes[node.first].max.z, nodes[node.first + 1].max.z);
+        }
+    }
+}
+
+void BarBvh::clear() {
+    nodes.clear();
+    order.clear();
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "RayBoxKernel.h"
+
+// Bounding volume hierarchy over upright boxes with a shared footprint: item i spans
+// centers[i] +- halfSize in XY and [baseZ, topZ[i]] in Z. The XY layout is fixed at build
+// time, refit() updates the heights in O(n) without rebuilding.
+class BarBvh {
+public:
+    void build(const std::vector<glm::vec2>& centers, float halfSize, float baseZ, const std::vector<float>& topZ);
+    void refit(const std::vector<float>& topZ);
+    void clear();
+    bool empty() const { return nodes.empty(); }
+    size_t nodeCount() const { return nodes.size(); }
+    size_t memoryBytes() const { return nodes.capacity() * sizeof(Node) + order.capacity() * sizeof(uint32_t); }
+
+    // Nearest item along the ray, or -1. hitTest(item, maxT) returns the exact hit distance for an
+    // item whose bounds the ray enters (infinity for a miss), so callers can test tighter or
+    // per-frame geometry inside the conservative bounds.
+    template <typename HitTest>
+    int64_t closestHit(const glm::vec3& origin, const glm::vec3& dir, HitTest&& hitTest, float* hitDistance = nullptr) const {
+        const float miss = std::numeric_limits<float>::infinity();
+        if (nodes.empty()) return -1;
+        const glm::vec3 invDir = 1.0f / dir;
+        float best = miss;
+        int64_t bestItem = -1;
+        struct Entry { uint32_t node; float t; };
+        Entry stack[64];
+        int stackSize = 0;
+        Entry current = { 0, rayBoxEntry(origin, invDir, nodes[0].min, nodes[0].max) };
+        if (current.t == miss) return -1;
+        for (;;) {
+            const Node& node = nodes[current.node];
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                    float t = hitTest(order[i], best);
+                    if (t < best) {
+                        best = t;
+                        bestItem = order[i];
+                    }
+                }
+            } else {
+                // Visit the nearer child first, the farther one is only popped if it can still win
+                uint32_t a = node.first, b = node.first + 1;
+                float ta = rayBoxEntry(origin, invDir, nodes[a].min, nodes[a].max, best);
+                float tb = rayBoxEntry(origin, invDir, nodes[b].min, nodes[b].max, best);
+                if (tb < ta) {
+                    std::swap(a, b);
+                    std::swap(ta, tb);
+                }
+                if (ta != miss) {
+                    if (tb != miss && stackSize < 64) stack[stackSize++] = { b, tb };
+                    current = { a, ta };
+                    continue;
+                }
+            }
+            do {
+                if (stackSize == 0) {
+                    if (hitDistance) *hitDistance = best;
+                    return bestItem;
+                }
+                current = stack[--stackSize];
+            } while (current.t >= best);
+        }
+    }
+
+private:
+    // Interior nodes have count == 0 and children first, first + 1. Leaves cover order[first, first + count).
+    struct Node {
+        glm::vec3 min;
+        uint32_t first;
+        glm::vec3 max;
+        uint32_t count;
+    };
+    std::vector<Node> nodes;
+    std::vector<uint32_t> order;
+};
@@ -0,0 +1,84 @@
+#include "BarCullGrid.h"
+#include <algorithm>
+#include <cmath>
+
+Frustum Frustum::fromViewProj(const glm::mat4& m) {
+    // glm is column-major: row r of the matrix is (m[0][r], m[1][r], m[2][r], m[3][r])
+    auto row = [&](int r) { return glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]); };
+    Frustum f;
+    f.planes[0] = row(3) + row(0); // left
+    f.planes[1] = row(3) - row(0); // right
+    f.planes[2] = row(3) + row(1); // bottom
+    f.planes[3] = row(3) - row(1); // top
+    f.planes[4] = row(3) + row(2); // near
+    f.planes[5] = row(3) - row(2); // far
+    return f;
+}
+
+void BarCullGrid::clear() {
+    cells.clear();
+    items.clear();
+    itemCenters.clear();
+    itemTopZ.clear();
+}
+
+void BarCullGrid::build(const std::vector<glm::vec2>& centers, float halfSize_, float baseZ_, const std::vector<float>& topZ,
+                        size_t itemsPerCell) {
+    clear();
+    halfSize = halfSize_;
+    baseZ = baseZ_;
+    if (centers.empty()) return;
+    glm::vec2 lo = centers[0], hi = centers[0];
+    for (const glm::vec2& c : centers) {
+        lo = glm::min(lo, c);
+        hi = glm::max(hi, c);
+    }
+    // Roughly square cells, about itemsPerCell items each for an even spread
+    glm::vec2 extent = glm::max(hi - lo, glm::vec2(1e-6f));
+    double cellArea = (double)extent.x * extent.y * std::max<size_t>(itemsPerCell, 1) / centers.size();
+    double side = std::sqrt(cellArea);
+    uint32_t nx = (uint32_t)std::clamp(std::ceil(extent.x / side), 1.0, 4096.0);
+    uint32_t ny = (uint32_t)std::clamp(std::ceil(extent.y / side), 1.0, 4096.0);
+    glm::vec2 scale = glm::vec2((float)nx, (float)ny) / extent;
+    auto cellOf = [&](const glm::vec2& c) {
+        uint32_t x = std::min((uint32_t)((c.x - lo.x) * scale.x), nx - 1);
+        uint32_t y = std::min((uint32_t)((c.y - lo.y) * scale.y), ny - 1);
+        return y * nx + x;
+    };
+
+    // Counting sort of the items into cells
+    cells.assign((size_t)nx * ny, Cell{ glm::vec3(0.0f), 0, glm::vec3(0.0f), 0 });
+    for (const glm::vec2& c : centers) ++cells[cellOf(c)].count;
+    uint32_t first = 0;
+    for (Cell& cell : cells) {
+        cell.first = first;
+        first += cell.count;
+        cell.count = 0;
+    }
+    items.resize(centers.size());
+    itemCenters.resize(centers.size());
+    itemTopZ.resize(centers.size());
+    for (uint32_t i = 0; i < (uint32_t)centers.size(); ++i) {
+        Cell& cell = cells[cellOf(centers[i])];
+        uint32_t slot = cell.first + cell.count++;
+        items[slot] = i;
+        itemCenters[slot] = centers[i];
+    }
+    refit(topZ);
+}
+
+void BarCullGrid::refit(const std::vector<float>& topZ) {
+    for (size_t i = 0; i < items.size(); ++i) itemTopZ[i] = topZ[items[i]];
+    for (Cell& cell : cells) {
+        if (cell.count == 0) continue;
+        glm::vec2 lo = itemCenters[cell.first], hi = lo;
+        float top = baseZ;
+        for (uint32_t i = cell.first; i < cell.first + cell.count; ++i) {
+            lo = glm::min(lo, itemCenters[i]);
+            hi = glm::max(hi, itemCenters[i]);
+            top = std::max(top, itemTopZ[i]);
+        }
+        cell.min = glm::vec3(lo - halfSize, baseZ);
+        cell.max = glm::vec3(hi + halfSize, top);
+    }
+}
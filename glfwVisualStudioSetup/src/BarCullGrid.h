@@ -0,0 +1,80 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+// The six clip planes of a view-projection, normals pointing inwards (Gribb/Hartmann)
+struct Frustum {
+    glm::vec4 planes[6];
+
+    static Frustum fromViewProj(const glm::mat4& viewProj);
+
+    // False only when the box lies entirely outside one plane, so it may keep a few boxes near the corners
+    bool intersects(const glm::vec3& min, const glm::vec3& max) const {
+        for (const glm::vec4& p : planes) {
+            glm::vec3 far(p.x > 0.0f ? max.x : min.x, p.y > 0.0f ? max.y : min.y, p.z > 0.0f ? max.z : min.z);
+            if (p.x * far.x + p.y * far.y + p.z * far.z + p.w < 0.0f) return false;
+        }
+        return true;
+    }
+
+    bool contains(const glm::vec3& min, const glm::vec3& max) const {
+        for (const glm::vec4& p : planes) {
+            glm::vec3 near(p.x > 0.0f ? min.x : max.x, p.y > 0.0f ? min.y : max.y, p.z > 0.0f ? min.z : max.z);
+            if (p.x * near.x + p.y * near.y + p.z * near.z + p.w < 0.0f) return false;
+        }
+        return true;
+    }
+};
+
+// Uniform 2D grid over upright boxes with a shared footprint, laid out like BarBvh: item i spans
+// centers[i] +- halfSize in XY and [baseZ, topZ[i]] in Z. Cells are tested against the frustum,
+// items of cells entirely inside it are taken without testing them one by one.
+class BarCullGrid {
+public:
+    void build(const std::vector<glm::vec2>& centers, float halfSize, float baseZ, const std::vector<float>& topZ,
+               size_t itemsPerCell = 32);
+    void refit(const std::vector<float>& topZ);
+    void clear();
+    bool empty() const { return cells.empty(); }
+    size_t cellCount() const { return cells.size(); }
+    size_t memoryBytes() const {
+        return cells.capacity() * sizeof(Cell) + items.capacity() * sizeof(uint32_t) +
+               itemCenters.capacity() * sizeof(glm::vec2) + itemTopZ.capacity() * sizeof(float);
+    }
+
+    // Appends the items whose box intersects the frustum and for which keep(item) holds, grouped by cell
+    template <typename Keep>
+    void cull(const Frustum& frustum, Keep&& keep, std::vector<uint32_t>& out) const {
+        for (const Cell& cell : cells) {
+            if (cell.count == 0 || !frustum.intersects(cell.min, cell.max)) continue;
+            const uint32_t end = cell.first + cell.count;
+            if (frustum.contains(cell.min, cell.max)) {
+                for (uint32_t i = cell.first; i < end; ++i)
+                    if (keep(items[i])) out.push_back(items[i]);
+                continue;
+            }
+            for (uint32_t i = cell.first; i < end; ++i) {
+                if (!keep(items[i])) continue;
+                glm::vec3 min(itemCenters[i] - halfSize, baseZ), max(itemCenters[i] + halfSize, itemTopZ[i]);
+                if (frustum.intersects(min, max)) out.push_back(items[i]);
+            }
+        }
+    }
+
+private:
+    // Items of a cell are items[first, first + count), bounds cover their boxes
+    struct Cell {
+        glm::vec3 min;
+        uint32_t first;
+        glm::vec3 max;
+        uint32_t count;
+    };
+    std::vector<Cell> cells;
+    std::vector<uint32_t> items;        // Item ids in cell order
+    std::vector<glm::vec2> itemCenters; // Parallel to items
+    std::vector<float> itemTopZ;
+    float halfSize = 0.0f;
+    float baseZ = 0.0f;
+};
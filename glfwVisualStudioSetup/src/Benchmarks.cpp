@@ -0,0 +1,1521 @@
+#include "Benchmarks.h"
+#include "PopulationBars.h"
+#include "HoverPicker.h"
+#include "CsvScanner.h"
+#include "CsvTokenizer.h"
+#include "DatasetCache.h"
+#include "BarBvh.h"
+#include "BarCullGrid.h"
+#include "DensityQuadtree.h"
+#include "ThreadPool.h"
+#include "RayBoxKernel.h"
+#include "CompressedTexture.h"
+#include "DecodedImage.h"
+#include "MapPlane.h"
+#include "FrameUniforms.h"
+#include "TilePyramid.h"
+#include "Skybox.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <charconv>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+// One line of a self-check; a failed condition clears ok
+static void check(bool& ok, bool condition, const char* what) {
+    std::cout << (condition ? "  ok    " : "  FAIL  ") << what << std::endl;
+    ok = ok && condition;
+}
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Needs a current GL context
+static void printRenderer() {
+    std::cout << "Renderer: " << glGetString(GL_RENDERER) << " (" << glGetString(GL_VERSION) << ")" << std::endl;
+}
+
+// Writes a dataset.csv shaped file: entities cycle through 201 years (1900-2100) each
+static bool writeSyntheticCSV(const std::string& path, size_t rows, size_t yearsPerEntity = 201) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Failed to create benchmark file: " << path << std::endl;
+        return false;
+    }
+    std::string buffer = "Entity,Code,Year,Population density,Coord_X,Coord_Y\n";
+    char num[32];
+    auto append = [&](auto value) {
+        auto result = std::to_chars(num, num + sizeof(num), value);
+        buffer.append(num, result.ptr);
+    };
+    uint32_t rng = 12345u;
+    for (size_t i = 0; i < rows; ++i) {
+        size_t entity = i / yearsPerEntity;
+        int year = 1900 + (int)(i % yearsPerEntity);
+        rng = rng * 1664525u + 1013904223u;
+        buffer += "Region ";
+        append(entity);
+        buffer += ",R";
+        append(entity);
+        buffer += ',';
+        append(year);
+        buffer += ',';
+        append((float)(rng >> 8) / 16777216.0f * 1000.0f);
+        buffer += ',';
+        append((int)((entity * 37) % 4592));
+        buffer += ',';
+        append((int)((entity * 53) % 3196));
+        buffer += '\n';
+        if (buffer.size() > (1 << 20)) {
+            out.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+    out.write(buffer.data(), buffer.size());
+    return out.good();
+}
+
+// Digest of the loaded year x entity table keyed by entity name, so loaders that assign ids
+// differently still agree
+static uint64_t fingerprint(const PopulationBars& bars) {
+    const PopulationTimeSeries& series = bars.getTimeSeries();
+    const EntityDictionary& entities = bars.getEntities();
+    uint64_t digest = 0;
+    for (int year = series.minYear(); year <= series.maxYear(); ++year) {
+        const float* row = series.row(year);
+        uint64_t yearHash = 0;
+        for (uint32_t e = 0; e < series.entityCount(); ++e) {
+            if (PopulationTimeSeries::isMissing(row[e])) continue;
+            uint64_t h = (1469598103934665603ull ^ (uint64_t)year) * 1099511628211ull;
+            h = (h ^ std::hash<std::string>()(entities.name(e))) * 1099511628211ull;
+            float fields[3] = { row[e], entities.x(e), entities.y(e) };
+            for (float f : fields) {
+                uint32_t b;
+                std::memcpy(&b, &f, 4);
+                h = (h ^ b) * 1099511628211ull;
+            }
+            yearHash += h;
+        }
+        digest += yearHash * 1099511628211ull;
+    }
+    return digest;
+}
+
+int runCsvLoaderBenchmark(const std::vector<size_t>& rowCounts, int loaderThreads) {
+    fs::path dir = fs::temp_directory_path();
+    bool allMatch = true;
+    std::cout << std::left << std::setw(12) << "rows" << std::setw(10) << "file MB"
+              << std::setw(14) << "stream ms" << std::setw(14) << "mapped ms" << std::setw(16) << "parallel ms"
+              << std::setw(16) << "stream rows/s" << std::setw(16) << "mapped rows/s" << std::setw(18) << "parallel rows/s"
+              << std::setw(10) << "threads" << "result" << std::endl;
+    for (size_t rows : rowCounts) {
+        std::string path = (dir / ("population_bench_" + std::to_string(rows) + ".csv")).string();
+        if (!writeSyntheticCSV(path, rows)) return 1;
+
+        // Load one at a time so only a single copy of the table is alive
+        DatasetLoadStats stats[3];
+        uint64_t digests[3];
+        for (int mode = 0; mode < 3; ++mode) {
+            PopulationBars bars;
+            bars.setLoaderThreads(mode == 2 ? loaderThreads : 1);
+            bars.setUseDatasetCache(false);
+            if (!(mode == 0 ? bars.loadFromCSVStream(path) : bars.loadFromCSV(path))) return 1;
+            stats[mode] = bars.getLastLoadStats();
+            digests[mode] = fingerprint(bars);
+        }
+        std::error_code ec;
+        fs::remove(path, ec);
+
+        bool match = digests[0] == digests[1] && digests[0] == digests[2] &&
+                     stats[0].rows == stats[1].rows && stats[0].rows == stats[2].rows;
+        allMatch = allMatch && match;
+        std::cout << std::left << std::setw(12) << rows
+                  << std::setw(10) << std::fixed << std::setprecision(1) << stats[1].bytes / (1024.0 * 1024.0)
+                  << std::setw(14) << stats[0].seconds * 1000.0
+                  << std::setw(14) << stats[1].seconds * 1000.0
+                  << std::setw(16) << stats[2].seconds * 1000.0
+                  << std::setprecision(0)
+                  << std::setw(16) << stats[0].rowsPerSecond()
+                  << std::setw(16) << stats[1].rowsPerSecond()
+                  << std::setw(18) << stats[2].rowsPerSecond()
+                  << std::setw(10) << stats[2].threads
+                  << (match ? "match" : "MISMATCH") << std::endl;
+    }
+    return allMatch ? 0 : 1;
+}
+
+int runCsvScanBenchmark(size_t megabytes) {
+    // Mix plain and quoted entity names so the quote masks are exercised
+    std::string text = "Entity,Code,Year,Population density,Coord_X,Coord_Y\n";
+    const size_t targetBytes = megabytes << 20;
+    for (size_t i = 0; text.size() < targetBytes; ++i) {
+        if (i % 7 == 0) text += "\"Korea, Republic of\",KOR,";
+        else if (i % 13 == 0) text += "\"Region \"\"North\"\", Zone\",RNZ,";
+        else text += "Albania,ALB,";
+        text += std::to_string(1900 + i % 201) + "," + std::to_string((i * 7919) % 100000 / 10.0) + ",2810,2747\n";
+    }
+    const char* begin = text.data();
+    const char* end = text.data() + text.size();
+    const char* blocksEnd = end - text.size() % 64;
+    double gigabytes = text.size() / 1e9;
+
+    std::cout << std::left << std::setw(10) << "path" << std::setw(16) << "classify GB/s"
+              << std::setw(16) << "tokenize GB/s" << std::setw(12) << "rows" << "result" << std::endl;
+    bool allMatch = true;
+    uint64_t referenceMasks = 0, referenceFields = 0;
+    const CsvScanPath paths[] = { CsvScanPath::Scalar, CsvScanPath::SSE42, CsvScanPath::AVX2 };
+    for (CsvScanPath path : paths) {
+        if (!isCsvScanPathSupported(path)) {
+            std::cout << std::left << std::setw(10) << csvScanPathName(path) << "not supported by this CPU" << std::endl;
+            continue;
+        }
+        CsvClassifyFn classify = getCsvClassifier(path);
+
+        uint64_t maskDigest = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const char* p = begin; p < blocksEnd; p += 64) {
+            CsvBlockMasks masks;
+            classify(p, masks);
+            maskDigest = (maskDigest ^ masks.comma ^ (masks.quote << 1) ^ (masks.newline << 2)) * 1099511628211ull;
+        }
+        double classifySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // Full tokenization, checking every path splits "Korea, Republic of" into one field
+        uint64_t fieldDigest = 0;
+        size_t rows = 0;
+        bool fieldsOk = true;
+        start = std::chrono::steady_clock::now();
+        CsvTokenizer tokenizer(begin, end, classify);
+        while (tokenizer.nextRow()) {
+            ++rows;
+            if (tokenizer.fieldCount() != 6) fieldsOk = false;
+            for (int i = 0; i < tokenizer.fieldCount(); ++i) fieldDigest = (fieldDigest ^ tokenizer.field(i).size()) * 1099511628211ull;
+        }
+        double tokenizeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (path == CsvScanPath::Scalar) {
+            referenceMasks = maskDigest;
+            referenceFields = fieldDigest;
+        }
+        bool match = fieldsOk && maskDigest == referenceMasks && fieldDigest == referenceFields;
+        allMatch = allMatch && match;
+        std::cout << std::left << std::setw(10) << csvScanPathName(path) << std::fixed << std::setprecision(2)
+                  << std::setw(16) << (blocksEnd - begin) / 1e9 / std::max(classifySeconds, 1e-9)
+                  << std::setw(16) << gigabytes / std::max(tokenizeSeconds, 1e-9)
+                  << std::setw(12) << rows << (match ? "match" : "MISMATCH") << std::endl;
+    }
+    std::cout << "Selected at runtime: " << csvScanPathName(detectCsvScanPath()) << std::endl;
+    return allMatch ? 0 : 1;
+}
+
+int runDatasetCacheCheck(const std::string& csvPath) {
+    // Work on a copy so the real cache is left alone and the CSV can be modified
+    fs::path dir = fs::temp_directory_path() / "population_cache_check";
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    fs::create_directories(dir, ec);
+    std::string csvCopy = (dir / "dataset.csv").string();
+    fs::copy_file(csvPath, csvCopy, ec);
+    if (ec) {
+        std::cerr << "Failed to copy " << csvPath << ": " << ec.message() << std::endl;
+        return 1;
+    }
+    bool ok = true;
+    auto sameTable = [](const PopulationBars& a, const PopulationBars& b) {
+        return fingerprint(a) == fingerprint(b) && a.getEntities().size() == b.getEntities().size() &&
+               a.minYear == b.minYear && a.maxYear == b.maxYear &&
+               a.getGlobalMaxDensity() == b.getGlobalMaxDensity();
+    };
+
+    PopulationBars parsed;
+    parsed.setUseDatasetCache(false);
+    check(ok, parsed.loadFromCSV(csvCopy), "CSV parses without the cache");
+
+    PopulationBars first;
+    check(ok, first.loadFromCSV(csvCopy) && !first.getLastLoadStats().fromCache, "first load parses the CSV");
+    check(ok, fs::exists(DatasetCache::cachePathFor(csvCopy)), "cache written next to the CSV");
+
+    PopulationBars cached;
+    check(ok, cached.loadFromCSV(csvCopy) && cached.getLastLoadStats().fromCache, "second load maps the cache");
+    check(ok, sameTable(parsed, cached), "cache matches the CSV parse");
+    std::cout << "  parse " << first.getLastLoadStats().seconds * 1000.0 << " ms, cache "
+              << cached.getLastLoadStats().seconds * 1000.0 << " ms" << std::endl;
+
+    // Appending a row changes size and mtime, the cache must be rebuilt and include it
+    {
+        std::ofstream append(csvCopy, std::ios::app | std::ios::binary);
+        append << "Cache Check,CCK,2025,1.5,100,100\n";
+    }
+    PopulationBars reparsed;
+    check(ok, reparsed.loadFromCSV(csvCopy) && !reparsed.getLastLoadStats().fromCache, "modified CSV invalidates the cache");
+    check(ok, reparsed.getLastLoadStats().rows == parsed.getLastLoadStats().rows + 1, "modified CSV row is loaded");
+
+    fs::remove_all(dir, ec);
+    std::cout << (ok ? "Dataset cache check passed" : "Dataset cache check FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
+
+int runYearScrubBenchmark(const std::vector<uint32_t>& entityCounts) {
+    fs::path dir = fs::temp_directory_path();
+    std::cout << std::left << std::setw(12) << "entities" << std::setw(8) << "years" << std::setw(12) << "passes"
+              << std::setw(16) << "matrix ns" << std::setw(16) << "map copy ns" << "result" << std::endl;
+    bool allMatch = true;
+    for (uint32_t entityCount : entityCounts) {
+        std::string path = (dir / ("population_scrub_" + std::to_string(entityCount) + ".csv")).string();
+        if (!writeSyntheticCSV(path, (size_t)entityCount * 201)) return 1;
+        PopulationBars bars;
+        bars.setUseDatasetCache(false);
+        bool loaded = bars.loadFromCSV(path);
+        std::error_code ec;
+        fs::remove(path, ec);
+        if (!loaded) return 1;
+
+        const PopulationTimeSeries& series = bars.getTimeSeries();
+        const int firstYear = series.minYear(), lastYear = series.maxYear();
+        // The previous layout: a hash map of per-year vectors copied into two vectors on every switch
+        struct LegacyBar {
+            uint32_t entity;
+            float density;
+            float x, y;
+        };
+        std::unordered_map<int, std::vector<LegacyBar>> yearToBars;
+        for (int year = firstYear; year <= lastYear; ++year) {
+            const float* row = series.row(year);
+            for (uint32_t e = 0; e < series.entityCount(); ++e)
+                if (!PopulationTimeSeries::isMissing(row[e]))
+                    yearToBars[year].push_back({ e, row[e], bars.getEntities().x(e), bars.getEntities().y(e) });
+        }
+        std::vector<LegacyBar> copyBars, copyAllBars;
+
+        // Enough forward + backward passes for roughly a million switches
+        const int yearCount = series.yearCount();
+        const int passes = std::max(1, 1000000 / (2 * yearCount));
+        auto start = std::chrono::steady_clock::now();
+        for (int pass = 0; pass < passes; ++pass) {
+            for (int year = firstYear; year <= lastYear; ++year) {
+                bars.setYear(year);
+            }
+            for (int year = lastYear; year >= firstYear; --year) {
+                bars.setYear(year);
+            }
+        }
+        double matrixSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // Fewer passes for the copying version, it is orders of magnitude slower on large tables
+        const int mapPasses = std::max(1, passes * 46 / (int)std::max<uint32_t>(entityCount, 46));
+        start = std::chrono::steady_clock::now();
+        for (int pass = 0; pass < mapPasses; ++pass) {
+            for (int step = 0; step < 2 * yearCount; ++step) {
+                int year = step < yearCount ? firstYear + step : lastYear - (step - yearCount);
+                auto it = yearToBars.find(year);
+                copyBars = it->second;
+                copyAllBars = it->second;
+            }
+        }
+        double mapSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // One pass of each: every year's row must hold exactly the bars the map copies, by entity id
+        bool match = true;
+        for (int year = firstYear; match && year <= lastYear; ++year) {
+            bars.setYear(year);
+            const float* row = bars.getYearDensities();
+            copyBars = yearToBars[year];
+            size_t present = 0;
+            for (uint32_t e = 0; e < series.entityCount(); ++e)
+                if (!PopulationTimeSeries::isMissing(row[e])) ++present;
+            match = present == copyBars.size();
+            for (const LegacyBar& bar : copyBars) match = match && row[bar.entity] == bar.density;
+        }
+        allMatch = allMatch && match;
+        std::cout << std::left << std::setw(12) << entityCount << std::setw(8) << yearCount << std::setw(12) << passes
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(16) << matrixSeconds * 1e9 / (2.0 * yearCount * passes)
+                  << std::setw(16) << mapSeconds * 1e9 / (2.0 * yearCount * mapPasses)
+                  << (match ? "match" : "MISMATCH") << std::endl;
+    }
+    return allMatch ? 0 : 1;
+}
+
+int runPickBenchmark(const std::vector<size_t>& barCounts) {
+    std::cout << std::left << std::setw(12) << "bars" << std::setw(14) << "build ms" << std::setw(16) << "linear us/pick"
+              << std::setw(14) << "bvh us/pick" << std::setw(10) << "speedup" << std::setw(12) << "hits" << "result" << std::endl;
+    bool allMatch = true;
+    const float mapWidth = 4.592f, mapHeight = 3.196f, baseZ = 0.01f;
+    for (size_t count : barCounts) {
+        // Square grid over the map with random heights, footprints shrink as the grid gets denser
+        size_t side = (size_t)std::ceil(std::sqrt((double)count));
+        float spacing = mapWidth / side;
+        std::mt19937 rng(12345);
+        std::uniform_real_distribution<float> height(0.0f, 1.5f);
+        std::vector<glm::vec2> centers(count);
+        std::vector<float> topZ(count);
+        for (size_t i = 0; i < count; ++i) {
+            centers[i] = glm::vec2(-0.5f * mapWidth + spacing * (i % side + 0.5f), -0.5f * mapHeight + spacing * 0.7f * (i / side + 0.5f));
+            topZ[i] = baseZ + height(rng);
+        }
+        const float halfSize = std::min(0.04f, 0.4f * spacing);
+
+        auto start = std::chrono::steady_clock::now();
+        BarBvh bvh;
+        bvh.build(centers, halfSize, baseZ, topZ);
+        double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // Rays from a raised camera through random points of the map, as the mouse would cast them
+        const int rayCount = 1000;
+        const glm::vec3 eye(0.0f, -4.0f, 3.0f);
+        std::uniform_real_distribution<float> u(-0.5f, 0.5f);
+        std::vector<glm::vec3> dirs(rayCount);
+        for (auto& dir : dirs) dir = glm::normalize(glm::vec3(u(rng) * mapWidth, u(rng) * mapHeight, 0.5f) - eye);
+
+        const int linearRays = count >= 1000000 ? 50 : (count >= 100000 ? 200 : rayCount);
+        std::vector<int64_t> linearHits(linearRays);
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < linearRays; ++r) {
+            glm::vec3 invDir = 1.0f / dirs[r];
+            float best = std::numeric_limits<float>::infinity();
+            int64_t bestItem = -1;
+            for (size_t i = 0; i < count; ++i) {
+                float t = rayBoxEntry(eye, invDir, glm::vec3(centers[i] - halfSize, baseZ), glm::vec3(centers[i] + halfSize, topZ[i]), best);
+                if (t < best) {
+                    best = t;
+                    bestItem = (int64_t)i;
+                }
+            }
+            linearHits[r] = bestItem;
+        }
+        double linearSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<int64_t> bvhHits(rayCount);
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rayCount; ++r) {
+            glm::vec3 invDir = 1.0f / dirs[r];
+            bvhHits[r] = bvh.closestHit(eye, dirs[r], [&](uint32_t i, float maxT) {
+                return rayBoxEntry(eye, invDir, glm::vec3(centers[i] - halfSize, baseZ), glm::vec3(centers[i] + halfSize, topZ[i]), maxT);
+            });
+        }
+        double bvhSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        int hits = 0;
+        bool match = true;
+        for (int r = 0; r < linearRays; ++r) {
+            match = match && linearHits[r] == bvhHits[r];
+            hits += linearHits[r] >= 0;
+        }
+        allMatch = allMatch && match;
+        double linearUs = linearSeconds * 1e6 / linearRays, bvhUs = bvhSeconds * 1e6 / rayCount;
+        std::cout << std::left << std::setw(12) << count << std::fixed << std::setprecision(2)
+                  << std::setw(14) << buildSeconds * 1000.0 << std::setw(16) << linearUs << std::setw(14) << bvhUs
+                  << std::setw(10) << std::setprecision(0) << linearUs / std::max(bvhUs, 1e-9)
+                  << std::setw(12) << std::to_string(hits) + "/" + std::to_string(linearRays)
+                  << (match ? "match" : "MISMATCH") << std::endl;
+    }
+    return allMatch ? 0 : 1;
+}
+
+int runCullBenchmark(const std::vector<size_t>& barCounts) {
+    std::cout << std::left << std::setw(12) << "bars" << std::setw(10) << "cells" << std::setw(12) << "build ms"
+              << std::setw(12) << "drawn" << std::setw(14) << "per-bar ms" << std::setw(12) << "grid ms"
+              << std::setw(10) << "speedup" << "result" << std::endl;
+    bool allMatch = true;
+    const float mapWidth = 4.592f, mapHeight = 3.196f, baseZ = 0.01f;
+    // Flying low over one corner of the map, most bars are behind or beside the camera
+    const glm::mat4 viewProj = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f) *
+                               glm::lookAt(glm::vec3(0.6f, 0.8f, 0.12f), glm::vec3(1.6f, 1.2f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    const Frustum frustum = Frustum::fromViewProj(viewProj);
+    for (size_t count : barCounts) {
+        size_t side = (size_t)std::ceil(std::sqrt((double)count));
+        float spacing = mapWidth / side;
+        std::mt19937 rng(12345);
+        std::uniform_real_distribution<float> height(0.0f, 1.5f);
+        std::vector<glm::vec2> centers(count);
+        std::vector<float> topZ(count);
+        for (size_t i = 0; i < count; ++i) {
+            centers[i] = glm::vec2(-0.5f * mapWidth + spacing * (i % side + 0.5f), -0.5f * mapHeight + spacing * 0.7f * (i / side + 0.5f));
+            topZ[i] = baseZ + height(rng);
+        }
+        const float halfSize = std::min(0.04f, 0.4f * spacing);
+        auto keep = [](uint32_t) { return true; };
+
+        auto start = std::chrono::steady_clock::now();
+        BarCullGrid grid;
+        grid.build(centers, halfSize, baseZ, topZ);
+        double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const int frames = count >= 1000000 ? 5 : 50;
+        std::vector<uint32_t> perBar, gridList;
+        perBar.reserve(count);
+        gridList.reserve(count);
+        start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; ++f) {
+            perBar.clear();
+            for (uint32_t i = 0; i < (uint32_t)count; ++i)
+                if (frustum.intersects(glm::vec3(centers[i] - halfSize, baseZ), glm::vec3(centers[i] + halfSize, topZ[i]))) perBar.push_back(i);
+        }
+        double perBarSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / frames;
+        start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; ++f) {
+            gridList.clear();
+            grid.cull(frustum, keep, gridList);
+        }
+        double gridSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / frames;
+
+        std::sort(gridList.begin(), gridList.end());
+        bool match = gridList == perBar;
+        allMatch = allMatch && match;
+        std::cout << std::left << std::setw(12) << count << std::setw(10) << grid.cellCount() << std::fixed << std::setprecision(2)
+                  << std::setw(12) << buildSeconds * 1000.0
+                  << std::setw(12) << std::to_string(gridList.size() * 100 / std::max<size_t>(count, 1)) + "%"
+                  << std::setw(14) << std::setprecision(3) << perBarSeconds * 1000.0 << std::setw(12) << gridSeconds * 1000.0
+                  << std::setw(10) << std::setprecision(1) << perBarSeconds / std::max(gridSeconds, 1e-12)
+                  << (match ? "match" : "MISMATCH") << std::endl;
+    }
+    return allMatch ? 0 : 1;
+}
+
+// Cheap integer hash to [0, 1)
+static float hashUnit(uint32_t x, uint32_t y, uint32_t salt) {
+    uint32_t h = x * 0x8da6b343u ^ y * 0xd8163841u ^ salt * 0xcb1ab31fu;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    h *= 0x297a2d39u;
+    h ^= h >> 15;
+    return (h >> 8) * (1.0f / 16777216.0f);
+}
+
+std::vector<float> makeSyntheticDensityRaster(uint32_t width, uint32_t height, uint32_t seed) {
+    std::vector<float> raster((size_t)width * height);
+    const float missing = std::numeric_limits<float>::quiet_NaN();
+    ThreadPool pool(0);
+    pool.parallelFor(height, [&](size_t row) {
+        uint32_t y = (uint32_t)row;
+        for (uint32_t x = 0; x < width; ++x) {
+            // Blocks of 256x256 cells are sea (no data) a fifth of the time
+            if (hashUnit(x >> 8, y >> 8, seed) < 0.2f) {
+                raster[(size_t)y * width + x] = missing;
+                continue;
+            }
+            // Multiplicative cascade over every other scale gives clustered, heavy-tailed densities
+            float density = 20.0f;
+            for (uint32_t level = 0; level < 16; level += 2) density *= 0.25f + 1.5f * hashUnit(x >> level, y >> level, seed + level + 1);
+            raster[(size_t)y * width + x] = density;
+        }
+    });
+    return raster;
+}
+
+int runLodBenchmark(const std::vector<size_t>& cellCounts) {
+    const float mapWidth = 4.592f, mapHeight = 3.196f, baseZ = 0.01f;
+    const float viewportHeight = 1080.0f, pixelError = 6.0f;
+    const size_t budget = 200000;
+    const glm::mat4 proj = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.01f, 100.0f);
+    struct View { const char* name; glm::mat4 viewProj; };
+    const View views[] = {
+        { "overview", proj * glm::lookAt(glm::vec3(0.0f, -4.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f)) },
+        { "low", proj * glm::lookAt(glm::vec3(0.6f, 0.8f, 0.12f), glm::vec3(1.6f, 1.2f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)) },
+        { "close", proj * glm::lookAt(glm::vec3(0.3f, 0.2f, 0.08f), glm::vec3(0.35f, 0.3f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)) },
+    };
+    auto heightOf = [](float density) { return 0.15f * std::log(density + 1.0f); };
+    bool ok = true;
+    for (size_t cells : cellCounts) {
+        uint32_t width = (uint32_t)std::max(1.0, std::round(std::sqrt((double)cells * mapWidth / mapHeight)));
+        uint32_t height = (uint32_t)std::max<size_t>(1, cells / width);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<float> raster = makeSyntheticDensityRaster(width, height, 7);
+        double generateSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        // Area-weighted mean of the whole raster, the root must reproduce it
+        double sum = 0.0;
+        size_t valid = 0;
+        for (float d : raster)
+            if (!std::isnan(d)) {
+                sum += d;
+                ++valid;
+            }
+        start = std::chrono::steady_clock::now();
+        DensityQuadtree tree;
+        tree.build(std::move(raster), width, height);
+        double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        tree.setExtent(glm::vec2(-0.5f * mapWidth, -0.5f * mapHeight), glm::vec2(0.5f * mapWidth, 0.5f * mapHeight), baseZ);
+        std::vector<LodBar> bars;
+        LodSelectStats rootOnly = tree.select(views[0].viewProj, 1.0f, 1e9f, budget, heightOf, bars);
+        double expected = valid ? sum / valid : 0.0;
+        bool meanOk = rootOnly.bars == 1 && std::abs(bars[0].density - expected) <= 1e-4 * expected;
+
+        std::cout << width << " x " << height << " cells (" << std::fixed << std::setprecision(1) << width * (double)height / 1e6
+                  << "M), " << tree.levelCount() << " levels, " << tree.memoryBytes() / (1024 * 1024) << " MB; generated in "
+                  << std::setprecision(2) << generateSeconds << " s, built in " << buildSeconds << " s; root mean "
+                  << (meanOk ? "matches" : "DIFFERS") << std::endl;
+        std::cout << "  " << std::left << std::setw(10) << "view" << std::setw(10) << "bars" << std::setw(12) << "nodes"
+                  << std::setw(10) << "ms" << "budget" << std::endl;
+        ok = ok && meanOk;
+        for (const View& view : views) {
+            LodSelectStats best;
+            double bestMs = 1e30;
+            for (int repeat = 0; repeat < 3; ++repeat) {
+                start = std::chrono::steady_clock::now();
+                LodSelectStats stats = tree.select(view.viewProj, viewportHeight, pixelError, budget, heightOf, bars);
+                double ms = msSince(start);
+                if (ms < bestMs) {
+                    bestMs = ms;
+                    best = stats;
+                }
+            }
+            ok = ok && best.bars <= budget && best.bars > 0;
+            std::cout << "  " << std::setw(10) << view.name << std::setw(10) << best.bars << std::setw(12) << best.nodesVisited
+                      << std::setw(10) << std::setprecision(2) << bestMs << (best.budgetReached ? "reached" : "-") << std::endl;
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+int runRayBoxBenchmark(size_t boxCount) {
+    // Random bars over the map, a few placed exactly on ray-origin planes so 0 * inf NaNs are covered
+    std::mt19937 rng(777);
+    std::uniform_real_distribution<float> u(-0.5f, 0.5f), height(0.0f, 1.5f);
+    BoxSoA boxes;
+    boxes.resize(boxCount);
+    for (size_t i = 0; i < boxCount; ++i) {
+        glm::vec2 center(u(rng) * 4.592f, u(rng) * 3.196f);
+        if (i % 97 == 0) center.x = 0.04f;
+        boxes.set(i, glm::vec3(center - 0.04f, 0.01f), glm::vec3(center + 0.04f, 0.01f + height(rng)));
+    }
+    std::vector<glm::vec3> origins, dirs;
+    const glm::vec3 eye(0.0f, -4.0f, 3.0f);
+    for (int r = 0; r < 64; ++r) {
+        origins.push_back(eye);
+        dirs.push_back(glm::normalize(glm::vec3(u(rng) * 4.592f, u(rng) * 3.196f, 0.5f) - eye));
+    }
+    // Axis-parallel rays give infinite inverse components
+    origins.push_back(glm::vec3(0.0f, -4.0f, 0.5f));
+    dirs.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+    origins.push_back(glm::vec3(0.0f, 0.0f, 3.0f));
+    dirs.push_back(glm::vec3(0.0f, 0.0f, -1.0f));
+
+    std::cout << std::left << std::setw(10) << "path" << std::setw(18) << "distances box/ns"
+              << std::setw(18) << "nearest box/ns" << "result" << std::endl;
+    std::vector<float> reference(boxCount), distances(boxCount);
+    std::vector<int64_t> referenceNearest(origins.size());
+    std::vector<float> referenceT(origins.size());
+    bool allMatch = true;
+    const RayBoxPath paths[] = { RayBoxPath::Scalar, RayBoxPath::AVX2, RayBoxPath::AVX512 };
+    for (RayBoxPath path : paths) {
+        if (!isRayBoxPathSupported(path)) {
+            std::cout << std::left << std::setw(10) << rayBoxPathName(path) << "not supported by this CPU" << std::endl;
+            continue;
+        }
+        RayBoxKernel kernel = getRayBoxKernel(path);
+        bool match = true;
+        double distanceSeconds = 0.0, nearestSeconds = 0.0;
+        for (size_t r = 0; r < origins.size(); ++r) {
+            glm::vec3 invDir = 1.0f / dirs[r];
+            auto start = std::chrono::steady_clock::now();
+            kernel.distances(boxes, origins[r], invDir, distances.data());
+            distanceSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            float bestT = std::numeric_limits<float>::infinity();
+            start = std::chrono::steady_clock::now();
+            int64_t nearest = kernel.nearest(boxes, origins[r], invDir, bestT);
+            nearestSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            // Bit-identical to the scalar slab test, NaN-free results compared as raw bits
+            if (path == RayBoxPath::Scalar) {
+                for (size_t i = 0; i < boxCount; ++i)
+                    match = match && std::memcmp(&distances[i], &(reference[i] = rayBoxEntry(origins[r], invDir,
+                        glm::vec3(boxes.minX[i], boxes.minY[i], boxes.minZ[i]), glm::vec3(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]))), 4) == 0;
+                referenceNearest[r] = nearest;
+                referenceT[r] = bestT;
+            } else {
+                for (size_t i = 0; i < boxCount; ++i)
+                    reference[i] = rayBoxEntry(origins[r], invDir, glm::vec3(boxes.minX[i], boxes.minY[i], boxes.minZ[i]),
+                                               glm::vec3(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]));
+                match = match && std::memcmp(distances.data(), reference.data(), boxCount * sizeof(float)) == 0 &&
+                        nearest == referenceNearest[r] && std::memcmp(&bestT, &referenceT[r], 4) == 0;
+            }
+        }
+        allMatch = allMatch && match;
+        double tested = (double)boxCount * origins.size();
+        std::cout << std::left << std::setw(10) << rayBoxPathName(path) << std::fixed << std::setprecision(2)
+                  << std::setw(18) << tested / std::max(distanceSeconds * 1e9, 1e-9)
+                  << std::setw(18) << tested / std::max(nearestSeconds * 1e9, 1e-9)
+                  << (match ? "bit-identical" : "MISMATCH") << std::endl;
+    }
+    std::cout << "Selected at runtime: " << rayBoxPathName(detectRayBoxPath()) << std::endl;
+    return allMatch ? 0 : 1;
+}
+
+// Offscreen colour + depth target for the GL checks
+struct CheckFramebuffer {
+    GLuint fbo = 0, color = 0, depth = 0;
+    int width = 0, height = 0;
+    bool create(int w, int h) {
+        width = w;
+        height = h;
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        glViewport(0, 0, w, h);
+        return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+    std::vector<uint8_t> read() const {
+        std::vector<uint8_t> pixels((size_t)width * height * 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        return pixels;
+    }
+    ~CheckFramebuffer() {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (fbo) glDeleteFramebuffers(1, &fbo);
+        if (color) glDeleteRenderbuffers(1, &color);
+        if (depth) glDeleteRenderbuffers(1, &depth);
+    }
+};
+
+int runGpuTimelineCheck(const std::string& csvPath) {
+    bool ok = true;
+    printRenderer();
+    PopulationBars bars;
+    if (!bars.loadFromCSV(csvPath) || !bars.initialize(4.592f, 3.196f, 0.02f)) {
+        check(ok, false, "bars load and initialize");
+        return 1;
+    }
+    CheckFramebuffer target;
+    check(ok, target.create(320, 240), "offscreen framebuffer");
+    glm::mat4 viewProj = glm::perspective(glm::radians(45.0f), 320.0f / 240.0f, 0.1f, 100.0f) *
+                         glm::lookAt(glm::vec3(0.0f, -4.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    auto render = [&](int year, bool logScale) {
+        bars.setYear(year);
+        bars.setLogScale(logScale);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_DEPTH_TEST);
+        bars.draw(viewProj);
+        return target.read();
+    };
+    auto [firstYear, lastYear] = bars.getYearRange();
+    bars.flushVisibility();
+
+    // A full timelapse with the scale toggled along the way, as the UI does it each frame
+    const BarResourceStats before = bars.getResourceStats();
+    std::vector<uint8_t> firstFrame = render(firstYear, true);
+    std::vector<uint8_t> lastFrame;
+    for (int year = firstYear; year <= lastYear; ++year) {
+        bars.flushVisibility();
+        lastFrame = render(year, (year / 10) % 2 == 0);
+        bars.pickBar(160.0f, 120.0f, glm::mat4(1.0f), glm::mat4(1.0f), 320, 240);
+    }
+    lastFrame = render(lastYear, true);
+    std::vector<uint8_t> linearFrame = render(lastYear, false);
+    BarResourceStats after = bars.getResourceStats();
+    check(ok, glGetError() == GL_NO_ERROR, "no GL errors");
+    check(ok, std::count(lastFrame.begin(), lastFrame.end(), 0) < (long)lastFrame.size() * 3 / 4, "bars are drawn");
+    check(ok, firstFrame != lastFrame, "year change alters the image");
+    check(ok, lastFrame != linearFrame, "log/linear toggle alters the image");
+    std::cout << "  uploads during timelapse: " << after.uploads - before.uploads
+              << " (" << after.bytes - before.bytes << " bytes), " << before.uploads << " at startup ("
+              << before.bytes << " bytes)" << std::endl;
+    check(ok, after.uploads == before.uploads && after.allocations == before.allocations,
+          "no buffer uploads or allocations while switching year or scale");
+
+    // Frustum culling must not change the image, from the overview or flying low with most bars out of view
+    glm::mat4 lowViewProj = glm::perspective(glm::radians(45.0f), 320.0f / 240.0f, 0.1f, 100.0f) *
+                            glm::lookAt(glm::vec3(-1.2f, -1.0f, 0.25f), glm::vec3(0.5f, 0.3f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    auto renderCulled = [&](const glm::mat4& vp, bool culling) {
+        bars.setCulling(culling);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        bars.draw(vp);
+        return target.read();
+    };
+    bars.setYear(lastYear);
+    bool sameImage = renderCulled(viewProj, true) == renderCulled(viewProj, false);
+    std::vector<uint8_t> lowCulled = renderCulled(lowViewProj, true);
+    BarCullStats lowStats = bars.getCullStats();
+    sameImage = sameImage && lowCulled == renderCulled(lowViewProj, false);
+    std::cout << "  flying low: " << lowStats.visible << " bars drawn, " << lowStats.culled << " culled in "
+              << std::setprecision(3) << lowStats.cullMs << " ms" << std::endl;
+    check(ok, sameImage && lowStats.culled > 0 && lowStats.visible > 0, "frustum culling draws the same image from fewer bars");
+    renderCulled(lowViewProj, true);
+    check(ok, bars.getCullStats().cullMs == 0.0, "an unchanged camera reuses the culled list");
+
+    // Culled lists go through the streaming ring: one write per camera change, none on idle frames,
+    // and the same image whether the ring is mapped persistently or per write
+    const StreamingStats streamStart = bars.getStreamingStats();
+    auto turned = [&](int step) { return lowViewProj * glm::rotate(glm::mat4(1.0f), 0.05f * step, glm::vec3(0.0f, 0.0f, 1.0f)); };
+    std::vector<std::vector<uint8_t>> streamedFrames;
+    for (int step = 1; step <= 6; ++step) streamedFrames.push_back(renderCulled(turned(step), true));
+    renderCulled(turned(6), true);
+    renderCulled(turned(6), true);
+    const StreamingStats streamed = bars.getStreamingStats();
+    const bool persistent = bars.isStreamingPersistent();
+    bars.setPersistentStreaming(false);
+    bool sameStreamed = true;
+    for (int step = 1; step <= 6; ++step) sameStreamed = sameStreamed && renderCulled(turned(step), true) == streamedFrames[step - 1];
+    bars.setPersistentStreaming(true);
+    std::cout << "  streamed " << streamed.writes - streamStart.writes << " culled lists, "
+              << streamed.bytes - streamStart.bytes << " bytes, " << streamed.fenceWaits - streamStart.fenceWaits
+              << " fence waits (" << std::setprecision(3) << streamed.fenceWaitMs - streamStart.fenceWaitMs << " ms), "
+              << (persistent ? "persistent mapping" : "unsynchronized mapping") << std::endl;
+    check(ok, streamed.writes - streamStart.writes == 6 && streamed.frameBytes == 0 && streamed.reallocations == 0,
+          "culled lists stream once per camera change without reallocating");
+    check(ok, sameStreamed && glGetError() == GL_NO_ERROR, "unsynchronized streaming draws the same image");
+    bars.setCulling(true);
+
+    // Continuous playback: blended frames lie between the years, still without uploads
+    bars.setInterpolation(YearInterpolation::Linear);
+    std::vector<uint8_t> yearFrame = render(firstYear, true);
+    bars.setTime(firstYear + 0.5f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    bars.draw(viewProj);
+    check(ok, target.read() != yearFrame, "fractional time blends the bars");
+    const PopulationTimeSeries& series = bars.getTimeSeries();
+    bool bounded = true, interpolated = false;
+    bars.setInterpolation(YearInterpolation::MonotoneCubic);
+    for (float time = (float)firstYear; time < (float)lastYear; time += 0.125f) {
+        bars.setTime(time);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        bars.draw(viewProj);
+        int year = (int)std::floor(time);
+        for (int i = 0; i < bars.getBarCount(); ++i) {
+            uint32_t e = bars.getBarEntity(i);
+            float y0 = series.density(year, e), y1 = series.density(year + 1, e), d = bars.getBarDensity(i);
+            if (PopulationTimeSeries::isMissing(y1)) y1 = y0;
+            if (d < std::min(y0, y1) - 1e-3f * std::abs(y0) || d > std::max(y0, y1) + 1e-3f * std::abs(y1)) bounded = false;
+            interpolated = interpolated || bars.isBarInterpolated(i);
+        }
+    }
+    check(ok, bounded && interpolated, "monotone cubic stays between the bracketing years");
+    check(ok, bars.getResourceStats().uploads == before.uploads && bars.getResourceStats().allocations == before.allocations,
+          "no buffer uploads or allocations during continuous playback");
+    // Crossing into a year with data for the same entities keeps the bar list and the culled ids
+    for (int year = firstYear; year < lastYear; ++year) {
+        const float* row = series.row(year);
+        const float* next = series.row(year + 1);
+        bool sameSet = true;
+        for (uint32_t e = 0; sameSet && e < series.entityCount(); ++e)
+            sameSet = PopulationTimeSeries::isMissing(row[e]) == PopulationTimeSeries::isMissing(next[e]);
+        if (!sameSet) continue;
+        bars.setYear(year);
+        bars.draw(viewProj);
+        bars.setYear(year + 1);
+        bars.draw(viewProj);
+        bool current = true;
+        for (int i = 0; i < bars.getBarCount(); ++i)
+            current = current && bars.getBarDensity(i) == series.density(year + 1, bars.getBarEntity(i));
+        check(ok, bars.getCullStats().cullMs == 0.0 && current, "a year change with the same bars keeps the culled list");
+        break;
+    }
+
+    // Cursor sweep over the frame, every pick must name a bar that is drawn
+    glm::mat4 pickView = glm::lookAt(glm::vec3(0.0f, -4.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    glm::mat4 pickProj = glm::perspective(glm::radians(45.0f), 320.0f / 240.0f, 0.1f, 100.0f);
+    bars.setYear(lastYear);
+    int picked = 0;
+    bool pickValid = true;
+    for (int py = 0; py < 240; py += 4) {
+        for (int px = 0; px < 320; px += 4) {
+            int bar = bars.pickBar((float)px, (float)py, pickView, pickProj, 320, 240);
+            if (bar < 0) continue;
+            ++picked;
+            pickValid = pickValid && bar < bars.getBarCount() && bars.getBarDensity(bar) > 0.0f;
+        }
+    }
+    check(ok, picked > 0 && pickValid, "cursor picking hits drawn bars");
+
+    // Id-buffer picking answers one or two calls late, so each cursor position is repeated until
+    // the answer is current. From above nothing hides the bars, so it must agree with the ray cast.
+    auto pickBoth = [&](const glm::mat4& view, float px, float py, int& cpu, int& gpu) {
+        bars.setPickMode(PickMode::Cpu);
+        cpu = bars.pickBar(px, py, view, pickProj, 320, 240);
+        bars.setPickMode(PickMode::Gpu);
+        for (int repeat = 0; repeat < 3; ++repeat) {
+            gpu = bars.pickBar(px, py, view, pickProj, 320, 240);
+            glFinish();
+        }
+    };
+    check(ok, bars.isGpuPickingAvailable(), "id-buffer picking target");
+    int gpuSamples = 0, gpuAgree = 0, gpuHits = 0;
+    for (int py = 2; py < 240; py += 8) {
+        for (int px = 2; px < 320; px += 8) {
+            int cpu, gpu;
+            pickBoth(pickView, (float)px, (float)py, cpu, gpu);
+            ++gpuSamples;
+            gpuAgree += cpu == gpu;
+            gpuHits += gpu >= 0;
+        }
+    }
+    std::cout << "  id-buffer picks matching the ray cast: " << gpuAgree << "/" << gpuSamples << ", " << gpuHits << " on bars" << std::endl;
+    check(ok, gpuHits > 0 && gpuAgree >= gpuSamples * 98 / 100, "id-buffer picking matches ray picking");
+    // The ray cast tests the prism, not its square footprint, so hexagons agree as well
+    bars.setBarShape(BarShape::HexagonalPrism);
+    int hexAgree = 0;
+    for (int py = 2; py < 240; py += 8) {
+        for (int px = 2; px < 320; px += 8) {
+            int cpu, gpu;
+            pickBoth(pickView, (float)px, (float)py, cpu, gpu);
+            hexAgree += cpu == gpu;
+        }
+    }
+    bars.setBarShape(BarShape::Box);
+    std::cout << "  hexagonal id-buffer picks matching the ray cast: " << hexAgree << "/" << gpuSamples << std::endl;
+    check(ok, hexAgree >= gpuAgree, "hexagonal picking matches the drawn prisms as well as boxes do");
+    // Straight from below the map covers every bar, the ray cast does not know about it
+    glm::mat4 belowView = glm::lookAt(glm::vec3(0.0f, 0.0f, -5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    int cpuBelow = 0, gpuBelow = 0;
+    for (int py = 2; py < 240; py += 8) {
+        for (int px = 2; px < 320; px += 8) {
+            int cpu, gpu;
+            pickBoth(belowView, (float)px, (float)py, cpu, gpu);
+            cpuBelow += cpu >= 0;
+            gpuBelow += gpu >= 0;
+        }
+    }
+    std::cout << "  picks from below the map: " << cpuBelow << " ray cast, " << gpuBelow << " id buffer" << std::endl;
+    check(ok, cpuBelow > 0 && gpuBelow == 0, "id-buffer picking is occluded by the map");
+    bars.setPickMode(PickMode::Cpu);
+    check(ok, glGetError() == GL_NO_ERROR, "no GL errors while picking");
+
+    // Hover picking as the frame loop drives it: idle frames hit the cache, data changes re-pick,
+    // a camera jump is debounced
+    HoverPicker hover;
+    float hoverX = 160.0f, hoverY = 120.0f;
+    for (int py = 2; py < 240 && hover.getStats().picks == 0; py += 8)
+        for (int px = 2; px < 320; px += 8)
+            if (bars.pickBar((float)px, (float)py, pickView, pickProj, 320, 240) >= 0) {
+                hoverX = (float)px;
+                hoverY = (float)py;
+                hover.update(bars, hoverX, hoverY, pickView, pickProj, 320, 240);
+                break;
+            }
+    for (int frame = 0; frame < 9; ++frame) hover.update(bars, hoverX, hoverY, pickView, pickProj, 320, 240);
+    check(ok, hover.getStats().picks == 1 && hover.getStats().cached == 9 && hover.hovered() >= 0, "idle frames reuse the hover pick");
+    bars.setTime(lastYear - 0.5f);
+    hover.update(bars, hoverX, hoverY, pickView, pickProj, 320, 240);
+    check(ok, hover.getStats().picks == 2, "a data change re-picks");
+    glm::mat4 turnedView = glm::rotate(pickView, glm::radians(20.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    check(ok, hover.update(bars, hoverX, hoverY, turnedView, pickProj, 320, 240) == -1 && hover.getStats().debounced == 1,
+          "fast camera motion is debounced");
+    hover.update(bars, hoverX, hoverY, turnedView, pickProj, 320, 240);
+    check(ok, hover.getStats().picks == 3, "picking resumes once the camera settles");
+    // GPU answers lag, the cache must only settle on the current one
+    bars.setYear(lastYear);
+    bars.setPickMode(PickMode::Gpu);
+    int settled = -2;
+    for (int frame = 0; frame < 4; ++frame) {
+        settled = hover.update(bars, hoverX, hoverY, pickView, pickProj, 320, 240);
+        glFinish();
+    }
+    uint64_t settledPicks = hover.getStats().picks;
+    check(ok, hover.update(bars, hoverX, hoverY, pickView, pickProj, 320, 240) == settled && hover.getStats().picks == settledPicks,
+          "the settled GPU answer is cached");
+    bars.setPickMode(PickMode::Cpu);
+    check(ok, settled == bars.pickBar(hoverX, hoverY, pickView, pickProj, 320, 240), "hover cache settles on the GPU answer");
+
+    // Visibility changes upload only the mask, once per batch of changes
+    bars.setYear(lastYear);
+    int barCount = bars.getBarCount();
+    bars.setEntityVisible(bars.getBarEntity(0), false);
+    bars.setEntityVisible(bars.getBarEntity(1), false);
+    bars.flushVisibility();
+    bars.flushVisibility();
+    check(ok, bars.getResourceStats().uploads == before.uploads + 1 && bars.getResourceStats().allocations == before.allocations &&
+          bars.getBarCount() == barCount - 2, "hiding two entities is one upload and no allocation");
+    bars.setAllEntitiesVisible(false);
+    bars.flushVisibility();
+    check(ok, bars.getResourceStats().uploads == before.uploads + 2 && bars.getBarCount() == 0, "uncheck all is one upload");
+    std::vector<uint8_t> hiddenFrame = render(lastYear, true);
+    check(ok, std::count(hiddenFrame.begin(), hiddenFrame.end(), 0) == (long)hiddenFrame.size() - (long)hiddenFrame.size() / 4,
+          "hidden entities are not drawn");
+
+    // A gridded raster replaces the entity bars, drawn through the quadtree LOD within the bar budget
+    DensityQuadtree raster;
+    raster.build(makeSyntheticDensityRaster(1200, 835), 1200, 835);
+    bars.setDensityRaster(&raster);
+    bars.setRasterLod(5000, 6.0f);
+    std::vector<uint8_t> rasterFrame = render(lastYear, true);
+    const LodSelectStats& lodStats = bars.getRasterLodStats();
+    std::cout << "  raster LOD: " << lodStats.bars << " bars from " << raster.cellCount() << " cells, "
+              << lodStats.nodesVisited << " nodes visited" << std::endl;
+    check(ok, lodStats.bars > 0 && lodStats.bars <= 5000 && rasterFrame != hiddenFrame, "raster bars are drawn within the budget");
+    bars.setDensityRaster(nullptr);
+    check(ok, render(lastYear, true) == hiddenFrame && glGetError() == GL_NO_ERROR, "clearing the raster restores the entity bars");
+
+    // Compute culling writes the same survivors through an indirect draw
+    if (bars.isGpuCullingAvailable()) {
+        auto renderGpuCulled = [&](const glm::mat4& vp) {
+            bars.setGpuCulling(true);
+            std::vector<uint8_t> image = renderCulled(vp, true);
+            size_t count = bars.readGpuCulledCount();
+            bars.setGpuCulling(false);
+            return std::make_pair(image, count);
+        };
+        bool sameGpuImage = true, sameGpuCount = true;
+        bars.setAllEntitiesVisible(true);
+        bars.flushVisibility();
+        for (int pass = 0; pass < 2; ++pass) {
+            // Second pass with every other entity hidden
+            if (pass == 1) {
+                for (uint32_t e = 0; e < bars.getTimeSeries().entityCount(); e += 2) bars.setEntityVisible(e, false);
+                bars.flushVisibility();
+            }
+            for (const glm::mat4& vp : { viewProj, lowViewProj }) {
+                auto gpu = renderGpuCulled(vp);
+                std::vector<uint8_t> cpuImage = renderCulled(vp, true);
+                sameGpuImage = sameGpuImage && gpu.first == cpuImage;
+                sameGpuCount = sameGpuCount && gpu.second == bars.getCullStats().visible;
+            }
+        }
+        bars.setAllEntitiesVisible(true);
+        bars.flushVisibility();
+        auto lowGpu = renderGpuCulled(lowViewProj);
+        std::cout << "  compute culling, flying low: " << lowGpu.second << " bars drawn" << std::endl;
+        check(ok, sameGpuImage && sameGpuCount && glGetError() == GL_NO_ERROR,
+              "compute culling draws the same image from the same bars as the CPU grid");
+        bars.setGpuCullMinPixels(40.0f);
+        size_t lodCount = renderGpuCulled(viewProj).second;
+        bars.setGpuCullMinPixels(0.0f);
+        size_t fullCount = renderGpuCulled(viewProj).second;
+        std::cout << "  compute culling, bars under 40 px dropped: " << lodCount << " of " << fullCount << std::endl;
+        check(ok, lodCount < fullCount && lodCount > 0, "the compute screen-size cut drops the smallest bars");
+    } else {
+        std::cout << "  compute culling unavailable (needs GL 4.3), skipped" << std::endl;
+    }
+
+    // Generated box strips draw what the 36-vertex reference cube drew (the faces split along other
+    // diagonals, so the colour gradient may round differently by one), other shapes change the image
+    bars.setAllEntitiesVisible(true);
+    bars.flushVisibility();
+    auto renderShape = [&](BarShape shape, const glm::mat4& vp) {
+        bars.setBarShape(shape);
+        return renderCulled(vp, true);
+    };
+    bool sameBoxes = true;
+    for (const glm::mat4& vp : { viewProj, lowViewProj }) {
+        std::vector<uint8_t> strip = renderShape(BarShape::Box, vp), mesh = renderShape(BarShape::ReferenceMesh, vp);
+        sameBoxes = sameBoxes && std::equal(strip.begin(), strip.end(), mesh.begin(), mesh.end(),
+                                            [](uint8_t x, uint8_t y) { return std::abs(x - y) <= 1; });
+    }
+    check(ok, sameBoxes, "generated box strips match the reference mesh");
+    std::vector<uint8_t> boxFrame = renderShape(BarShape::Box, viewProj);
+    std::vector<uint8_t> hexFrame = renderShape(BarShape::HexagonalPrism, viewProj);
+    std::vector<uint8_t> cylinderFrame = renderShape(BarShape::Cylinder, viewProj);
+    check(ok, hexFrame != boxFrame && cylinderFrame != hexFrame && std::count(cylinderFrame.begin(), cylinderFrame.end(), 0) < (long)cylinderFrame.size() * 3 / 4,
+          "hexagonal prisms and cylinders are drawn");
+    if (bars.isGpuCullingAvailable()) {
+        bars.setBarShape(BarShape::Cylinder);
+        bars.setGpuCulling(true);
+        bool sameIndirect = renderCulled(viewProj, true) == cylinderFrame;
+        bars.setGpuCulling(false);
+        check(ok, sameIndirect, "indirect draws use the shape's vertex count");
+    }
+    bars.setBarShape(BarShape::Box);
+    check(ok, glGetError() == GL_NO_ERROR, "no GL errors while switching shapes");
+    std::cout << (ok ? "GPU timeline check passed" : "GPU timeline check FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
+
+int runBarShapeBenchmark(uint32_t entityCount) {
+    std::string path = (fs::temp_directory_path() / ("population_shapes_" + std::to_string(entityCount) + ".csv")).string();
+    if (!writeSyntheticCSV(path, (size_t)entityCount * 2, 2)) return 1;
+    PopulationBars bars;
+    bars.setUseDatasetCache(false);
+    bool loaded = bars.loadFromCSV(path);
+    std::error_code ec;
+    fs::remove(path, ec);
+    if (!loaded || !bars.initialize(4.592f, 3.196f, 0.02f)) return 1;
+    printRenderer();
+    // A small target keeps the bars a few pixels wide, so the draws are bound by vertex work
+    CheckFramebuffer target;
+    if (!target.create(256, 256)) return 1;
+    glm::mat4 viewProj = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f) *
+                         glm::lookAt(glm::vec3(0.0f, -4.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    bars.setCulling(false);
+    bars.setYear(bars.getYearRange().first);
+    glEnable(GL_DEPTH_TEST);
+
+    struct Path {
+        const char* name;
+        BarShape shape;
+    };
+    const Path paths[] = { { "36-vertex mesh", BarShape::ReferenceMesh }, { "box strip", BarShape::Box },
+                           { "hexagonal prism", BarShape::HexagonalPrism }, { "cylinder (16)", BarShape::Cylinder } };
+    std::cout << entityCount << " bars, 256x256 target" << std::endl;
+    std::cout << std::left << std::setw(18) << "path" << std::setw(10) << "vertices" << std::setw(12) << "ms/frame"
+              << std::setw(16) << "M instances/s" << "vs mesh" << std::endl;
+    double meshRate = 0.0;
+    for (const Path& path : paths) {
+        bars.setBarShape(path.shape);
+        auto frame = [&]() {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            bars.draw(viewProj);
+            glFinish();
+        };
+        frame();
+        int frames = 0;
+        auto start = std::chrono::steady_clock::now();
+        double seconds = 0.0;
+        while (frames < 3 || seconds < 1.0) {
+            frame();
+            ++frames;
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        double rate = (double)bars.getBarCount() * frames / seconds;
+        if (path.shape == BarShape::ReferenceMesh) meshRate = rate;
+        std::cout << std::left << std::setw(18) << path.name << std::setw(10) << bars.getBarVertexCount() << std::fixed
+                  << std::setprecision(2) << std::setw(12) << seconds * 1000.0 / frames << std::setw(16) << rate / 1e6
+                  << rate / meshRate << "x" << std::endl;
+    }
+    return glGetError() == GL_NO_ERROR ? 0 : 1;
+}
+
+int runMapTextureBenchmark(const std::string& imagePath) {
+    if (!CompressedTexture::isFormatSupported()) {
+        std::cerr << "GL_EXT_texture_compression_s3tc is not supported" << std::endl;
+        return 1;
+    }
+    printRenderer();
+    // Bytes the GL reports for every level of the bound texture
+    auto textureBytes = [](bool compressed) {
+        GLint maxLevel = 0;
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+        size_t bytes = 0;
+        for (GLint level = 0; level <= std::min(maxLevel, 31); ++level) {
+            GLint width = 0, height = 0, size = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+            if (width == 0 || height == 0) break;
+            if (compressed) glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            bytes += compressed ? (size_t)size : (size_t)width * height * 4;
+            if (width == 1 && height == 1) break;
+        }
+        return bytes;
+    };
+    GLuint textures[2];
+    glGenTextures(2, textures);
+
+    // Old path: decode the PNG, upload RGBA8 and let the driver build the mip chain
+    auto start = std::chrono::steady_clock::now();
+    DecodedImage image;
+    if (!decodeImage(imagePath, true, image)) {
+        std::cerr << "Failed to load texture: " << imagePath << std::endl;
+        return 1;
+    }
+    double decodeMs = msSince(start);
+    glBindTexture(GL_TEXTURE_2D, textures[0]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.get());
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glFinish();
+    double rgbaMs = msSince(start);
+    size_t rgbaBytes = textureBytes(false);
+
+    // First run: convert into a temporary cache next to a copy of the image (the real cache is left alone)
+    std::string sourceCopy = (fs::temp_directory_path() / "population_map_benchmark.png").string();
+    std::string cachePath = CompressedTexture::cachePathFor(sourceCopy);
+    std::error_code ec;
+    fs::copy_file(imagePath, sourceCopy, fs::copy_options::overwrite_existing, ec);
+    if (ec) return 1;
+    start = std::chrono::steady_clock::now();
+    DecodedImage firstRunImage;
+    bool converted = decodeImage(sourceCopy, true, firstRunImage) && CompressedTexture::write(cachePath, sourceCopy, firstRunImage);
+    double convertMs = msSince(start);
+
+    // Warm start: map the cache and upload the levels as they are
+    start = std::chrono::steady_clock::now();
+    CompressedTexture compressed;
+    bool opened = converted && compressed.open(cachePath, sourceCopy);
+    if (opened) {
+        glBindTexture(GL_TEXTURE_2D, textures[1]);
+        compressed.upload();
+        glFinish();
+    }
+    double warmMs = msSince(start);
+    size_t compressedBytes = opened ? textureBytes(true) : 0;
+    uint32_t levelCount = compressed.levelCount();
+
+    // Base level quality against the decoded image
+    double psnr = 0.0;
+    if (opened) {
+        CompressedTexture::Level base = compressed.level(0);
+        const uint8_t* blocks = static_cast<const uint8_t*>(base.data);
+        const uint32_t blocksX = (base.width + 3) / 4;
+        double squaredError = 0.0;
+        size_t samples = 0;
+        uint8_t rgba[64];
+        for (uint32_t by = 0; by < (base.height + 3) / 4; ++by) {
+            for (uint32_t bx = 0; bx < blocksX; ++bx) {
+                decodeBc1Block(blocks + ((size_t)by * blocksX + bx) * 8, rgba);
+                for (uint32_t i = 0; i < 16; ++i) {
+                    uint32_t x = bx * 4 + i % 4, y = by * 4 + i / 4;
+                    if (x >= base.width || y >= base.height) continue;
+                    const uint8_t* pixel = image.pixels.get() + ((size_t)y * base.width + x) * 4;
+                    for (int c = 0; c < 3; ++c) {
+                        double d = (double)rgba[i * 4 + c] - pixel[c];
+                        squaredError += d * d;
+                    }
+                    samples += 3;
+                }
+            }
+        }
+        double mse = squaredError / std::max<size_t>(samples, 1);
+        psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+    }
+    compressed.close();
+    glDeleteTextures(2, textures);
+    fs::remove(cachePath, ec);
+    fs::remove(sourceCopy, ec);
+
+    std::cout << imagePath << ": " << image.width << "x" << image.height << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "PNG + RGBA8 + glGenerateMipmap: " << rgbaMs << " ms (decode " << decodeMs << " ms), "
+              << rgbaBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+    std::cout << "First run, decode + BC1 conversion: " << convertMs << " ms" << std::endl;
+    std::cout << "Cached BC1, map + upload " << levelCount << " levels: " << warmMs << " ms, "
+              << compressedBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+    std::cout << std::setprecision(2) << "Load " << rgbaMs / std::max(warmMs, 1e-3) << "x faster, memory "
+              << (double)rgbaBytes / std::max<size_t>(compressedBytes, 1) << "x smaller, base level PSNR " << psnr << " dB"
+              << std::endl;
+    bool ok = opened && psnr > 30.0 && glGetError() == GL_NO_ERROR;
+    std::cout << (ok ? "Map texture check passed" : "Map texture check FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
+
+// Synthetic panorama: red and blue follow the cosine and sine of the longitude and green the
+// latitude, so every direction has its own smooth colour and a misoriented face shows
+static DecodedImage syntheticPanorama(int width, int height) {
+    DecodedImage image;
+    image.width = width;
+    image.height = height;
+    image.pixels = { static_cast<unsigned char*>(std::malloc((size_t)width * height * 4)), std::free };
+    const double pi = 3.14159265358979;
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x) {
+            double longitude = ((x + 0.5) / width - 0.5) * 2.0 * pi;
+            unsigned char* p = image.pixels.get() + ((size_t)y * width + x) * 4;
+            p[0] = (unsigned char)std::lround(127.5 + 127.5 * std::cos(longitude));
+            p[1] = (unsigned char)std::lround(255.0 * (y + 0.5) / height);
+            p[2] = (unsigned char)std::lround(127.5 + 127.5 * std::sin(longitude));
+            p[3] = 255;
+        }
+    return image;
+}
+
+int runSkyboxBenchmark(const std::string& imagePath) {
+    bool ok = true;
+    printRenderer();
+
+    // Load: the panorama itself, then the faces converted on first run and read from the cache after
+    DecodedImage image;
+    SkyboxFaces faces;
+    double decodeMs = 0.0, convertMs = 0.0, warmMs = -1.0;
+    std::error_code ec;
+    auto start = std::chrono::steady_clock::now();
+    if (fs::exists(imagePath, ec)) {
+        if (!decodeImage(imagePath, false, image)) {
+            std::cerr << "Failed to load background texture: " << imagePath << std::endl;
+            return 1;
+        }
+        decodeMs = msSince(start);
+        // Converted into a temporary cache next to a copy of the image (the real cache is left alone)
+        std::string sourceCopy = (fs::temp_directory_path() / ("population_sky_benchmark" + fs::path(imagePath).extension().string())).string();
+        fs::copy_file(imagePath, sourceCopy, fs::copy_options::overwrite_existing, ec);
+        if (ec) return 1;
+        start = std::chrono::steady_clock::now();
+        check(ok, Skybox::prepareTexture(sourceCopy, faces), "panorama converts to cubemap faces");
+        convertMs = msSince(start);
+        SkyboxFaces cached;
+        start = std::chrono::steady_clock::now();
+        check(ok, Skybox::prepareTexture(sourceCopy, cached) && cached.blocks == faces.blocks, "faces load back from the cache");
+        warmMs = msSince(start);
+        fs::remove(Skybox::cachePathFor(sourceCopy), ec);
+        fs::remove(sourceCopy, ec);
+        std::cout << imagePath << ": " << image.width << "x" << image.height << std::endl;
+    } else {
+        image = syntheticPanorama(4096, 2048);
+        std::cout << imagePath << " not found, synthetic " << image.width << "x" << image.height << " panorama" << std::endl;
+        start = std::chrono::steady_clock::now();
+        check(ok, Skybox::convertEquirect(image, faces), "panorama converts to cubemap faces");
+        convertMs = msSince(start);
+    }
+    if (!ok) return 1;
+
+    FrameUniforms frameUniforms;
+    Skybox skybox;
+    MapPlane plane(4.592f, 3.196f, 0.02f);
+    check(ok, frameUniforms.initialize() && skybox.initialize() && skybox.uploadTexture(faces) && plane.initialize(),
+          "skybox and map plane initialize");
+    if (!ok) return 1;
+    glEnable(GL_DEPTH_TEST);
+    auto viewFor = [](glm::vec3 position, float yaw, float pitch) {
+        glm::vec3 forward(std::cos(pitch) * std::sin(yaw), std::cos(pitch) * std::cos(yaw), std::sin(pitch));
+        glm::vec3 up = std::abs(pitch) > 1.5f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
+        return glm::lookAt(position, position + forward, up);
+    };
+    // Cleared to a colour neither path can produce, so uncovered pixels show
+    glClearColor(1.0f, 0.0f, 1.0f, 1.0f);
+    auto isClearColor = [](const uint8_t* p) { return p[0] == 255 && p[1] == 0 && p[2] == 255; };
+
+    // With a 90 degree square view both paths look along the same directions: compare them over the whole sky
+    {
+        CheckFramebuffer target;
+        check(ok, target.create(512, 512), "offscreen framebuffer");
+        glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.0f);
+        double difference = 0.0;
+        size_t samples = 0, uncovered = 0;
+        const float views[][2] = { { 0.0f, 0.0f }, { 1.57f, 0.3f }, { 3.14f, -0.3f }, { -1.57f, 0.8f }, { 0.7f, 1.56f },
+                                   { 2.2f, -1.56f }, { 0.4f, -0.9f } };
+        for (const auto& v : views) {
+            frameUniforms.update(viewFor(glm::vec3(0.0f), v[0], v[1]), proj, glm::vec4(0.0f, 0.0f, 512.0f, 512.0f), 0.0f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            skybox.draw();
+            std::vector<uint8_t> cube = target.read();
+            skybox.setReferenceEquirect(image);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            skybox.draw();
+            std::vector<uint8_t> reference = target.read();
+            skybox.setReferenceEquirect(DecodedImage());
+            for (size_t i = 0; i < cube.size(); i += 4) {
+                if (isClearColor(&cube[i])) ++uncovered;
+                for (int c = 0; c < 3; ++c) difference += std::abs((int)cube[i + c] - (int)reference[i + c]);
+                samples += 3;
+            }
+        }
+        difference /= std::max<size_t>(samples, 1);
+        std::cout << std::fixed << std::setprecision(2) << "Mean difference to the equirectangular pass: " << difference
+                  << " / 255" << std::defaultfloat << std::setprecision(6) << std::endl;
+        check(ok, uncovered == 0, "the cube covers every pixel, looking in any direction");
+        check(ok, difference < 4.0, "cubemap matches the equirectangular pass");
+    }
+
+    // Per-frame cost at the window size: the map alone, with the old sky before it and with the cube after it
+    CheckFramebuffer target;
+    check(ok, target.create(1280, 800), "offscreen framebuffer");
+    glm::mat4 proj = glm::perspective(glm::radians(45.0f), 1280.0f / 800.0f, 0.1f, 100.0f);
+    struct View {
+        const char* name;
+        glm::vec3 position;
+        float yaw, pitch;
+    };
+    const View views[] = { { "default camera", glm::vec3(0.0f, -4.0f, 2.0f), 0.0f, -0.4f },
+                           { "looking down", glm::vec3(0.0f, -1.0f, 2.0f), 0.0f, -1.2f },
+                           { "horizon", glm::vec3(0.0f, -4.0f, 0.5f), 0.0f, 0.1f } };
+    auto timeFrames = [&](const std::function<void()>& draw) {
+        auto frame = [&]() {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            draw();
+            glFinish();
+        };
+        frame();
+        int frames = 0;
+        auto start = std::chrono::steady_clock::now();
+        double seconds = 0.0;
+        while (frames < 3 || seconds < 1.0) {
+            frame();
+            ++frames;
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        return seconds * 1000.0 / frames;
+    };
+    std::cout << "1280x800 target, ms/frame" << std::endl;
+    std::cout << std::left << std::setw(16) << "view" << std::setw(8) << "sky %" << std::setw(10) << "map only"
+              << std::setw(22) << "equirect first (sky)" << std::setw(22) << "cube last (sky)" << "sky speedup" << std::endl;
+    for (const View& view : views) {
+        frameUniforms.update(viewFor(view.position, view.yaw, view.pitch), proj, glm::vec4(0.0f, 0.0f, 1280.0f, 800.0f), 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        plane.draw();
+        skybox.draw();
+        std::vector<uint8_t> pixels = target.read();
+        size_t skyPixels = 0;
+        for (size_t i = 0; i < pixels.size(); i += 4) skyPixels += pixels[i] | pixels[i + 1] | pixels[i + 2] ? 1 : 0;
+
+        double mapMs = timeFrames([&]() { plane.draw(); });
+        double cubeMs = timeFrames([&]() {
+            plane.draw();
+            skybox.draw();
+        });
+        skybox.setReferenceEquirect(image);
+        double referenceMs = timeFrames([&]() {
+            skybox.draw();
+            plane.draw();
+        });
+        skybox.setReferenceEquirect(DecodedImage());
+        double referenceSky = std::max(referenceMs - mapMs, 0.0), cubeSky = std::max(cubeMs - mapMs, 0.0);
+        std::ostringstream referenceCell, cubeCell;
+        referenceCell << std::fixed << std::setprecision(2) << referenceMs << " (" << referenceSky << ")";
+        cubeCell << std::fixed << std::setprecision(2) << cubeMs << " (" << cubeSky << ")";
+        std::cout << std::left << std::setw(16) << view.name << std::setw(8) << std::fixed << std::setprecision(0)
+                  << 100.0 * skyPixels / (pixels.size() / 4) << std::setprecision(2) << std::setw(10) << mapMs
+                  << std::setw(22) << referenceCell.str() << std::setw(22) << cubeCell.str()
+                  << referenceSky / std::max(cubeSky, 1e-3) << "x" << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+
+    const size_t referenceBytes = (size_t)image.width * image.height * 4 * 4 / 3;
+    std::cout << std::fixed << std::setprecision(1);
+    if (warmMs >= 0.0)
+        std::cout << "First run, decode (" << decodeMs << " ms) + conversion: " << convertMs << " ms, cached faces: " << warmMs << " ms";
+    else
+        std::cout << "Conversion: " << convertMs << " ms";
+    std::cout << std::endl << "GPU memory: " << faces.size << "^2 x 6 BC1 faces " << faces.blocks.size() / (1024.0 * 1024.0)
+              << " MB vs equirectangular RGBA8 mip chain " << referenceBytes / (1024.0 * 1024.0) << " MB" << std::endl
+              << std::defaultfloat << std::setprecision(6);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    check(ok, glGetError() == GL_NO_ERROR, "no GL errors");
+    std::cout << (ok ? "Skybox check passed" : "Skybox check FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
+
+// Synthetic basemap texel: a sawtooth per axis repeating every 200 / 150 texels, so a tile drawn in
+// the wrong place shows, and an 8-texel checker in blue that only stays sharp at level 0
+static void syntheticBasemapTexel(uint32_t x, uint32_t y, uint8_t* rgba) {
+    rgba[0] = (uint8_t)(x % 200 * 255 / 199);
+    rgba[1] = (uint8_t)(y % 150 * 255 / 149);
+    rgba[2] = (x / 8 + y / 8) % 2 ? 255 : 0;
+    rgba[3] = 255;
+}
+
+int runVirtualTextureCheck(uint32_t width, uint32_t height) {
+    bool ok = true;
+    printRenderer();
+    std::string path = (fs::temp_directory_path() / "population_virtual_check.ptp").string();
+    auto start = std::chrono::steady_clock::now();
+    bool built = TilePyramid::build(path, width, height, [&](uint32_t y, uint32_t rows, uint8_t* rgba) {
+        for (uint32_t r = 0; r < rows; ++r)
+            for (uint32_t x = 0; x < width; ++x) syntheticBasemapTexel(x, y + r, rgba + ((size_t)r * width + x) * 4);
+        return true;
+    });
+    double buildMs = msSince(start);
+    TilePyramid pyramid;
+    check(ok, built && pyramid.open(path), "tile pyramid builds and opens");
+    if (!ok) return 1;
+    std::error_code ec;
+    std::cout << std::fixed << std::setprecision(1) << "  " << width << " x " << height << ": " << pyramid.levelCount() << " levels, " << pyramid.tileCount()
+              << " tiles, " << fs::file_size(path, ec) / (1024.0 * 1024.0) << " MB on disk, built in " << buildMs << " ms"
+              << std::defaultfloat << std::endl;
+
+    // Small budgets, so flying across the map has to evict
+    VirtualTextureSettings settings;
+    settings.cacheBytes = (size_t)4 << 20;
+    settings.physicalTiles = 64;
+    FrameUniforms frameUniforms;
+    frameUniforms.initialize();
+    const float planeWidth = 2.0f, planeHeight = planeWidth * height / width;
+    MapPlane plane(planeWidth, planeHeight, 0.0f);
+    plane.setTileSettings(settings);
+    MapTextureSource source;
+    check(ok, MapPlane::prepareTexture(path, source) && plane.initialize() && plane.uploadTexture(source), "tiled map plane opens");
+    if (!ok) return 1;
+    const VirtualTexture& tiles = *plane.getVirtualTexture();
+    CheckFramebuffer target;
+    check(ok, target.create(320, 240), "offscreen framebuffer");
+    glEnable(GL_DEPTH_TEST);
+
+    size_t peakCacheBytes = 0, peakResident = 0;
+    const glm::mat4 proj = glm::perspective(glm::radians(45.0f), 320.0f / 240.0f, 0.001f, 100.0f);
+    glm::mat4 viewProj;
+    auto frame = [&](const glm::vec3& eye, const glm::vec3& center) {
+        glm::mat4 view = glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f));
+        viewProj = proj * view;
+        frameUniforms.update(view, proj, glm::vec4(0.0f, 0.0f, 320.0f, 240.0f), 0.0f, 0.0f);
+        plane.updateTiles(320, 240);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        plane.draw();
+        VirtualTextureStats stats = tiles.getStats();
+        peakCacheBytes = std::max(peakCacheBytes, stats.cacheBytes);
+        peakResident = std::max(peakResident, stats.residentTiles);
+        return stats;
+    };
+    // Frames from one camera until every tile it asks for is resident (-1 if that never happens)
+    auto converge = [&](const glm::vec3& eye, const glm::vec3& center) {
+        for (int i = 0; i < 500; ++i) {
+            VirtualTextureStats stats = frame(eye, center);
+            if (i >= 3 && stats.requested > 0 && stats.missing == 0 && stats.loading == 0) return i + 1;
+            if (stats.loading > 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return -1;
+    };
+    // Compares a converged close-up with the synthetic texels under each pixel
+    auto closeUpMatches = [&](float x, float y, const char* what) {
+        // About 0.8 level-0 texels per pixel
+        const float altitude = 0.8f * 320.0f * planeWidth / (2.0f * std::tan(glm::radians(22.5f)) * (320.0f / 240.0f) * width);
+        int frames = converge(glm::vec3(x, y, altitude), glm::vec3(x, y, 0.0f));
+        std::vector<uint8_t> pixels = target.read();
+        glm::mat4 inverse = glm::inverse(viewProj);
+        size_t compared = 0, matching = 0, sharp = 0;
+        for (int py = 0; py < 240; ++py) {
+            for (int px = 0; px < 320; ++px) {
+                glm::vec4 ndc((px + 0.5f) / 160.0f - 1.0f, (py + 0.5f) / 120.0f - 1.0f, -1.0f, 1.0f);
+                glm::vec4 nearPoint = inverse * ndc;
+                ndc.z = 1.0f;
+                glm::vec4 farPoint = inverse * ndc;
+                glm::vec3 a = glm::vec3(nearPoint) / nearPoint.w, b = glm::vec3(farPoint) / farPoint.w;
+                glm::vec3 hit = a + (b - a) * (a.z / (a.z - b.z));
+                double texelX = (hit.x / planeWidth + 0.5) * width, texelY = (0.5 - hit.y / planeHeight) * height;
+                if (texelX < 0.0 || texelY < 0.0 || texelX >= width || texelY >= height) continue;
+                uint32_t tx = (uint32_t)texelX, ty = (uint32_t)texelY;
+                // Filtering blends across the sawtooth wraps
+                if (tx % 200 < 2 || tx % 200 > 197 || ty % 150 < 2 || ty % 150 > 147) continue;
+                uint8_t expected[4];
+                syntheticBasemapTexel(tx, ty, expected);
+                const uint8_t* pixel = &pixels[((size_t)py * 320 + px) * 4];
+                ++compared;
+                if (std::abs(pixel[0] - expected[0]) <= 24 && std::abs(pixel[1] - expected[1]) <= 24) ++matching;
+                if (pixel[2] < 48 || pixel[2] > 207) ++sharp;
+            }
+        }
+        std::cout << "  " << what << ": converged after " << frames << " frames, " << std::fixed << std::setprecision(1)
+                  << 100.0 * matching / std::max<size_t>(compared, 1) << "% of pixels match, "
+                  << 100.0 * sharp / std::max<size_t>(compared, 1) << "% with a sharp checker" << std::endl;
+        std::cout << std::defaultfloat << std::setprecision(6);
+        return frames > 0 && compared > 0 && matching >= compared * 9 / 10 && sharp >= compared * 6 / 10 &&
+               tiles.getStats().finestLevel == 0;
+    };
+
+    const float halfWidth = planeWidth / 2, halfHeight = planeHeight / 2;
+    int overviewFrames = converge(glm::vec3(0.0f, -0.2f, 2.6f * halfWidth), glm::vec3(0.0f));
+    VirtualTextureStats overview = tiles.getStats();
+    std::cout << "  overview: converged after " << overviewFrames << " frames, finest level " << overview.finestLevel << std::endl;
+    check(ok, overviewFrames > 0 && overview.finestLevel > 0, "overview streams in coarse levels only");
+    check(ok, closeUpMatches(0.31f * halfWidth, -0.27f * halfHeight, "close-up"), "close-up shows level 0 in the right place");
+
+    // Low flight across the map without waiting for tiles
+    const float altitude = 0.05f * planeWidth;
+    for (int i = 0; i < 120; ++i) {
+        float t = i / 119.0f;
+        glm::vec3 eye(-0.9f * halfWidth + 1.8f * halfWidth * t, 0.8f * halfHeight * std::sin(t * 6.28f), altitude);
+        frame(eye, eye + glm::vec3(0.1f * planeWidth, 0.0f, -altitude));
+    }
+    VirtualTextureStats flight = tiles.getStats();
+    std::cout << std::fixed << std::setprecision(1) << "  flight: " << flight.loads << " tile loads, " << flight.uploads << " uploads, " << flight.evictions
+              << " evictions, peak " << peakCacheBytes / (1024.0 * 1024.0) << " MB cached of "
+              << flight.cacheBudget / (1024.0 * 1024.0) << " MB, " << peakResident << "/" << flight.physicalTiles << " resident"
+              << std::defaultfloat << std::endl;
+    check(ok, flight.evictions > 0, "flight evicts tiles from the GPU cache");
+    check(ok, peakCacheBytes <= flight.cacheBudget && peakResident <= flight.physicalTiles, "memory stays within the budgets");
+    check(ok, closeUpMatches(-0.62f * halfWidth, 0.55f * halfHeight, "close-up after the flight"),
+          "reused slots show the right tiles");
+    check(ok, glGetError() == GL_NO_ERROR, "no GL errors");
+    std::cout << std::fixed << std::setprecision(1) << "  GPU memory: " << flight.gpuBytes / (1024.0 * 1024.0) << " MB (tile atlas and page table) for a "
+              << (double)width * height * 4 * 4 / 3 / (1024.0 * 1024.0) << " MB RGBA8 mip chain" << std::endl;
+    fs::remove(path, ec);
+    std::cout << (ok ? "Virtual texture check passed" : "Virtual texture check FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
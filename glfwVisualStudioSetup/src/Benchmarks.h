@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <string>
+#include <cstdint>
+
+// Command line benchmarks and self-checks. Unless noted they run without a window or OpenGL context.
+// Each returns the process exit code.
+
+// Compares the stream loader with the memory-mapped loader (serial and with loaderThreads workers)
+// on synthetic files with the given row counts
+int runCsvLoaderBenchmark(const std::vector<size_t>& rowCounts, int loaderThreads);
+
+// Measures CSV classification and tokenization throughput (GB/s) for every supported scanner path
+int runCsvScanBenchmark(size_t megabytes);
+
+// Checks that the .pdc cache reproduces the CSV parse of csvPath and is invalidated when the CSV changes
+int runDatasetCacheCheck(const std::string& csvPath);
+
+// Scrubs every year forwards and backwards through setYear on synthetic datasets with the given
+// entity counts and reports ns per switch, next to the old copy-a-vector-per-year approach
+int runYearScrubBenchmark(const std::vector<uint32_t>& entityCounts);
+
+// Nearest-hit ray picking over synthetic bar grids: linear slab test vs BarBvh, checks both agree
+int runPickBenchmark(const std::vector<size_t>& barCounts);
+
+// Frustum culling of synthetic bar grids seen from a low camera: every bar tested against the frustum
+// vs BarCullGrid, checks both keep the same bars
+int runCullBenchmark(const std::vector<size_t>& barCounts);
+
+// Synthetic population-like density raster (clustered, heavy-tailed, with empty "sea" blocks),
+// row-major with row 0 along the northern edge
+std::vector<float> makeSyntheticDensityRaster(uint32_t width, uint32_t height, uint32_t seed = 1);
+
+// Builds DensityQuadtree over synthetic rasters with about the given cell counts and times LOD
+// selection (200k bar budget, 1080p) from an overview, a low and a close camera
+int runLodBenchmark(const std::vector<size_t>& cellCounts);
+
+// Ray-box throughput (boxes/ns) of the scalar and SIMD RayBoxKernel paths over boxCount random bars,
+// checking each path is bit-identical to rayBoxEntry
+int runRayBoxBenchmark(size_t boxCount);
+
+// Needs a current OpenGL 3.3 context: renders a full timelapse of csvPath offscreen and checks that
+// year and log/linear switches change the image without any GPU buffer uploads
+int runGpuTimelineCheck(const std::string& csvPath);
+
+// Needs a current OpenGL 3.3 context: instances per second of the 36-vertex reference cube against the
+// generated strips (box, hexagonal prism, cylinder) for entityCount synthetic bars, all drawn
+int runBarShapeBenchmark(uint32_t entityCount);
+
+// Needs a current OpenGL 3.3 context: loads imagePath the old way (decode, RGBA8 upload, generated
+// mipmaps) and through the BC1 cache (first-run conversion, then a warm start), compares load time
+// and GPU memory and checks the compressed base level stays above 30 dB PSNR
+int runMapTextureBenchmark(const std::string& imagePath);
+
+// Needs a current OpenGL 3.3 context: per-frame cost of the per-pixel equirectangular sky drawn first
+// against the cubemap drawn last behind the map, for a few camera views, plus conversion and cache
+// load times. Uses a synthetic panorama when imagePath does not exist. Checks the two paths agree
+// and that the cube covers every direction.
+int runSkyboxBenchmark(const std::string& imagePath);
+
+// Needs a current OpenGL 3.3 context: cuts a synthetic width x height basemap into a tile pyramid and
+// streams it through the tiled MapPlane with a small tile cache, checking close-ups show the right
+// level-0 texels, that memory stays within the budgets while flying across the map and no GL errors
+int runVirtualTextureCheck(uint32_t width, uint32_t height);
@@ -0,0 +1,30 @@
+#include "CacheFile.h"
+#include <filesystem>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+bool sourceStamp(const std::string& path, uint64_t& size, int64_t& mtime) {
+    std::error_code ec;
+    size = (uint64_t)fs::file_size(path, ec);
+    if (ec) return false;
+    mtime = (int64_t)fs::last_write_time(path, ec).time_since_epoch().count();
+    return !ec;
+}
+
+bool writeFileAtomically(const std::string& path, const char* what, const std::function<bool(std::ofstream&)>& write) {
+    std::string tempPath = path + ".tmp";
+    std::error_code ec;
+    bool written;
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        written = out.is_open() && write(out) && out.good();
+    }
+    if (written) fs::rename(tempPath, path, ec);
+    if (!written || ec) {
+        std::cerr << "Failed to write " << what << ": " << path << std::endl;
+        fs::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
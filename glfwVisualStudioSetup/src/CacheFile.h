@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+
+// Helpers shared by the on-disk caches (dataset, map texture, skybox faces)
+
+// Size and modification time of the file a cache was built from, as stored in the cache header
+bool sourceStamp(const std::string& path, uint64_t& size, int64_t& mtime);
+
+// Writes a cache file through path + ".tmp" and renames it over path, so readers never see a
+// partial cache. write fills the open stream and returns false to abandon it; the temporary file
+// is removed and what is named in an error message ("dataset cache") on any failure.
+bool writeFileAtomically(const std::string& path, const char* what, const std::function<bool(std::ofstream&)>& write);
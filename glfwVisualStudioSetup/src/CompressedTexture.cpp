@@ -0,0 +1,262 @@
+#include "CompressedTexture.h"
+#include "CacheFile.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static const char kMagic[4] = { 'P', 'T', 'C', '1' };
+static const uint32_t kVersion = 1;
+static const uint32_t kMaxLevels = 24; // Up to 16M texels per side
+
+struct LevelRecord {
+    uint64_t offset; // Bytes from the start of the file, 8-byte aligned
+    uint64_t bytes;
+    uint32_t width;
+    uint32_t height;
+};
+
+struct CompressedTexture::Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint32_t glFormat;
+    uint32_t levelCount;
+    LevelRecord levels[kMaxLevels];
+};
+
+static size_t bc1Bytes(uint32_t width, uint32_t height) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+}
+
+// Next mip level: 2x2 box filter, the last row/column of odd sizes is reused
+static std::vector<uint8_t> downsample(const std::vector<uint8_t>& src, uint32_t width, uint32_t height, ThreadPool& pool) {
+    const uint32_t w = std::max(width / 2, 1u), h = std::max(height / 2, 1u);
+    std::vector<uint8_t> dst((size_t)w * h * 4);
+    const size_t rowsPerTask = 64;
+    pool.parallelFor((h + rowsPerTask - 1) / rowsPerTask, [&](size_t task) {
+        for (uint32_t y = (uint32_t)(task * rowsPerTask); y < std::min<uint32_t>(h, (uint32_t)((task + 1) * rowsPerTask)); ++y) {
+            const uint32_t y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+            for (uint32_t x = 0; x < w; ++x) {
+                const uint32_t x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+                for (int c = 0; c < 4; ++c) {
+                    unsigned sum = src[((size_t)y0 * width + x0) * 4 + c] + src[((size_t)y0 * width + x1) * 4 + c] +
+                                   src[((size_t)y1 * width + x0) * 4 + c] + src[((size_t)y1 * width + x1) * 4 + c];
+                    dst[((size_t)y * w + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+                }
+            }
+        }
+    });
+    return dst;
+}
+
+static uint16_t to565(const float c[3]) {
+    auto q = [](float v, int max) { return (uint16_t)std::lround(std::clamp(v, 0.0f, 255.0f) * max / 255.0f); };
+    return (uint16_t)(q(c[0], 31) << 11 | q(c[1], 63) << 5 | q(c[2], 31));
+}
+
+static void from565(uint16_t c, int rgb[3]) {
+    rgb[0] = ((c >> 11) & 31) * 255 / 31;
+    rgb[1] = ((c >> 5) & 63) * 255 / 63;
+    rgb[2] = (c & 31) * 255 / 31;
+}
+
+// BC1 in four-colour mode. The endpoints are the block's extreme colours along its principal
+// axis (a few power iterations on the colour covariance), pulled in by 1/16 of their distance.
+void encodeBc1Block(const uint8_t pixels[16][4], uint8_t out[8]) {
+    float mean[3] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c) mean[c] += pixels[i][c] / 16.0f;
+    float cov[6] = {}; // rr rg rb gg gb bb
+    for (int i = 0; i < 16; ++i) {
+        float r = pixels[i][0] - mean[0], g = pixels[i][1] - mean[1], b = pixels[i][2] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b; cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 4; ++iteration) {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float length = std::max({ std::fabs(x), std::fabs(y), std::fabs(z) });
+        if (length < 1e-6f) break;
+        axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+    }
+    int lo = 0, hi = 0;
+    float minDot = 1e30f, maxDot = -1e30f;
+    for (int i = 0; i < 16; ++i) {
+        float d = pixels[i][0] * axis[0] + pixels[i][1] * axis[1] + pixels[i][2] * axis[2];
+        if (d < minDot) { minDot = d; lo = i; }
+        if (d > maxDot) { maxDot = d; hi = i; }
+    }
+    float e0[3], e1[3];
+    for (int c = 0; c < 3; ++c) {
+        float inset = (pixels[hi][c] - pixels[lo][c]) / 16.0f;
+        e0[c] = pixels[hi][c] - inset;
+        e1[c] = pixels[lo][c] + inset;
+    }
+    uint16_t c0 = to565(e0), c1 = to565(e1);
+    if (c0 < c1) std::swap(c0, c1);
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int palette[4][3];
+        from565(c0, palette[0]);
+        from565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, bestDistance = 1 << 30;
+            for (int p = 0; p < 4; ++p) {
+                int dr = pixels[i][0] - palette[p][0], dg = pixels[i][1] - palette[p][1], db = pixels[i][2] - palette[p][2];
+                int distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance) { bestDistance = distance; best = p; }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+    out[0] = (uint8_t)(c0 & 0xFF); out[1] = (uint8_t)(c0 >> 8);
+    out[2] = (uint8_t)(c1 & 0xFF); out[3] = (uint8_t)(c1 >> 8);
+    std::memcpy(out + 4, &indices, 4);
+}
+
+void decodeBc1Block(const uint8_t* block, uint8_t rgba[64]) {
+    uint16_t c0 = (uint16_t)(block[0] | block[1] << 8), c1 = (uint16_t)(block[2] | block[3] << 8);
+    uint32_t indices;
+    std::memcpy(&indices, block + 4, 4);
+    int palette[4][4];
+    from565(c0, palette[0]);
+    from565(c1, palette[1]);
+    palette[0][3] = palette[1][3] = palette[2][3] = 255;
+    palette[3][3] = c0 > c1 ? 255 : 0;
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = c0 > c1 ? (2 * palette[0][c] + palette[1][c]) / 3 : (palette[0][c] + palette[1][c]) / 2;
+        palette[3][c] = c0 > c1 ? (palette[0][c] + 2 * palette[1][c]) / 3 : 0;
+    }
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 4; ++c) rgba[i * 4 + c] = (uint8_t)palette[(indices >> (2 * i)) & 3][c];
+}
+
+static void compressLevel(const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height, uint8_t* out, ThreadPool& pool) {
+    const uint32_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    const size_t rowsPerTask = 16;
+    pool.parallelFor((blocksY + rowsPerTask - 1) / rowsPerTask, [&](size_t task) {
+        uint8_t pixels[16][4];
+        for (uint32_t by = (uint32_t)(task * rowsPerTask); by < std::min<uint32_t>(blocksY, (uint32_t)((task + 1) * rowsPerTask)); ++by) {
+            for (uint32_t bx = 0; bx < blocksX; ++bx) {
+                // Blocks past the edge repeat the last row/column
+                for (uint32_t i = 0; i < 16; ++i) {
+                    uint32_t x = std::min(bx * 4 + i % 4, width - 1), y = std::min(by * 4 + i / 4, height - 1);
+                    std::memcpy(pixels[i], &rgba[((size_t)y * width + x) * 4], 4);
+                }
+                encodeBc1Block(pixels, out + ((size_t)by * blocksX + bx) * 8);
+            }
+        }
+    });
+}
+
+std::string CompressedTexture::cachePathFor(const std::string& imagePath) {
+    return fs::path(imagePath).replace_extension(".ptc").string();
+}
+
+bool CompressedTexture::isFormatSupported() {
+    return GLAD_GL_EXT_texture_compression_s3tc != 0;
+}
+
+bool CompressedTexture::write(const std::string& cachePath, const std::string& sourcePath, const DecodedImage& image,
+                              unsigned threadCount) {
+    if (image.empty()) return false;
+    Header header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.glFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    if (!sourceStamp(sourcePath, header.sourceSize, header.sourceMtime)) return false;
+
+    ThreadPool pool(ThreadPool::resolveThreadCount((int)threadCount));
+    uint32_t width = (uint32_t)image.width, height = (uint32_t)image.height;
+    std::vector<uint8_t> level(image.pixels.get(), image.pixels.get() + (size_t)width * height * 4);
+    std::vector<uint8_t> blocks;
+    uint64_t offset = (sizeof(Header) + 7) & ~(uint64_t)7;
+    for (;;) {
+        LevelRecord& record = header.levels[header.levelCount++];
+        record = { offset, bc1Bytes(width, height), width, height };
+        blocks.resize(blocks.size() + record.bytes);
+        compressLevel(level, width, height, blocks.data() + (offset - header.levels[0].offset), pool);
+        offset += (record.bytes + 7) & ~(uint64_t)7;
+        blocks.resize(offset - header.levels[0].offset);
+        if ((width == 1 && height == 1) || header.levelCount == kMaxLevels) break;
+        level = downsample(level, width, height, pool);
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+
+    return writeFileAtomically(cachePath, "texture cache", [&](std::ofstream& out) {
+        static const char zeros[8] = {};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(zeros, (std::streamsize)(header.levels[0].offset - sizeof(header)));
+        out.write(reinterpret_cast<const char*>(blocks.data()), (std::streamsize)blocks.size());
+        return true;
+    });
+}
+
+bool CompressedTexture::open(const std::string& cachePath, const std::string& sourcePath) {
+    close();
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    if (!sourceStamp(sourcePath, sourceSize, sourceMtime)) return false;
+    if (!file.open(cachePath) || file.size() < sizeof(Header)) {
+        close();
+        return false;
+    }
+    const Header* h = reinterpret_cast<const Header*>(file.data());
+    bool valid = std::memcmp(h->magic, kMagic, sizeof(kMagic)) == 0 && h->version == kVersion &&
+                 h->sourceSize == sourceSize && h->sourceMtime == sourceMtime &&
+                 h->levelCount > 0 && h->levelCount <= kMaxLevels;
+    // Every level must lie inside the file and hold its whole block grid
+    for (uint32_t i = 0; valid && i < h->levelCount; ++i) {
+        const LevelRecord& level = h->levels[i];
+        valid = level.offset <= file.size() && level.bytes <= file.size() - level.offset &&
+                level.bytes == bc1Bytes(level.width, level.height);
+    }
+    if (!valid) {
+        close();
+        return false;
+    }
+    header = h;
+    return true;
+}
+
+void CompressedTexture::close() {
+    file.close();
+    header = nullptr;
+}
+
+GLenum CompressedTexture::internalFormat() const { return header ? header->glFormat : 0; }
+uint32_t CompressedTexture::levelCount() const { return header ? header->levelCount : 0; }
+
+CompressedTexture::Level CompressedTexture::level(uint32_t index) const {
+    const LevelRecord& record = header->levels[index];
+    return { record.width, record.height, file.data() + record.offset, (size_t)record.bytes };
+}
+
+size_t CompressedTexture::dataBytes() const {
+    size_t bytes = 0;
+    for (uint32_t i = 0; i < levelCount(); ++i) bytes += (size_t)header->levels[i].bytes;
+    return bytes;
+}
+
+void CompressedTexture::upload() const {
+    for (uint32_t i = 0; i < levelCount(); ++i) {
+        Level l = level(i);
+        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, header->glFormat, (GLsizei)l.width, (GLsizei)l.height, 0,
+                               (GLsizei)l.bytes, l.data);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levelCount() - 1);
+}
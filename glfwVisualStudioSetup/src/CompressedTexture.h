@@ -0,0 +1,52 @@
+#pragma once
+#include "MappedFile.h"
+#include "DecodedImage.h"
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+
+// Block-compressed (BC1) full mip chain of an image, cached in a KTX2-like container (.ptc) next
+// to the source image: a header with one record per level, then the levels back to back. The file
+// is memory-mapped and its levels go to glCompressedTexImage2D as they are. Like the dataset
+// cache it is tied to the source by size and modification time.
+class CompressedTexture {
+public:
+    struct Level {
+        uint32_t width, height;
+        const void* data;
+        size_t bytes;
+    };
+
+    // assets/map.png -> assets/map.ptc
+    static std::string cachePathFor(const std::string& imagePath);
+    // BC1 needs GL_EXT_texture_compression_s3tc (after gladLoadGL, readable from any thread)
+    static bool isFormatSupported();
+
+    // Builds the mip chain of image, compresses every level and writes them for sourcePath (via a
+    // temporary file). Both steps run on threadCount workers (0 = all hardware threads).
+    static bool write(const std::string& cachePath, const std::string& sourcePath, const DecodedImage& image,
+                      unsigned threadCount = 0);
+
+    // Maps cachePath and validates it against sourcePath (returns false if missing, corrupt or stale)
+    bool open(const std::string& cachePath, const std::string& sourcePath);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+
+    GLenum internalFormat() const;
+    uint32_t levelCount() const;
+    Level level(uint32_t index) const;
+    size_t dataBytes() const; // All levels, as held by the GPU
+
+    // Uploads every level into the texture bound to GL_TEXTURE_2D
+    void upload() const;
+
+private:
+    struct Header;
+    MappedFile file;
+    const Header* header = nullptr;
+};
+
+// Encodes 16 RGBA pixels (row by row, alpha ignored) as one 8-byte BC1 block
+void encodeBc1Block(const uint8_t pixels[16][4], uint8_t out[8]);
+// Decodes one 8-byte BC1 block into 16 RGBA pixels, row by row
+void decodeBc1Block(const uint8_t* block, uint8_t rgba[64]);
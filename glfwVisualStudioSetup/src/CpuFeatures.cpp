@@ -0,0 +1,68 @@
+#include "CpuFeatures.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void cpuidQuery(int leaf, int subleaf, unsigned regs[4]) {
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, leaf, subleaf);
+    for (int i = 0; i < 4; ++i) regs[i] = (unsigned)r[i];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register state the OS saves on context switch (0 without OSXSAVE)
+static unsigned long long enabledXcr0() {
+    unsigned regs[4];
+    cpuidQuery(1, 0, regs);
+    bool osxsave = (regs[2] & (1u << 27)) != 0;
+    bool avx = (regs[2] & (1u << 28)) != 0;
+    if (!osxsave || !avx) return 0;
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+static unsigned extendedFeatures() {
+    unsigned regs[4];
+    cpuidQuery(0, 0, regs);
+    if (regs[0] < 7) return 0;
+    cpuidQuery(7, 0, regs);
+    return regs[1];
+}
+
+bool cpuHasSSE42() {
+    static const bool supported = [] {
+        unsigned regs[4];
+        cpuidQuery(1, 0, regs);
+        return (regs[2] & (1u << 20)) != 0;
+    }();
+    return supported;
+}
+
+// YMM state must be enabled as well as the CPU supporting AVX2
+bool cpuHasAVX2() {
+    static const bool supported = (enabledXcr0() & 0x6) == 0x6 && (extendedFeatures() & (1u << 5)) != 0;
+    return supported;
+}
+
+// Opmask and ZMM state must be enabled as well as the CPU supporting AVX-512F
+bool cpuHasAVX512() {
+    static const bool supported = (enabledXcr0() & 0xE6) == 0xE6 && (extendedFeatures() & (1u << 16)) != 0;
+    return supported;
+}
+#else
+bool cpuHasSSE42() { return false; }
+bool cpuHasAVX2() { return false; }
+bool cpuHasAVX512() { return false; }
+#endif
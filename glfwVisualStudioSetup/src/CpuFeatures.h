@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// x86 instruction set extensions the running process may use: the CPU must support them and
+// the OS must save the wider registers. Detected once, always false on other architectures.
+bool cpuHasSSE42();
+bool cpuHasAVX2();
+bool cpuHasAVX512();   // AVX-512 Foundation
+
+// Index of the lowest set bit, x must not be 0
+inline int countTrailingZeros(uint64_t x) {
+#if defined(_MSC_VER) && defined(_M_IX86)
+    unsigned long index;
+    if (_BitScanForward(&index, (unsigned long)x)) return (int)index;
+    _BitScanForward(&index, (unsigned long)(x >> 32));
+    return (int)index + 32;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (int)index;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
@@ -0,0 +1,100 @@
+#include "CsvScanner.h"
+#include "CpuFeatures.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CSV_SCANNER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define CSV_TARGET_SSE42
+#define CSV_TARGET_AVX2
+#else
+#define CSV_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define CSV_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+static void classifyScalar(const char* block, CsvBlockMasks& out) {
+    uint64_t comma = 0, quote = 0, newline = 0;
+    for (int i = 0; i < 64; ++i) {
+        char c = block[i];
+        comma |= (uint64_t)(c == ',') << i;
+        quote |= (uint64_t)(c == '"') << i;
+        newline |= (uint64_t)(c == '\n') << i;
+    }
+    out.comma = comma;
+    out.quote = quote;
+    out.newline = newline;
+}
+
+#ifdef CSV_SCANNER_X86
+// Four 16-byte lanes per block
+CSV_TARGET_SSE42 static void classifySSE42(const char* block, CsvBlockMasks& out) {
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i newline = _mm_set1_epi8('\n');
+    uint64_t commaMask = 0, quoteMask = 0, newlineMask = 0;
+    for (int lane = 0; lane < 4; ++lane) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + lane * 16));
+        commaMask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, comma)) << (lane * 16);
+        quoteMask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, quote)) << (lane * 16);
+        newlineMask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)) << (lane * 16);
+    }
+    out.comma = commaMask;
+    out.quote = quoteMask;
+    out.newline = newlineMask;
+}
+
+CSV_TARGET_AVX2 static inline uint64_t matchMask64(__m256i lo, __m256i hi, __m256i c) {
+    uint64_t low = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, c));
+    uint64_t high = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, c));
+    return low | (high << 32);
+}
+
+// Two 32-byte lanes per block
+CSV_TARGET_AVX2 static void classifyAVX2(const char* block, CsvBlockMasks& out) {
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+    out.comma = matchMask64(lo, hi, comma);
+    out.quote = matchMask64(lo, hi, quote);
+    out.newline = matchMask64(lo, hi, newline);
+}
+#endif
+
+bool isCsvScanPathSupported(CsvScanPath path) {
+    switch (path) {
+    case CsvScanPath::Scalar: return true;
+#ifdef CSV_SCANNER_X86
+    case CsvScanPath::SSE42: return cpuHasSSE42();
+    case CsvScanPath::AVX2: return cpuHasAVX2();
+#endif
+    default: return false;
+    }
+}
+
+CsvScanPath detectCsvScanPath() {
+    if (isCsvScanPathSupported(CsvScanPath::AVX2)) return CsvScanPath::AVX2;
+    if (isCsvScanPathSupported(CsvScanPath::SSE42)) return CsvScanPath::SSE42;
+    return CsvScanPath::Scalar;
+}
+
+CsvClassifyFn getCsvClassifier(CsvScanPath path) {
+    if (!isCsvScanPathSupported(path)) return classifyScalar;
+    switch (path) {
+#ifdef CSV_SCANNER_X86
+    case CsvScanPath::SSE42: return classifySSE42;
+    case CsvScanPath::AVX2: return classifyAVX2;
+#endif
+    default: return classifyScalar;
+    }
+}
+
+const char* csvScanPathName(CsvScanPath path) {
+    switch (path) {
+    case CsvScanPath::SSE42: return "SSE4.2";
+    case CsvScanPath::AVX2: return "AVX2";
+    default: return "scalar";
+    }
+}
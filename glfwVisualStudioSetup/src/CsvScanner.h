@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include "CpuFeatures.h"
+
+// Structural character masks for one 64-byte block: bit i is set when byte i matches
+struct CsvBlockMasks {
+    uint64_t comma;
+    uint64_t quote;
+    uint64_t newline;
+};
+
+enum class CsvScanPath { Scalar, SSE42, AVX2 };
+
+// Classifies exactly 64 bytes starting at block
+using CsvClassifyFn = void (*)(const char* block, CsvBlockMasks& out);
+
+// Fastest path supported by the running CPU (detected once)
+CsvScanPath detectCsvScanPath();
+bool isCsvScanPathSupported(CsvScanPath path);
+CsvClassifyFn getCsvClassifier(CsvScanPath path);
+const char* csvScanPathName(CsvScanPath path);
+
+// Classifier for the detected path
+inline CsvClassifyFn csvClassifier() {
+    static const CsvClassifyFn best = getCsvClassifier(detectCsvScanPath());
+    return best;
+}
+
+// Bit i of the result is the xor of bits 0..i, turning quote positions into "inside quotes" runs
+inline uint64_t prefixXor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include "CsvScanner.h"
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+
+// Splits an in-memory CSV buffer into rows and comma separated fields without copying.
+// The buffer is classified 64 bytes at a time into comma/quote/newline bitmasks; commas and
+// newlines inside double quotes are not separators, so "Korea, Republic of" stays one field.
+// Fields are views into the buffer (quotes included, see unquoteField), so the buffer must
+// outlive the tokenizer.
+class CsvTokenizer {
+public:
+    static constexpr int kMaxFields = 16;
+
+    CsvTokenizer(const char* begin, const char* end, CsvClassifyFn classify = csvClassifier())
+        : classify(classify), begin(begin), end(end), fieldStart(begin) {}
+
+    // Advances to the next non-empty line (returns false at end of input)
+    bool nextRow() {
+        count = 0;
+        for (;;) {
+            while (separators == 0) {
+                if (!nextBlock()) {
+                    // Last line without a trailing newline
+                    if (fieldStart >= end && count == 0) return false;
+                    pushField(fieldStart, end);
+                    fieldStart = end;
+                    if (finishRow()) return true;
+                    return false;
+                }
+            }
+            int bit = countTrailingZeros(separators);
+            separators &= separators - 1;
+            const char* pos = blockStart + bit;
+            pushField(fieldStart, pos);
+            fieldStart = pos + 1;
+            if ((newlines >> bit) & 1) {
+                if (finishRow()) return true;
+                count = 0;
+            }
+        }
+    }
+
+    int fieldCount() const { return count; }
+    std::string_view field(int i) const { return fields[i]; }
+
+private:
+    CsvClassifyFn classify;
+    const char* begin;
+    const char* end;
+    const char* blockStart = nullptr;
+    const char* fieldStart;
+    uint64_t separators = 0; // unconsumed unquoted commas and newlines of the current block
+    uint64_t newlines = 0;   // unquoted newlines of the current block
+    uint64_t insideQuotes = 0; // all ones when the previous block ended inside a quoted field
+    std::string_view fields[kMaxFields];
+    int count = 0;
+
+    bool nextBlock() {
+        if (!blockStart) blockStart = begin;
+        else if (end - blockStart > 64) blockStart += 64;
+        else blockStart = end;
+        if (!blockStart || blockStart >= end) {
+            blockStart = end;
+            return false;
+        }
+        CsvBlockMasks masks;
+        size_t remaining = (size_t)(end - blockStart);
+        if (remaining >= 64) {
+            classify(blockStart, masks);
+        } else {
+            char padded[64] = {};
+            std::memcpy(padded, blockStart, remaining);
+            classify(padded, masks);
+        }
+        uint64_t quoted = prefixXor(masks.quote) ^ insideQuotes;
+        insideQuotes = (uint64_t)0 - (quoted >> 63);
+        newlines = masks.newline & ~quoted;
+        separators = (masks.comma & ~quoted) | newlines;
+        return true;
+    }
+
+    void pushField(const char* from, const char* to) {
+        if (count < kMaxFields) fields[count++] = std::string_view(from, to - from);
+    }
+
+    // Drops the CR of CRLF endings, returns false for blank lines
+    bool finishRow() {
+        std::string_view& last = fields[count - 1];
+        if (!last.empty() && last.back() == '\r') last.remove_suffix(1);
+        return !(count == 1 && last.empty());
+    }
+};
+
+// Strips leading and trailing whitespace from a field
+inline std::string_view trimField(std::string_view s) {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos) return {};
+    size_t last = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, last - start + 1);
+}
+
+// Trims a field and removes its surrounding double quotes; escaped quotes ("") stay doubled
+inline std::string_view unquoteField(std::string_view s) {
+    s = trimField(s);
+    if (s.size() >= 2 && s.front() == '"' && s.back() == '"') s = s.substr(1, s.size() - 2);
+    return s;
+}
+
+// Copies an unquoted field into out, collapsing escaped quotes
+inline void assignUnquoted(std::string& out, std::string_view field) {
+    std::string_view s = unquoteField(field);
+    out.assign(s);
+    if (s.find("\"\"") == std::string_view::npos) return;
+    size_t w = 0;
+    for (size_t r = 0; r < out.size(); ++r, ++w) {
+        out[w] = out[r];
+        if (out[r] == '"' && r + 1 < out.size() && out[r + 1] == '"') ++r;
+    }
+    out.resize(w);
+}
+
+// Locale independent number parsing (returns false if the field is not a complete number)
+inline bool parseFloatField(std::string_view s, float& out) {
+    s = unquoteField(s);
+    if (!s.empty() && s.front() == '+') s.remove_prefix(1);
+    auto result = std::from_chars(s.data(), s.data() + s.size(), out);
+    return result.ec == std::errc() && result.ptr == s.data() + s.size();
+}
+
+inline bool parseIntField(std::string_view s, int& out) {
+    s = unquoteField(s);
+    if (!s.empty() && s.front() == '+') s.remove_prefix(1);
+    auto result = std::from_chars(s.data(), s.data() + s.size(), out);
+    return result.ec == std::errc() && result.ptr == s.data() + s.size();
+}
@@ -0,0 +1,183 @@
+#include "DatasetCache.h"
+#include "CacheFile.h"
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+
+namespace fs = std::filesystem;
+
+static const char kMagic[4] = { 'P', 'D', 'C', '1' };
+static const uint32_t kVersion = 3;
+
+// All section offsets are in bytes from the start of the file and 8-byte aligned
+struct DatasetCache::Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint64_t sourceHash;
+    uint32_t rowCount;
+    uint32_t entityCount;
+    int32_t minYear;
+    int32_t maxYear;
+    float globalMaxDensity;
+    uint32_t nameBlobSize;
+    uint64_t densityTableOffset;
+    uint64_t entityTableOffset;
+    uint64_t nameBlobOffset;
+};
+
+// Name and code are stored back to back in the name blob
+struct DatasetCache::EntityRecord {
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t codeLength;
+    float x, y;
+};
+
+static uint64_t fnv1a(uint64_t hash, const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+    return hash;
+}
+
+// Hashes the head, the tail and 64 evenly spaced pages of the CSV, so validation costs a few
+// hundred KB of reads however large the dataset is
+static uint64_t sampledSourceHash(const std::string& csvPath) {
+    MappedFile csv;
+    if (!csv.open(csvPath)) return 0;
+    const size_t size = csv.size();
+    const size_t edge = 64 * 1024, page = 4096, samples = 64;
+    uint64_t hash = fnv1a(1469598103934665603ull, reinterpret_cast<const char*>(&size), sizeof(size));
+    if (size <= 2 * edge + samples * page) return fnv1a(hash, csv.data(), size);
+    hash = fnv1a(hash, csv.data(), edge);
+    hash = fnv1a(hash, csv.data() + size - edge, edge);
+    for (size_t i = 0; i < samples; ++i) {
+        size_t offset = edge + (size - 2 * edge - page) / samples * i;
+        hash = fnv1a(hash, csv.data() + offset, page);
+    }
+    return hash;
+}
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+static uint64_t yearCountOf(int minYear, int maxYear) {
+    return maxYear >= minYear ? (uint64_t)((int64_t)maxYear - minYear + 1) : 0;
+}
+
+std::string DatasetCache::cachePathFor(const std::string& csvPath) {
+    return fs::path(csvPath).replace_extension(".pdc").string();
+}
+
+bool DatasetCache::write(const std::string& cachePath, const std::string& csvPath, const DatasetCacheContents& contents) {
+    Header header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    if (!sourceStamp(csvPath, header.sourceSize, header.sourceMtime)) return false;
+    header.sourceHash = sampledSourceHash(csvPath);
+    header.rowCount = contents.rowCount;
+    header.entityCount = (uint32_t)contents.names.size();
+    header.minYear = contents.minYear;
+    header.maxYear = contents.maxYear;
+    header.globalMaxDensity = contents.globalMaxDensity;
+
+    std::vector<EntityRecord> entities(contents.names.size());
+    std::string names;
+    for (size_t i = 0; i < contents.names.size(); ++i) {
+        entities[i] = { (uint32_t)names.size(), (uint32_t)contents.names[i].size(), (uint32_t)contents.codes[i].size(),
+                        contents.entityX[i], contents.entityY[i] };
+        names += contents.names[i];
+        names += contents.codes[i];
+    }
+    header.nameBlobSize = (uint32_t)names.size();
+
+    const uint64_t densityBytes = yearCountOf(contents.minYear, contents.maxYear) * contents.names.size() * sizeof(float);
+    uint64_t offset = align8(sizeof(Header));
+    header.densityTableOffset = offset;
+    offset = align8(offset + densityBytes);
+    header.entityTableOffset = offset;
+    offset = align8(offset + entities.size() * sizeof(EntityRecord));
+    header.nameBlobOffset = offset;
+
+    return writeFileAtomically(cachePath, "dataset cache", [&](std::ofstream& out) {
+        auto section = [&](uint64_t at, const void* data, size_t bytes) {
+            static const char zeros[8] = {};
+            uint64_t pos = (uint64_t)out.tellp();
+            out.write(zeros, (std::streamsize)(at - pos));
+            out.write(static_cast<const char*>(data), (std::streamsize)bytes);
+        };
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        section(header.densityTableOffset, contents.densities, (size_t)densityBytes);
+        section(header.entityTableOffset, entities.data(), entities.size() * sizeof(EntityRecord));
+        section(header.nameBlobOffset, names.data(), names.size());
+        return true;
+    });
+}
+
+bool DatasetCache::open(const std::string& cachePath, const std::string& csvPath) {
+    close();
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    if (!sourceStamp(csvPath, sourceSize, sourceMtime)) return false;
+    if (!file.open(cachePath) || file.size() < sizeof(Header)) {
+        close();
+        return false;
+    }
+    const Header* h = reinterpret_cast<const Header*>(file.data());
+    bool valid = std::memcmp(h->magic, kMagic, sizeof(kMagic)) == 0 && h->version == kVersion &&
+                 h->sourceSize == sourceSize && h->sourceMtime == sourceMtime &&
+                 (int64_t)h->maxYear >= (int64_t)h->minYear - 1 && h->densityTableOffset % sizeof(float) == 0;
+    // Every section must lie inside the file. Counts are 32-bit, so a product of two fits in 64 bits.
+    if (valid) {
+        const uint64_t yearCount = yearCountOf(h->minYear, h->maxYear);
+        auto inside = [&](uint64_t offset, uint64_t bytes) { return offset <= file.size() && bytes <= file.size() - offset; };
+        valid = yearCount <= (uint64_t)INT32_MAX && yearCount * h->entityCount <= file.size() / sizeof(float) &&
+                inside(h->densityTableOffset, yearCount * h->entityCount * sizeof(float)) &&
+                inside(h->entityTableOffset, (uint64_t)h->entityCount * sizeof(EntityRecord)) &&
+                inside(h->nameBlobOffset, h->nameBlobSize);
+    }
+    if (!valid || h->sourceHash != sampledSourceHash(csvPath)) {
+        close();
+        return false;
+    }
+    header = h;
+    densityTable = reinterpret_cast<const float*>(file.data() + h->densityTableOffset);
+    entityTable = reinterpret_cast<const EntityRecord*>(file.data() + h->entityTableOffset);
+    nameBlob = file.data() + h->nameBlobOffset;
+    return true;
+}
+
+void DatasetCache::close() {
+    file.close();
+    header = nullptr;
+    densityTable = nullptr;
+    entityTable = nullptr;
+    nameBlob = nullptr;
+}
+
+uint32_t DatasetCache::rowCount() const { return header ? header->rowCount : 0; }
+uint32_t DatasetCache::entityCount() const { return header ? header->entityCount : 0; }
+int DatasetCache::minYear() const { return header ? header->minYear : 0; }
+int DatasetCache::maxYear() const { return header ? header->maxYear : -1; }
+float DatasetCache::globalMaxDensity() const { return header ? header->globalMaxDensity : 0.0f; }
+
+uint64_t DatasetCache::densityBytes() const {
+    return header ? yearCountOf(header->minYear, header->maxYear) * header->entityCount * sizeof(float) : 0;
+}
+
+std::string_view DatasetCache::entityName(uint32_t id) const {
+    const EntityRecord& e = entityTable[id];
+    if ((uint64_t)e.nameOffset + e.nameLength > header->nameBlobSize) return {};
+    return std::string_view(nameBlob + e.nameOffset, e.nameLength);
+}
+
+std::string_view DatasetCache::entityCode(uint32_t id) const {
+    const EntityRecord& e = entityTable[id];
+    if ((uint64_t)e.nameOffset + e.nameLength + e.codeLength > header->nameBlobSize) return {};
+    return std::string_view(nameBlob + e.nameOffset + e.nameLength, e.codeLength);
+}
+
+float DatasetCache::entityX(uint32_t id) const { return entityTable[id].x; }
+float DatasetCache::entityY(uint32_t id) const { return entityTable[id].y; }
@@ -0,0 +1,58 @@
+#pragma once
+#include "MappedFile.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+// A parsed dataset as stored in the binary cache. The densities are the year x entity table
+// exactly as PopulationTimeSeries holds it (row-major by year, NaN where missing), so a mapped
+// cache is used without copying.
+struct DatasetCacheContents {
+    int minYear = 0;
+    int maxYear = -1;
+    float globalMaxDensity = 0.0f;
+    uint32_t rowCount = 0;            // CSV rows the table was built from
+    const float* densities = nullptr; // (maxYear - minYear + 1) x names.size() samples
+    std::vector<std::string> names;   // indexed by entity id
+    std::vector<std::string> codes;
+    std::vector<float> entityX, entityY;
+};
+
+// Binary dataset cache (.pdc) kept next to the source CSV. The file is memory-mapped and its
+// density table is used in place. It is tied to the CSV by size, modification time and a
+// hash of sampled CSV pages, so an edited dataset is re-parsed instead of served stale.
+class DatasetCache {
+public:
+    // dataset/dataset.csv -> dataset/dataset.pdc
+    static std::string cachePathFor(const std::string& csvPath);
+
+    // Writes contents for csvPath (via a temporary file, so readers never see a partial cache)
+    static bool write(const std::string& cachePath, const std::string& csvPath, const DatasetCacheContents& contents);
+
+    // Maps cachePath and validates it against csvPath (returns false if missing, corrupt or stale)
+    bool open(const std::string& cachePath, const std::string& csvPath);
+    void close();
+
+    uint32_t rowCount() const;
+    uint32_t entityCount() const;
+    int minYear() const;
+    int maxYear() const;
+    float globalMaxDensity() const;
+    // Year x entity table, valid while the cache is open
+    const float* densities() const { return densityTable; }
+    uint64_t densityBytes() const;
+    std::string_view entityName(uint32_t id) const;
+    std::string_view entityCode(uint32_t id) const;
+    float entityX(uint32_t id) const;
+    float entityY(uint32_t id) const;
+
+private:
+    struct Header;
+    struct EntityRecord;
+    MappedFile file;
+    const Header* header = nullptr;
+    const float* densityTable = nullptr;
+    const EntityRecord* entityTable = nullptr;
+    const char* nameBlob = nullptr;
+};
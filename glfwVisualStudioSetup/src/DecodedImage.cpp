@@ -0,0 +1,15 @@
+#include "DecodedImage.h"
+#include <stb_image/stb_image.h>
+
+bool decodeImage(const std::string& path, bool flipVertically, DecodedImage& image) {
+    int channels = 0;
+    stbi_set_flip_vertically_on_load_thread(flipVertically ? 1 : 0);
+    unsigned char* data = stbi_load(path.c_str(), &image.width, &image.height, &channels, 4);
+    image.pixels = { data, stbi_image_free };
+    return data != nullptr;
+}
+
+bool readImageSize(const std::string& path, int& width, int& height) {
+    int channels = 0;
+    return stbi_info(path.c_str(), &width, &height, &channels) != 0;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <memory>
+#include <string>
+
+// RGBA8 pixels of an image file, decoded off the GL thread and uploaded later
+struct DecodedImage {
+    int width = 0, height = 0;
+    std::unique_ptr<unsigned char, void (*)(void*)> pixels{ nullptr, nullptr };
+
+    bool empty() const { return !pixels; }
+};
+
+// Decodes path with stb_image. The flip setting is per thread, so several images can be
+// decoded in parallel with different settings.
+bool decodeImage(const std::string& path, bool flipVertically, DecodedImage& image);
+// Reads the size of path from its header without decoding it
+bool readImageSize(const std::string& path, int& width, int& height);
@@ -0,0 +1,81 @@
+#include "DensityQuadtree.h"
+#include "ThreadPool.h"
+#include <limits>
+
+void DensityQuadtree::clear() {
+    raster.clear();
+    raster.shrink_to_fit();
+    levels.clear();
+    rasterWidth = rasterHeight = 0;
+}
+
+bool DensityQuadtree::build(std::vector<float> density, uint32_t width, uint32_t height, unsigned threads) {
+    clear();
+    if (width == 0 || height == 0 || density.size() != (size_t)width * height) return false;
+    raster = std::move(density);
+    rasterWidth = width;
+    rasterHeight = height;
+
+    // Area (valid cell count) of the previous level's nodes, only needed while building
+    const float missing = std::numeric_limits<float>::quiet_NaN();
+    std::vector<uint32_t> area, nextArea;
+    ThreadPool pool(ThreadPool::resolveThreadCount((int)threads));
+    for (int level = 1; levelWidth(level - 1) > 1 || levelHeight(level - 1) > 1; ++level) {
+        const uint32_t childWidth = levelWidth(level - 1), childHeight = levelHeight(level - 1);
+        LevelInfo info;
+        info.width = (childWidth + 1) / 2;
+        info.height = (childHeight + 1) / 2;
+        info.nodes.resize((size_t)info.width * info.height);
+        nextArea.resize(info.nodes.size());
+        // Rows are independent, spread them over the pool in bands
+        const uint32_t bandRows = std::max<uint32_t>(1, 16384 / info.width);
+        const size_t bands = (info.height + bandRows - 1) / bandRows;
+        pool.parallelFor(bands, [&](size_t band) {
+            uint32_t yEnd = std::min<uint32_t>(info.height, (uint32_t)(band + 1) * bandRows);
+            for (uint32_t y = (uint32_t)band * bandRows; y < yEnd; ++y) {
+                for (uint32_t x = 0; x < info.width; ++x) {
+                    double weightedSum = 0.0;
+                    uint32_t cells = 0;
+                    float max = -std::numeric_limits<float>::infinity();
+                    for (uint32_t cy = y * 2; cy < std::min(y * 2 + 2, childHeight); ++cy) {
+                        for (uint32_t cx = x * 2; cx < std::min(x * 2 + 2, childWidth); ++cx) {
+                            size_t child = (size_t)cy * childWidth + cx;
+                            NodeStats s = node(level - 1, cx, cy);
+                            uint32_t childArea = level == 1 ? (std::isnan(s.mean) ? 0u : 1u) : area[child];
+                            if (childArea == 0) continue;
+                            weightedSum += (double)s.mean * childArea;
+                            cells += childArea;
+                            max = std::max(max, s.max);
+                        }
+                    }
+                    size_t index = (size_t)y * info.width + x;
+                    info.nodes[index] = cells ? NodeStats{ (float)(weightedSum / cells), max } : NodeStats{ missing, missing };
+                    nextArea[index] = cells;
+                }
+            }
+        });
+        levels.push_back(std::move(info));
+        area.swap(nextArea);
+    }
+    setExtent(extentMin, extentMax, baseZ);
+    return true;
+}
+
+float DensityQuadtree::maxDensity() const {
+    if (raster.empty()) return 0.0f;
+    NodeStats root = node(levelCount() - 1, 0, 0);
+    return std::isnan(root.max) ? 0.0f : root.max;
+}
+
+size_t DensityQuadtree::memoryBytes() const {
+    size_t bytes = raster.capacity() * sizeof(float);
+    for (const LevelInfo& info : levels) bytes += info.nodes.capacity() * sizeof(NodeStats);
+    return bytes;
+}
+
+void DensityQuadtree::setExtent(const glm::vec2& mapMin, const glm::vec2& mapMax, float baseZ_) {
+    extentMin = mapMin;
+    extentMax = mapMax;
+    cellSize = (mapMax - mapMin) / glm::vec2((float)std::max(rasterWidth, 1u), (float)std::max(rasterHeight, 1u));
+    baseZ = baseZ_;
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "BarCullGrid.h"
+
+// One aggregated bar of a level-of-detail selection (20 bytes, streamed as instance data)
+struct LodBar {
+    glm::vec2 center;   // Map-space centre of the covered cells
+    glm::vec2 halfSize; // Half extent of the covered cells
+    float density;      // Area-weighted mean density
+};
+
+// Result of the most recent DensityQuadtree::select
+struct LodSelectStats {
+    size_t bars = 0;
+    size_t nodesVisited = 0;
+    bool budgetReached = false; // Some nodes were drawn coarser than the pixel error asked for
+    double ms = 0.0;
+};
+
+// Implicit quadtree (a mip pyramid) over a gridded density raster. Level 0 is the raster itself;
+// every node of level l aggregates up to 2x2 nodes of level l - 1 into their area-weighted mean
+// and maximum density. Missing cells (NaN) carry no area. select() walks the tree from the
+// root, refining nodes whose footprint is larger than a pixel threshold on screen, so distant
+// regions come out as a few coarse bars and the result never exceeds a bar budget.
+class DensityQuadtree {
+public:
+    // density is width x height row-major, row 0 along the northern edge. threads as for ThreadPool.
+    bool build(std::vector<float> density, uint32_t width, uint32_t height, unsigned threads = 0);
+    void clear();
+    bool empty() const { return raster.empty(); }
+    uint32_t width() const { return rasterWidth; }
+    uint32_t height() const { return rasterHeight; }
+    size_t cellCount() const { return raster.size(); }
+    int levelCount() const { return (int)levels.size() + 1; }
+    float maxDensity() const;
+    size_t memoryBytes() const;
+
+    // Map rectangle covered by the raster and the height of the bars' base
+    void setExtent(const glm::vec2& mapMin, const glm::vec2& mapMax, float baseZ);
+
+    // Appends the selected bars to out (cleared first). A node is refined while its footprint
+    // spans more than maxPixelError pixels at its nearest point; refinement stops once one more
+    // split could exceed budget. heightOf(density) is the bar height above baseZ, used to bound
+    // nodes by their maximum density for frustum culling.
+    template <typename HeightOf>
+    LodSelectStats select(const glm::mat4& viewProj, float viewportHeight, float maxPixelError, size_t budget,
+                          HeightOf&& heightOf, std::vector<LodBar>& out) const;
+
+private:
+    struct NodeStats {
+        float mean;
+        float max;
+    };
+    struct LevelInfo {
+        uint32_t width, height;
+        std::vector<NodeStats> nodes;
+    };
+    struct NodeRef {
+        uint32_t x, y;
+    };
+    std::vector<float> raster;
+    uint32_t rasterWidth = 0, rasterHeight = 0;
+    std::vector<LevelInfo> levels; // levels[l - 1] is level l
+    glm::vec2 extentMin = glm::vec2(0.0f), extentMax = glm::vec2(1.0f), cellSize = glm::vec2(1.0f);
+    float baseZ = 0.0f;
+    mutable std::vector<NodeRef> frontier, nextFrontier;
+
+    uint32_t levelWidth(int level) const { return level == 0 ? rasterWidth : levels[level - 1].width; }
+    uint32_t levelHeight(int level) const { return level == 0 ? rasterHeight : levels[level - 1].height; }
+    NodeStats node(int level, uint32_t x, uint32_t y) const {
+        if (level == 0) {
+            float d = raster[(size_t)y * rasterWidth + x];
+            return { d, d };
+        }
+        const LevelInfo& info = levels[level - 1];
+        return info.nodes[(size_t)y * info.width + x];
+    }
+    // Map-space rectangle of the raster cells under a node (clamped at the raster's edges)
+    void nodeRect(int level, uint32_t x, uint32_t y, glm::vec2& min, glm::vec2& max) const {
+        uint32_t x0 = x << level, y0 = y << level;
+        uint32_t x1 = std::min(rasterWidth, (x + 1) << level), y1 = std::min(rasterHeight, (y + 1) << level);
+        // Rows run north to south, map y grows to the north
+        min = glm::vec2(extentMin.x + x0 * cellSize.x, extentMin.y + (rasterHeight - y1) * cellSize.y);
+        max = glm::vec2(extentMin.x + x1 * cellSize.x, extentMin.y + (rasterHeight - y0) * cellSize.y);
+    }
+};
+
+template <typename HeightOf>
+LodSelectStats DensityQuadtree::select(const glm::mat4& viewProj, float viewportHeight, float maxPixelError, size_t budget,
+                                       HeightOf&& heightOf, std::vector<LodBar>& out) const {
+    LodSelectStats stats;
+    out.clear();
+    if (raster.empty()) return stats;
+    const Frustum frustum = Frustum::fromViewProj(viewProj);
+    // Clip w is the view depth; |row 1| is the projection's y scale, so a length L at depth w
+    // covers L * pixelsPerUnit / w pixels
+    const glm::vec4 depthRow(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+    const float pixelsPerUnit = 0.5f * viewportHeight * glm::length(glm::vec3(viewProj[0][1], viewProj[1][1], viewProj[2][1]));
+    const float minDepth = 1e-3f;
+
+    int level = levelCount() - 1;
+    frontier.clear();
+    for (uint32_t y = 0; y < levelHeight(level); ++y)
+        for (uint32_t x = 0; x < levelWidth(level); ++x) frontier.push_back({ x, y });
+    for (; !frontier.empty(); --level) {
+        nextFrontier.clear();
+        for (size_t i = 0; i < frontier.size(); ++i) {
+            const NodeRef ref = frontier[i];
+            const NodeStats aggregate = node(level, ref.x, ref.y);
+            ++stats.nodesVisited;
+            if (std::isnan(aggregate.mean)) continue;
+            glm::vec2 min, max;
+            nodeRect(level, ref.x, ref.y, min, max);
+            glm::vec3 boxMin(min, baseZ), boxMax(max, baseZ + heightOf(aggregate.max));
+            if (!frustum.intersects(boxMin, boxMax)) continue;
+            bool refine = level > 0;
+            if (refine) {
+                // Nearest depth of the node's box, from the box corner minimising the depth row
+                glm::vec3 nearest(depthRow.x > 0.0f ? boxMin.x : boxMax.x, depthRow.y > 0.0f ? boxMin.y : boxMax.y,
+                                  depthRow.z > 0.0f ? boxMin.z : boxMax.z);
+                float depth = std::max(glm::dot(glm::vec3(depthRow), nearest) + depthRow.w, minDepth);
+                float footprint = std::max(max.x - min.x, max.y - min.y);
+                refine = footprint * pixelsPerUnit / depth > maxPixelError;
+            }
+            // Every node still queued yields at most one bar unless it is split itself
+            if (refine && out.size() + nextFrontier.size() + (frontier.size() - i - 1) + 4 > budget) {
+                refine = false;
+                stats.budgetReached = true;
+            }
+            if (!refine) {
+                out.push_back({ 0.5f * (min + max), 0.5f * (max - min), aggregate.mean });
+                continue;
+            }
+            uint32_t childWidth = levelWidth(level - 1), childHeight = levelHeight(level - 1);
+            for (uint32_t cy = ref.y * 2; cy < std::min(ref.y * 2 + 2, childHeight); ++cy)
+                for (uint32_t cx = ref.x * 2; cx < std::min(ref.x * 2 + 2, childWidth); ++cx) nextFrontier.push_back({ cx, cy });
+        }
+        frontier.swap(nextFrontier);
+    }
+    stats.bars = out.size();
+    return stats;
+}
@@ -0,0 +1,36 @@
+#include "EntityDictionary.h"
+
+uint32_t EntityDictionary::intern(std::string_view name, std::string_view code, float x, float y) {
+    auto it = index.find(name);
+    if (it != index.end()) return it->second;
+    uint32_t id = (uint32_t)names.size();
+    names.emplace_back(name);
+    codes.emplace_back(code);
+    xs.push_back(x);
+    ys.push_back(y);
+    index.emplace(std::string_view(names.back()), id);
+    return id;
+}
+
+uint32_t EntityDictionary::find(std::string_view name) const {
+    auto it = index.find(name);
+    return it != index.end() ? it->second : kInvalidId;
+}
+
+void EntityDictionary::clear() {
+    index.clear();
+    names.clear();
+    codes.clear();
+    xs.clear();
+    ys.clear();
+}
+
+size_t EntityDictionary::memoryBytes() const {
+    size_t bytes = (xs.capacity() + ys.capacity()) * sizeof(float);
+    // Strings longer than the small-string buffer own a heap block
+    for (const auto& s : names) bytes += sizeof(std::string) + (s.capacity() > 15 ? s.capacity() + 1 : 0);
+    for (const auto& s : codes) bytes += sizeof(std::string) + (s.capacity() > 15 ? s.capacity() + 1 : 0);
+    // Hash node (key view + id + next pointer) and bucket per entry
+    bytes += index.size() * (sizeof(std::string_view) + sizeof(uint32_t) + 2 * sizeof(void*));
+    return bytes;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// Dense ids for dataset entities (countries, regions). Each entity's display name, code and
+// map coordinates are stored once, rows and UI state refer to entities by id.
+class EntityDictionary {
+public:
+    static constexpr uint32_t kInvalidId = 0xFFFFFFFFu;
+
+    EntityDictionary() = default;
+    // A copy's index would still view the source's strings. Moving keeps the deque nodes, and the
+    // strings with them, in place.
+    EntityDictionary(const EntityDictionary&) = delete;
+    EntityDictionary& operator=(const EntityDictionary&) = delete;
+    EntityDictionary(EntityDictionary&&) = default;
+    EntityDictionary& operator=(EntityDictionary&&) = default;
+
+    // Returns the id for name, adding the entity with the given code and coordinates if new
+    uint32_t intern(std::string_view name, std::string_view code, float x, float y);
+    // Id for name, or kInvalidId
+    uint32_t find(std::string_view name) const;
+    void clear();
+
+    uint32_t size() const { return (uint32_t)names.size(); }
+    const std::string& name(uint32_t id) const { return names[id]; }
+    const std::string& code(uint32_t id) const { return codes[id]; }
+    float x(uint32_t id) const { return xs[id]; }
+    float y(uint32_t id) const { return ys[id]; }
+
+    // Approximate heap footprint, for memory reporting
+    size_t memoryBytes() const;
+
+private:
+    // deque keeps the strings in place, so the index can key on views into them
+    std::deque<std::string> names;
+    std::deque<std::string> codes;
+    std::vector<float> xs, ys;
+    std::unordered_map<std::string_view, uint32_t> index;
+};
@@ -0,0 +1,79 @@
+#include "FrameUniforms.h"
+#include <cstddef>
+
+const char* const FrameUniforms::kGlsl = R"(#version 330 core
+layout(std140) uniform FrameUniforms {
+    mat4 uView;
+    mat4 uProj;
+    mat4 uViewProj;
+    mat4 uInvView;
+    mat4 uInvProj;
+    mat4 uInvViewProj;
+    vec4 uViewport;
+    float uTime;
+    float uYear;
+};
+)";
+
+static_assert(sizeof(FrameUniformData) == 6 * 64 + 16 + 16, "FrameUniformData must match the std140 block");
+
+// Buffer bound to kBinding, so repeated binds of the same block are skipped
+static GLuint boundBuffer = 0;
+
+FrameUniforms::~FrameUniforms() {
+    if (!buffer) return;
+    if (boundBuffer == buffer) boundBuffer = 0;
+    glDeleteBuffers(1, &buffer);
+}
+
+bool FrameUniforms::initialize() {
+    if (buffer) return true;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniformData), &values, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    bind();
+    return true;
+}
+
+void FrameUniforms::bind() const {
+    if (boundBuffer == buffer) return;
+    glBindBufferBase(GL_UNIFORM_BUFFER, kBinding, buffer);
+    boundBuffer = buffer;
+}
+
+void FrameUniforms::update(const glm::mat4& view, const glm::mat4& proj, const glm::vec4& viewport, float time, float year) {
+    if (!buffer) initialize();
+    values.view = view;
+    values.proj = proj;
+    values.viewProj = proj * view;
+    values.invView = glm::inverse(view);
+    values.invProj = glm::inverse(proj);
+    values.invViewProj = glm::inverse(values.viewProj);
+    values.viewport = viewport;
+    values.time = time;
+    values.year = year;
+    // glBufferSubData through binding kBinding, so the block is also bound for the frame
+    boundBuffer = buffer;
+    glBindBufferBase(GL_UNIFORM_BUFFER, kBinding, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(values), &values);
+}
+
+void FrameUniforms::setViewProj(const glm::mat4& viewProj) {
+    if (!buffer) initialize();
+    bind();
+    if (viewProj == values.viewProj) return;
+    values.viewProj = viewProj;
+    values.invViewProj = glm::inverse(viewProj);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, offsetof(FrameUniformData, viewProj), sizeof(glm::mat4), &values.viewProj);
+    glBufferSubData(GL_UNIFORM_BUFFER, offsetof(FrameUniformData, invViewProj), sizeof(glm::mat4), &values.invViewProj);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+bool FrameUniforms::attach(GLuint program) {
+    GLuint index = glGetUniformBlockIndex(program, "FrameUniforms");
+    if (index == GL_INVALID_INDEX) return false;
+    glUniformBlockBinding(program, index, kBinding);
+    return true;
+}
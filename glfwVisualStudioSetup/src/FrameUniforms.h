@@ -0,0 +1,49 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Contents of the FrameUniforms block (std140: only mat4, vec4 and a closing vec4 of scalars)
+struct FrameUniformData {
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 proj = glm::mat4(1.0f);
+    glm::mat4 viewProj = glm::mat4(1.0f);
+    glm::mat4 invView = glm::mat4(1.0f);
+    glm::mat4 invProj = glm::mat4(1.0f);
+    glm::mat4 invViewProj = glm::mat4(1.0f);
+    glm::vec4 viewport = glm::vec4(0.0f); // x, y, width, height in pixels
+    float time = 0.0f;                    // Seconds since startup
+    float year = 0.0f;                    // Year shown, fractional while playing
+    float padding[2] = {};
+};
+
+// Per-frame camera and scene values shared by every scene shader through one uniform buffer,
+// bound to kBinding. kGlsl holds the #version line and the block, shaders are compiled with it as
+// their first source string; programs are pointed at the binding once with attach().
+class FrameUniforms {
+public:
+    static const GLuint kBinding = 0;
+    static const char* const kGlsl;
+
+    FrameUniforms() = default;
+    FrameUniforms(const FrameUniforms&) = delete;
+    FrameUniforms& operator=(const FrameUniforms&) = delete;
+    ~FrameUniforms();
+    bool initialize();
+    bool isInitialized() const { return buffer != 0; }
+
+    // Uploads the whole block and binds it, once per frame
+    void update(const glm::mat4& view, const glm::mat4& proj, const glm::vec4& viewport, float time, float year);
+    // Draws with another view-projection (picking, offscreen checks) replace only viewProj and
+    // its inverse; nothing is uploaded when it already holds that matrix
+    void setViewProj(const glm::mat4& viewProj);
+    const FrameUniformData& data() const { return values; }
+    GLuint name() const { return buffer; }
+
+    // Binds program's FrameUniforms block to kBinding, false if the program does not declare it
+    static bool attach(GLuint program);
+
+private:
+    GLuint buffer = 0;
+    FrameUniformData values;
+    void bind() const;
+};
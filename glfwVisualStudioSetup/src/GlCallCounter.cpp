@@ -0,0 +1,69 @@
+#include "GlCallCounter.h"
+#include <glad/glad.h>
+
+namespace {
+
+uint64_t calls = 0;
+bool installed = false;
+
+// One wrapper per entry point: Slot is glad's pointer variable, Fn its type
+template <auto* Slot, typename Fn>
+struct CountedCall;
+
+template <auto* Slot, typename R, typename... Args>
+struct CountedCall<Slot, R (APIENTRYP)(Args...)> {
+    static inline R (APIENTRYP real)(Args...) = nullptr;
+    static R APIENTRY call(Args... args) {
+        ++calls;
+        return real(args...);
+    }
+    static void install() {
+        // Entry points the context does not provide stay null
+        if (real || !*Slot) return;
+        real = *Slot;
+        *Slot = &call;
+    }
+    static void uninstall() {
+        if (!real) return;
+        *Slot = real;
+        real = nullptr;
+    }
+};
+
+#define COUNTED_GL_CALLS(X) \
+    X(glActiveTexture) X(glBindBuffer) X(glBindBufferBase) X(glBindBufferRange) X(glBindFramebuffer) \
+    X(glBindTexture) X(glBindVertexArray) X(glBlendFunc) X(glBufferData) X(glBufferSubData) X(glClear) \
+    X(glClearBufferfv) X(glClearBufferuiv) X(glClearColor) X(glClientWaitSync) X(glDeleteSync) X(glDepthFunc) \
+    X(glDepthMask) X(glDisable) X(glDisableVertexAttribArray) X(glDispatchCompute) X(glDrawArrays) \
+    X(glDrawArraysIndirect) X(glDrawArraysInstanced) X(glDrawElements) X(glDrawElementsInstanced) X(glEnable) \
+    X(glEnableVertexAttribArray) X(glFenceSync) X(glGetBufferSubData) X(glGetError) X(glGetIntegerv) \
+    X(glGetUniformBlockIndex) X(glGetUniformLocation) X(glIsEnabled) X(glMapBufferRange) X(glMemoryBarrier) \
+    X(glReadPixels) X(glTexParameteri) X(glUniform1f) X(glUniform1i) X(glUniform1iv) X(glUniform1ui) \
+    X(glUniform2f) X(glUniform3f) X(glUniform4f) X(glUniform4fv) X(glUniformBlockBinding) X(glUniformMatrix4fv) \
+    X(glUnmapBuffer) X(glUseProgram) X(glVertexAttribDivisor) X(glVertexAttribIPointer) X(glVertexAttribPointer) \
+    X(glViewport)
+
+#define INSTALL_COUNTED(name) CountedCall<&glad_##name, decltype(glad_##name)>::install();
+#define UNINSTALL_COUNTED(name) CountedCall<&glad_##name, decltype(glad_##name)>::uninstall();
+
+} // namespace
+
+void installGlCallCounter() {
+    if (installed) return;
+    COUNTED_GL_CALLS(INSTALL_COUNTED)
+    installed = true;
+}
+
+void uninstallGlCallCounter() {
+    if (!installed) return;
+    COUNTED_GL_CALLS(UNINSTALL_COUNTED)
+    installed = false;
+}
+
+bool isGlCallCounterInstalled() {
+    return installed;
+}
+
+uint64_t glCallCount() {
+    return calls;
+}
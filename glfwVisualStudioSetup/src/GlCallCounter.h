@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+
+// Counts calls into the GL entry points the scene renderers use, by swapping glad's function
+// pointers for counting wrappers. Install after gladLoadGL; calls made by ImGui's own loader
+// are not seen. Only for measuring: every counted call pays one extra indirect jump.
+void installGlCallCounter();
+void uninstallGlCallCounter();
+bool isGlCallCounterInstalled();
+uint64_t glCallCount();
@@ -0,0 +1,96 @@
+#include "GpuPicker.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+
+GpuPicker::~GpuPicker() {
+    for (int i = 0; i < kRingSize; ++i)
+        if (fences[i]) glDeleteSync(fences[i]);
+    if (pixelBuffers[0]) glDeleteBuffers(kRingSize, pixelBuffers);
+    if (colorBuffer) glDeleteRenderbuffers(1, &colorBuffer);
+    if (depthBuffer) glDeleteRenderbuffers(1, &depthBuffer);
+    if (fbo) glDeleteFramebuffers(1, &fbo);
+}
+
+bool GpuPicker::initialize() {
+    if (fbo) return true;
+    GLint previous = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_R32UI, 1, 1);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 1, 1);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previous);
+    if (!complete) {
+        std::cerr << "Picking framebuffer is incomplete" << std::endl;
+        return false;
+    }
+    glGenBuffers(kRingSize, pixelBuffers);
+    for (int i = 0; i < kRingSize; ++i) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(uint32_t), nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return true;
+}
+
+// Reads every queued pixel whose fence has signalled, oldest first, without blocking
+void GpuPicker::collectReadbacks() {
+    while (pending > 0) {
+        int slot = (head - pending + kRingSize) % kRingSize;
+        GLenum status = glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        glDeleteSync(fences[slot]);
+        fences[slot] = nullptr;
+        --pending;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+        const void* pixel = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(uint32_t), GL_MAP_READ_BIT);
+        if (pixel) {
+            lastId = *static_cast<const uint32_t*>(pixel);
+            lastTag = tags[slot];
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+}
+
+bool GpuPicker::begin(float mouseX, float mouseY, int screenWidth, int screenHeight, uint64_t tag, glm::mat4& pickMatrix) {
+    if (!fbo || screenWidth <= 0 || screenHeight <= 0) return false;
+    collectReadbacks();
+    // Every slot still waits on the GPU, keep the previous result rather than stall
+    if (pending == kRingSize) return false;
+
+    // Maps the one pixel under the cursor onto the whole 1x1 target
+    pickMatrix = glm::pickMatrix(glm::vec2(mouseX, (float)screenHeight - mouseY), glm::vec2(1.0f),
+                                 glm::ivec4(0, 0, screenWidth, screenHeight));
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &savedFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, savedViewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, 1, 1);
+    const GLuint noId[4] = { 0, 0, 0, 0 };
+    const GLfloat farDepth = 1.0f;
+    glClearBufferuiv(GL_COLOR, 0, noId);
+    glClearBufferfv(GL_DEPTH, 0, &farDepth);
+    tags[head] = tag;
+    return true;
+}
+
+void GpuPicker::end() {
+    // Copy into the next pixel-buffer object, glReadPixels returns without waiting for the pass
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[head]);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fences[head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    head = (head + 1) % kRingSize;
+    ++pending;
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)savedFramebuffer);
+    glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+}
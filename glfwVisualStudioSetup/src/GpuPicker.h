@@ -0,0 +1,44 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+
+// Offscreen id-buffer picking. An id pass renders the single pixel under the cursor into a 1x1
+// R32UI colour attachment (through a pick matrix, so its cost does not depend on the window
+// size). The pixel is copied into one of a ring of pixel-buffer objects and read once its fence
+// has signalled, one or two passes later, so picking never waits for the GPU. Each pass carries
+// the caller's tag, so a caller can tell whether the id it reads answers its latest request.
+class GpuPicker {
+public:
+    GpuPicker() = default;
+    GpuPicker(const GpuPicker&) = delete;
+    GpuPicker& operator=(const GpuPicker&) = delete;
+    ~GpuPicker();
+    bool initialize();
+    bool isInitialized() const { return fbo != 0; }
+
+    // Collects finished readbacks and, if a ring slot is free, binds the target for an id pass
+    // covering the pixel at (mouseX, mouseY) (window coordinates, y down). pickMatrix must be
+    // premultiplied onto the pass's view-projection. Returns false when the pass should be skipped.
+    bool begin(float mouseX, float mouseY, int screenWidth, int screenHeight, uint64_t tag, glm::mat4& pickMatrix);
+    // Queues the readback of the id and restores the caller's framebuffer and viewport
+    void end();
+    // Id from the most recent completed readback, 0 when nothing was under the cursor
+    uint32_t latestId() const { return lastId; }
+    // Tag of the pass latestId() came from, 0 before the first readback
+    uint64_t latestTag() const { return lastTag; }
+
+private:
+    static const int kRingSize = 3;
+    GLuint fbo = 0, colorBuffer = 0, depthBuffer = 0;
+    GLuint pixelBuffers[kRingSize] = {};
+    GLsync fences[kRingSize] = {};
+    uint64_t tags[kRingSize] = {};
+    int head = 0;    // Next slot to fill
+    int pending = 0; // Queued readbacks, oldest at head - pending
+    uint32_t lastId = 0;
+    uint64_t lastTag = 0;
+    GLint savedFramebuffer = 0;
+    GLint savedViewport[4] = {};
+    void collectReadbacks();
+};
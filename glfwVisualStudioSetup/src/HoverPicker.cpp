@@ -0,0 +1,62 @@
+#include "HoverPicker.h"
+#include <cmath>
+
+// Scene motion under the cursor above which hovering is suspended, in pixels per frame
+static const float kFastMotionPixels = 6.0f;
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) hash = (hash ^ bytes[i]) * 1099511628211ull;
+    return hash;
+}
+
+// Screen distance travelled by the scene point under the cursor between two view-projections.
+// The point is taken at the depth of the map centre (the world origin).
+static float cursorMotionPixels(const glm::mat4& from, const glm::mat4& to, float mouseX, float mouseY,
+                                int screenWidth, int screenHeight) {
+    glm::vec4 centre = from * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    if (centre.w <= 0.0f) return 0.0f;
+    glm::vec4 ndc(2.0f * mouseX / screenWidth - 1.0f, 1.0f - 2.0f * mouseY / screenHeight, centre.z / centre.w, 1.0f);
+    glm::vec4 world = glm::inverse(from) * ndc;
+    glm::vec4 moved = to * (world / world.w);
+    if (moved.w <= 0.0f) return 0.0f;
+    float dx = (moved.x / moved.w - ndc.x) * 0.5f * screenWidth;
+    float dy = (moved.y / moved.w - ndc.y) * 0.5f * screenHeight;
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+int HoverPicker::update(const PopulationBars& bars, float mouseX, float mouseY, const glm::mat4& view, const glm::mat4& proj,
+                        int screenWidth, int screenHeight) {
+    if (screenWidth <= 0 || screenHeight <= 0) return result = -1;
+    glm::mat4 viewProj = proj * view;
+    uint64_t generation = bars.getPickGeneration();
+    uint64_t key = 1469598103934665603ull;
+    key = fnv1a(key, &mouseX, sizeof(mouseX));
+    key = fnv1a(key, &mouseY, sizeof(mouseY));
+    key = fnv1a(key, &viewProj, sizeof(viewProj));
+    key = fnv1a(key, &screenWidth, sizeof(screenWidth));
+    key = fnv1a(key, &screenHeight, sizeof(screenHeight));
+    key = fnv1a(key, &generation, sizeof(generation));
+
+    bool fastMotion = hasViewProj && viewProj != lastViewProj &&
+                      cursorMotionPixels(lastViewProj, viewProj, mouseX, mouseY, screenWidth, screenHeight) > kFastMotionPixels;
+    lastViewProj = viewProj;
+    hasViewProj = true;
+    if (fastMotion) {
+        // Forget the key so the first calm frame picks again
+        hasKey = false;
+        ++stats.debounced;
+        return result = -1;
+    }
+    if (hasKey && key == lastKey && resultCurrent) {
+        ++stats.cached;
+        return result;
+    }
+    // The key tags the pick, so a GPU answer is only cached once it is the one for this key
+    lastKey = key;
+    hasKey = true;
+    ++stats.picks;
+    result = bars.pickBar(mouseX, mouseY, view, proj, screenWidth, screenHeight, key);
+    resultCurrent = bars.isPickCurrent(key);
+    return result;
+}
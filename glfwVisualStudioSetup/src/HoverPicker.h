@@ -0,0 +1,35 @@
+#pragma once
+#include "PopulationBars.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+
+// Hover picks performed, answered from the cache, and suppressed while the camera moved fast
+struct HoverPickStats {
+    uint64_t picks = 0;
+    uint64_t cached = 0;
+    uint64_t debounced = 0;
+    uint64_t frames() const { return picks + cached + debounced; }
+};
+
+// Per-frame hover picking for the UI. The result is cached on a hash of the cursor position,
+// the view-projection, the screen size and the bars' pick generation, so an idle frame costs
+// one hash. While the scene under the cursor moves faster than a few pixels per frame hovering
+// is switched off instead of re-picking every frame.
+class HoverPicker {
+public:
+    // Bar under the cursor this frame, -1 for none
+    int update(const PopulationBars& bars, float mouseX, float mouseY, const glm::mat4& view, const glm::mat4& proj,
+               int screenWidth, int screenHeight);
+    int hovered() const { return result; }
+    const HoverPickStats& getStats() const { return stats; }
+    void resetStats() { stats = HoverPickStats(); }
+
+private:
+    uint64_t lastKey = 0;
+    bool hasKey = false;
+    glm::mat4 lastViewProj = glm::mat4(1.0f);
+    bool hasViewProj = false;
+    int result = -1;
+    bool resultCurrent = false; // result answers lastKey (GPU picks arrive a few calls late)
+    HoverPickStats stats;
+};
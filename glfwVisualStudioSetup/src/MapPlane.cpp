@@ -1,10 +1,14 @@
 #include "MapPlane.h"
-#include <stb_image/stb_image.h>
+#include "FrameUniforms.h"
+#include "DecodedImage.h"
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 #include <vector>
 #include <fstream>
 #include <sstream>
+#include <filesystem>
+
+namespace fs = std::filesystem;
 
 // Vertex structure for the box
 struct Vertex {
@@ -20,26 +24,57 @@ MapPlane::~MapPlane() {
     if (vbo) glDeleteBuffers(1, &vbo);
     if (ebo) glDeleteBuffers(1, &ebo);
     if (texture) glDeleteTextures(1, &texture);
-    if (shaderProgram) glDeleteProgram(shaderProgram);
 }
 
-bool MapPlane::loadTexture(const std::string& path) {
-    int texWidth, texHeight, nrChannels;
-    stbi_set_flip_vertically_on_load(1);
-    unsigned char* data = stbi_load(path.c_str(), &texWidth, &texHeight, &nrChannels, 4);
-    if (!data) {
+bool MapPlane::loadTexture(const std::string& path, bool useCache) {
+    MapTextureSource source;
+    if (!prepareTexture(path, source, useCache)) return false;
+    return uploadTexture(source);
+}
+
+bool MapPlane::prepareTexture(const std::string& path, MapTextureSource& source, bool useCache) {
+    if (fs::path(path).extension() == ".ptp") return source.tiles.open(path);
+    useCache = useCache && CompressedTexture::isFormatSupported();
+    const std::string cachePath = CompressedTexture::cachePathFor(path);
+    if (useCache && source.compressed.open(cachePath, path)) return true;
+    if (!decodeImage(path, true, source.image)) {
         std::cerr << "Failed to load texture: " << path << std::endl;
         return false;
     }
+    // First run (or an edited image): convert once, later starts only map the cache
+    if (useCache && CompressedTexture::write(cachePath, path, source.image) && source.compressed.open(cachePath, path))
+        source.image = DecodedImage();
+    return true;
+}
+
+bool MapPlane::uploadTexture(const MapTextureSource& source) {
+    if (source.tiles.isOpen()) {
+        virtualTexture = std::make_unique<VirtualTexture>();
+        if (!virtualTexture->open(source.tiles, tileSettings) || !createVirtualShaders()) {
+            virtualTexture.reset();
+            return false;
+        }
+        textureCompressed = CompressedTexture::isFormatSupported();
+        return true;
+    }
+    if (!source.compressed.isOpen() && source.image.empty()) return false;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texWidth, texHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    textureCompressed = source.compressed.isOpen();
+    if (textureCompressed) {
+        source.compressed.upload();
+        textureBytes = source.compressed.dataBytes();
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, source.image.width, source.image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                     source.image.pixels.get());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        textureBytes = (size_t)source.image.width * source.image.height * 4 * 4 / 3;
+    }
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    // Trilinear, so the zoomed-out map samples its mip levels instead of aliasing
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    stbi_image_free(data);
     return true;
 }
 
@@ -50,14 +85,33 @@ bool MapPlane::initialize() {
     return true;
 }
 
-void MapPlane::draw(const glm::mat4& viewProjMatrix) const {
+size_t MapPlane::getTextureBytes() const {
+    return virtualTexture ? virtualTexture->getStats().gpuBytes : textureBytes;
+}
+
+void MapPlane::updateTiles(int viewportWidth, int viewportHeight) {
+    if (!initialized || !virtualTexture) return;
+    virtualTexture->update();
+    virtualTexture->beginFeedback(viewportWidth, viewportHeight);
+    glUseProgram(feedbackProgram.id());
+    glBindVertexArray(vao);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
+    virtualTexture->endFeedback();
+}
+
+void MapPlane::draw() const {
     if (!initialized) return;
-    glUseProgram(shaderProgram);
     glBindVertexArray(vao);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glUniform1i(glGetUniformLocation(shaderProgram, "uTexture"), 0);
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "uViewProj"), 1, GL_FALSE, glm::value_ptr(viewProjMatrix));
+    if (virtualTexture) {
+        glUseProgram(virtualProgram.id());
+        virtualTexture->bindTextures();
+    } else {
+        glUseProgram(shaderProgram.id());
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0); // Only top face
     glBindVertexArray(0);
     glUseProgram(0);
@@ -88,11 +142,10 @@ void MapPlane::createBoxGeometry() {
     glBindVertexArray(0);
 }
 
+// Compiled after FrameUniforms::kGlsl
 static const char* vertexShaderSrc = R"(
-#version 330 core
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec2 aTexCoord;
-uniform mat4 uViewProj;
 out vec2 vTexCoord;
 void main() {
     gl_Position = uViewProj * vec4(aPos, 1.0);
@@ -110,38 +163,46 @@ void main() {
 }
 )";
 
-static GLuint compileShader(GLenum type, const char* src) {
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &src, nullptr);
-    glCompileShader(shader);
-    int success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
-        std::cerr << "Shader compilation error: " << infoLog << std::endl;
-        return 0;
-    }
-    return shader;
+// Compiled after VirtualTexture::kGlsl
+static const char* virtualFragmentShaderSrc = R"(
+in vec2 vTexCoord;
+out vec4 FragColor;
+void main() {
+    FragColor = sampleVirtual(vTexCoord);
 }
+)";
+
+static const char* feedbackFragmentShaderSrc = R"(
+in vec2 vTexCoord;
+out uint FeedbackTile;
+void main() {
+    FeedbackTile = virtualTileId(vTexCoord);
+}
+)";
 
 bool MapPlane::createShaders() {
-    GLuint vs = compileShader(GL_VERTEX_SHADER, vertexShaderSrc);
-    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSrc);
-    if (!vs || !fs) return false;
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vs);
-    glAttachShader(shaderProgram, fs);
-    glLinkProgram(shaderProgram);
-    int success;
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
-        std::cerr << "Shader link error: " << infoLog << std::endl;
-        return false;
-    }
-    glDeleteShader(vs);
-    glDeleteShader(fs);
-    return true;
-} 
\ No newline at end of file
+    return shaderProgram.create("map", {
+        { GL_VERTEX_SHADER, { { "frame_uniforms.glsl", FrameUniforms::kGlsl }, { "map.vert", vertexShaderSrc } } },
+        { GL_FRAGMENT_SHADER, { { "map.frag", fragmentShaderSrc } } } },
+        [](GLuint program) {
+            // The sampler unit never changes; the camera comes from the frame block
+            FrameUniforms::attach(program);
+            glUseProgram(program);
+            glUniform1i(glGetUniformLocation(program, "uTexture"), 0);
+            glUseProgram(0);
+        });
+}
+
+bool MapPlane::createVirtualShaders() {
+    auto program = [this](ShaderProgram& target, const char* name, const char* file, const char* source, bool feedback) {
+        return target.create(name, {
+            { GL_VERTEX_SHADER, { { "frame_uniforms.glsl", FrameUniforms::kGlsl }, { "map.vert", vertexShaderSrc } } },
+            { GL_FRAGMENT_SHADER, { { "virtual_texture.glsl", VirtualTexture::kGlsl }, { file, source } } } },
+            [this, feedback](GLuint id) {
+                FrameUniforms::attach(id);
+                if (virtualTexture) virtualTexture->setUniforms(id, feedback);
+            });
+    };
+    return program(virtualProgram, "map_virtual", "map_virtual.frag", virtualFragmentShaderSrc, false) &&
+           program(feedbackProgram, "map_feedback", "map_feedback.frag", feedbackFragmentShaderSrc, true);
+}
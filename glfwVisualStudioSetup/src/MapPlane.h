@@ -2,6 +2,19 @@
 #include <string>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include "ShaderManager.h"
+#include "DecodedImage.h"
+#include "CompressedTexture.h"
+#include "VirtualTexture.h"
+#include <memory>
+
+// Map texture prepared off the GL thread: the tile table of a .ptp pyramid, the mapped
+// block-compressed cache when the GL supports its format, otherwise the decoded image
+struct MapTextureSource {
+    TilePyramid tiles;
+    CompressedTexture compressed;
+    DecodedImage image;
+};
 
 // Class responsible for rendering a flat box (plane) with a texture on the top face
 class MapPlane {
@@ -11,13 +24,29 @@ public:
     ~MapPlane();
 
     // Loads the texture from file (returns true on success)
-    bool loadTexture(const std::string& path);
+    bool loadTexture(const std::string& path, bool useCache = true);
+    // The two halves of loadTexture. prepareTexture needs no GL context and may run on any thread:
+    // it maps the compressed cache, building it on the first run (or decodes path without it). A
+    // .ptp path is a tile pyramid and makes the map a virtual texture streamed as the view needs it.
+    static bool prepareTexture(const std::string& path, MapTextureSource& source, bool useCache = true);
+    bool uploadTexture(const MapTextureSource& source);
+    // GPU memory of the texture with all its mip levels (tiled: tile atlas and page table)
+    size_t getTextureBytes() const;
+    bool isTextureCompressed() const { return textureCompressed; }
+
+    // Tiled basemaps: settings used by the next uploadTexture of a pyramid
+    void setTileSettings(const VirtualTextureSettings& settings) { tileSettings = settings; }
+    bool isTiled() const { return virtualTexture != nullptr; }
+    const VirtualTexture* getVirtualTexture() const { return virtualTexture.get(); }
+    // Streams in the tiles the view needs: uploads what has loaded, then renders this frame's
+    // feedback pass. Call once per frame after the FrameUniforms update, before draw().
+    void updateTiles(int viewportWidth, int viewportHeight);
 
     // Initializes OpenGL buffers and shaders
     bool initialize();
 
-    // Renders the map plane
-    void draw(const glm::mat4& viewProjMatrix) const;
+    // Renders the map plane with the camera of the bound FrameUniforms block
+    void draw() const;
 
     // Returns aspect ratio (width/height)
     float getAspectRatio() const { return width / height; }
@@ -26,11 +55,17 @@ private:
     float width, height, thickness;
     GLuint vao = 0, vbo = 0, ebo = 0;
     GLuint texture = 0;
-    GLuint shaderProgram = 0;
+    size_t textureBytes = 0;
+    bool textureCompressed = false;
+    ShaderProgram shaderProgram;
     bool initialized = false;
+    VirtualTextureSettings tileSettings;
+    std::unique_ptr<VirtualTexture> virtualTexture;
+    ShaderProgram virtualProgram, feedbackProgram;
 
     // Helper to create geometry
     void createBoxGeometry();
     // Helper to load and compile shaders
     bool createShaders();
+    bool createVirtualShaders();
 }; 
\ No newline at end of file
@@ -1,9 +1,21 @@
 #include "PopulationBars.h"
+#include "MappedFile.h"
+#include "CsvTokenizer.h"
+#include "ThreadPool.h"
+#include "DatasetCache.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <cstring>
+#include <cstddef>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
 #include <cmath>
 
 // Helper to trim whitespace from strings
@@ -13,20 +25,230 @@ static std::string trim(const std::string& s) {
     return (start == std::string::npos) ? "" : s.substr(start, end - start + 1);
 }
 
+// Bar placement, shared by the vertex shader and CPU picking
+static const float kMaxBarHeight = 1.5f;
+static const float kBarWidth = 0.08f;
+static const float kImageWidth = 4592.0f;
+static const float kImageHeight = 3196.0f;
+// Up to this many visible bars pickBar uses the SIMD kernel instead of the BVH
+static const size_t kKernelPickLimit = 4096;
+
+// Distance along dir to where the ray enters the regular prism of the given sides standing on
+// [baseZ, topZ], corners on the circle of radius around center at angles 2 pi k / sides as the
+// vertex shader builds them. Infinity on a miss or at or beyond maxT, like rayBoxEntry.
+static float rayPrismEntry(const glm::vec3& origin, const glm::vec3& dir, glm::vec2 center, float radius, float baseZ,
+                           float topZ, int sides, float maxT) {
+    const float miss = std::numeric_limits<float>::infinity();
+    float tNear = 0.0f, tFar = miss;
+    // Clips the ray to the half-space normal . p <= d, given normal . dir and d - normal . origin
+    auto clip = [&](float along, float distance) {
+        if (along == 0.0f) return distance >= 0.0f;
+        if (along < 0.0f) tNear = std::max(tNear, distance / along);
+        else tFar = std::min(tFar, distance / along);
+        return tNear <= tFar;
+    };
+    if (!clip(-dir.z, origin.z - baseZ) || !clip(dir.z, topZ - origin.z)) return miss;
+    const float apothem = radius * std::cos(glm::pi<float>() / sides);
+    const glm::vec2 offset = glm::vec2(origin) - center;
+    for (int k = 0; k < sides; ++k) {
+        float angle = glm::two_pi<float>() * (k + 0.5f) / sides;
+        glm::vec2 normal(std::cos(angle), std::sin(angle));
+        if (!clip(glm::dot(normal, glm::vec2(dir)), apothem - glm::dot(normal, offset))) return miss;
+    }
+    return tNear < maxT ? tNear : miss;
+}
+
+// One (year, entity, density) row of the dataset
+struct DensitySample {
+    int32_t year;
+    uint32_t entity;
+    float density;
+};
+
+// Rows parsed from one line-aligned slice of the dataset file. Entity ids are local to the
+// chunk until the merge maps them into the shared dictionary.
+struct ParsedChunk {
+    EntityDictionary entities;
+    std::vector<DensitySample> samples;
+    float maxDensity = 0.0f;
+    int minYear = std::numeric_limits<int>::max();
+    int maxYear = std::numeric_limits<int>::min();
+};
+
+static void parseChunk(const char* begin, const char* end, ParsedChunk& out) {
+    CsvTokenizer tokenizer(begin, end);
+    std::string unescaped;
+    while (tokenizer.nextRow()) {
+        if (tokenizer.fieldCount() < 6) continue;
+        DensitySample sample;
+        float x, y;
+        if (!parseIntField(tokenizer.field(2), sample.year) ||
+            !parseFloatField(tokenizer.field(3), sample.density) ||
+            !parseFloatField(tokenizer.field(4), x) ||
+            !parseFloatField(tokenizer.field(5), y)) continue;
+        std::string_view name = unquoteField(tokenizer.field(0));
+        if (name.find("\"\"") != std::string_view::npos) {
+            assignUnquoted(unescaped, tokenizer.field(0));
+            name = unescaped;
+        }
+        sample.entity = out.entities.intern(name, unquoteField(tokenizer.field(1)), x, y);
+        if (sample.density > out.maxDensity) out.maxDensity = sample.density;
+        if (sample.year < out.minYear) out.minYear = sample.year;
+        if (sample.year > out.maxYear) out.maxYear = sample.year;
+        out.samples.push_back(sample);
+    }
+}
+
+// Splits [begin, end) into at most count slices that each end just after a newline.
+// Quoted fields may contain commas but are assumed not to span lines.
+static std::vector<std::pair<const char*, const char*>> splitLineAligned(const char* begin, const char* end, size_t count) {
+    std::vector<std::pair<const char*, const char*>> ranges;
+    size_t approx = (size_t)(end - begin) / count + 1;
+    const char* p = begin;
+    while (p < end) {
+        const char* cut = p + approx < end ? p + approx : end;
+        if (cut < end) {
+            const char* newline = static_cast<const char*>(std::memchr(cut, '\n', end - cut));
+            cut = newline ? newline + 1 : end;
+        }
+        ranges.emplace_back(p, cut);
+        p = cut;
+    }
+    return ranges;
+}
+
+// Merges parsed chunks in file order, so ids and duplicate-row resolution (last row wins)
+// do not depend on scheduling
+static size_t mergeChunks(std::vector<ParsedChunk>& chunks, EntityDictionary& entities, PopulationTimeSeries& timeSeries,
+                          float& globalMaxDensity) {
+    int minYear = std::numeric_limits<int>::max();
+    int maxYear = std::numeric_limits<int>::min();
+    globalMaxDensity = 0.0f;
+    for (const auto& chunk : chunks) {
+        if (chunk.maxDensity > globalMaxDensity) globalMaxDensity = chunk.maxDensity;
+        if (chunk.minYear < minYear) minYear = chunk.minYear;
+        if (chunk.maxYear > maxYear) maxYear = chunk.maxYear;
+    }
+    if (chunks.size() == 1) {
+        entities = std::move(chunks[0].entities);
+    } else {
+        for (auto& chunk : chunks) {
+            std::vector<uint32_t> globalIds(chunk.entities.size());
+            for (uint32_t local = 0; local < chunk.entities.size(); ++local)
+                globalIds[local] = entities.intern(chunk.entities.name(local), chunk.entities.code(local),
+                                                   chunk.entities.x(local), chunk.entities.y(local));
+            for (auto& sample : chunk.samples) sample.entity = globalIds[sample.entity];
+            chunk.entities.clear();
+        }
+    }
+    if (maxYear < minYear) {
+        timeSeries.clear();
+        return 0;
+    }
+    timeSeries.reset(minYear, maxYear, entities.size());
+    size_t rows = 0;
+    for (auto& chunk : chunks) {
+        for (const auto& sample : chunk.samples) timeSeries.set(sample.year, sample.entity, sample.density);
+        rows += chunk.samples.size();
+        chunk.samples = std::vector<DensitySample>();
+    }
+    return rows;
+}
+
 bool PopulationBars::loadFromCSV(const std::string& path) {
-    bars.clear();
-    yearToBars.clear();
-    minYear = std::numeric_limits<int>::max();
-    maxYear = std::numeric_limits<int>::min();
-    std::ifstream file("dataset/dataset.csv");
+    auto startTime = std::chrono::steady_clock::now();
+    if (useDatasetCache && loadFromDatasetCache(path)) {
+        lastLoadStats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        return onDatasetLoaded();
+    }
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "Failed to open CSV: " << path << std::endl;
+        return false;
+    }
+    entities.clear();
+    const char* begin = file.data();
+    const char* end = file.data() + file.size();
+    // Skip header
+    const char* headerEnd = begin ? static_cast<const char*>(std::memchr(begin, '\n', file.size())) : nullptr;
+    begin = headerEnd ? headerEnd + 1 : end;
+
+    // Small files are not worth the thread start-up, big ones get a few chunks per worker for balancing
+    const size_t minChunkBytes = 4 << 20;
+    unsigned threads = ThreadPool::resolveThreadCount(loaderThreads);
+    size_t chunkCount = std::min<size_t>((size_t)threads * 4, (size_t)(end - begin) / minChunkBytes);
+    if (threads <= 1 || chunkCount < 2) chunkCount = 1;
+    auto ranges = splitLineAligned(begin, end, chunkCount);
+    std::vector<ParsedChunk> chunks(ranges.size());
+    if (chunks.size() > 1) {
+        ThreadPool pool(threads);
+        pool.parallelFor(chunks.size(), [&](size_t i) { parseChunk(ranges[i].first, ranges[i].second, chunks[i]); });
+    } else if (!chunks.empty()) {
+        parseChunk(ranges[0].first, ranges[0].second, chunks[0]);
+    }
+    size_t rows = mergeChunks(chunks, entities, timeSeries, globalMaxDensity);
+
+    lastLoadStats.rows = rows;
+    lastLoadStats.bytes = file.size();
+    lastLoadStats.threads = chunks.size() > 1 ? threads : 1;
+    lastLoadStats.fromCache = false;
+    lastLoadStats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    file.close();
+    if (useDatasetCache && !writeDatasetCache(path))
+        std::cerr << "Dataset cache not written for: " << path << std::endl;
+    return onDatasetLoaded();
+}
+
+bool PopulationBars::loadFromDatasetCache(const std::string& csvPath) {
+    // The time series views the mapped table, so the cache stays open for as long as it is used
+    auto cache = std::make_shared<DatasetCache>();
+    if (!cache->open(DatasetCache::cachePathFor(csvPath), csvPath)) return false;
+    const uint32_t entityCount = cache->entityCount();
+    // A corrupt entity table just falls back to the CSV
+    entities.clear();
+    for (uint32_t e = 0; e < entityCount; ++e) {
+        if (entities.intern(cache->entityName(e), cache->entityCode(e), cache->entityX(e), cache->entityY(e)) != e) return false;
+    }
+    timeSeries.view(cache->minYear(), cache->maxYear(), entityCount, cache->densities(), cache);
+    globalMaxDensity = cache->globalMaxDensity();
+    lastLoadStats.rows = cache->rowCount();
+    lastLoadStats.bytes = (size_t)cache->densityBytes();
+    lastLoadStats.threads = 1;
+    lastLoadStats.fromCache = true;
+    return true;
+}
+
+bool PopulationBars::writeDatasetCache(const std::string& csvPath) const {
+    DatasetCacheContents contents;
+    contents.globalMaxDensity = globalMaxDensity;
+    contents.minYear = timeSeries.minYear();
+    contents.maxYear = timeSeries.maxYear();
+    contents.rowCount = (uint32_t)lastLoadStats.rows;
+    contents.densities = timeSeries.data();
+    for (uint32_t e = 0; e < entities.size(); ++e) {
+        contents.names.push_back(entities.name(e));
+        contents.codes.push_back(entities.code(e));
+        contents.entityX.push_back(entities.x(e));
+        contents.entityY.push_back(entities.y(e));
+    }
+    return DatasetCache::write(DatasetCache::cachePathFor(csvPath), csvPath, contents);
+}
+
+bool PopulationBars::loadFromCSVStream(const std::string& path) {
+    auto startTime = std::chrono::steady_clock::now();
+    entities.clear();
+    std::ifstream file(path);
     if (!file.is_open()) {
         std::cerr << "Failed to open CSV: " << path << std::endl;
         return false;
     }
     std::string line;
     std::getline(file, line); // skip header
-    std::vector<PopulationBarData> allBars; // For global max
+    size_t bytes = line.size() + 1;
+    std::vector<ParsedChunk> chunks(1);
+    ParsedChunk& parsed = chunks[0];
     while (std::getline(file, line)) {
+        bytes += line.size() + 1;
         std::stringstream ss(line);
         std::string name, code, yearStr, density, x, y;
         std::getline(ss, name, ',');
@@ -35,144 +257,407 @@ bool PopulationBars::loadFromCSV(const std::string& path) {
         std::getline(ss, density, ',');
         std::getline(ss, x, ',');
         std::getline(ss, y, ',');
-        PopulationBarData bar;
-        bar.name = trim(name);
-        bar.density = std::stof(density);
-        bar.x = std::stof(x);
-        bar.y = std::stof(y);
-        int year = std::stoi(yearStr);
-        yearToBars[year].push_back(bar);
-        allBars.push_back(bar);
-        if (year < minYear) minYear = year;
-        if (year > maxYear) maxYear = year;
-    }
-    // Compute global max density
-    globalMaxDensity = 0.0f;
-    for (const auto& bar : allBars) if (bar.density > globalMaxDensity) globalMaxDensity = bar.density;
+        DensitySample sample;
+        sample.density = std::stof(density);
+        sample.entity = parsed.entities.intern(trim(name), trim(code), std::stof(x), std::stof(y));
+        sample.year = std::stoi(yearStr);
+        parsed.samples.push_back(sample);
+        if (sample.density > parsed.maxDensity) parsed.maxDensity = sample.density;
+        if (sample.year < parsed.minYear) parsed.minYear = sample.year;
+        if (sample.year > parsed.maxYear) parsed.maxYear = sample.year;
+    }
+    lastLoadStats.rows = mergeChunks(chunks, entities, timeSeries, globalMaxDensity);
+    lastLoadStats.bytes = bytes;
+    lastLoadStats.threads = 1;
+    lastLoadStats.fromCache = false;
+    lastLoadStats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return onDatasetLoaded();
+}
+
+bool PopulationBars::onDatasetLoaded() {
+    minYear = timeSeries.empty() ? std::numeric_limits<int>::max() : timeSeries.minYear();
+    maxYear = timeSeries.empty() ? std::numeric_limits<int>::min() : timeSeries.maxYear();
+    setAllEntitiesVisible(true);
+    visibilityDirty = false;
+    // Sized once so rebuilding the visible set never allocates
+    bars.clear();
+    bars.reserve(entities.size());
+    barIndexOfEntity.assign(entities.size(), -1);
+    pickBoxes.reserve(std::min<size_t>(entities.size(), kKernelPickLimit));
+    pickDistances.reserve(std::min<size_t>(entities.size(), kKernelPickLimit));
+    countAllocation();
+    if (initialized) {
+        if (!createBarGeometry()) return false;
+        uploadTimeSeries();
+    }
     setYear(currentYear);
     return true;
 }
 
+size_t PopulationBars::getDatasetMemoryBytes() const {
+    return entities.memoryBytes() + timeSeries.memoryBytes();
+}
+
 bool PopulationBars::initialize(float mapWidth_, float mapHeight_, float mapThickness_) {
     mapWidth = mapWidth_;
     mapHeight = mapHeight_;
     mapThickness = mapThickness_;
-    if (!createShaders()) return false;
-    createBarGeometry();
+    if (!shaderProgram.id() && !createShaders()) return false;
+    if (!createBarGeometry()) return false;
+    if (!uploadTimeSeries()) return false;
+    createPickTargets();
+    createGpuCulling();
+    rebuildVisibleBars();
     initialized = true;
     return true;
 }
 
-void PopulationBars::createBarGeometry() {
-    // Delete old buffers and VAO
-    if (vao) { glDeleteVertexArrays(1, &vao); vao = 0; }
-    if (vbo) { glDeleteBuffers(1, &vbo); vbo = 0; }
-    if (instanceVBO) { glDeleteBuffers(1, &instanceVBO); instanceVBO = 0; }
-    if (heightVBO) { glDeleteBuffers(1, &heightVBO); heightVBO = 0; }
-
-    // 8 vertices, 12 triangles (36 indices)
-    float v[] = {
-        -0.5f, -0.5f, 0.0f,
-         0.5f, -0.5f, 0.0f,
-         0.5f,  0.5f, 0.0f,
-        -0.5f,  0.5f, 0.0f,
-        -0.5f, -0.5f, 1.0f,
-         0.5f, -0.5f, 1.0f,
-         0.5f,  0.5f, 1.0f,
-        -0.5f,  0.5f, 1.0f
-    };
-    unsigned int idx[] = {
-        0,1,2, 2,3,0,
-        4,5,6, 6,7,4,
-        0,1,5, 5,4,0,
-        1,2,6, 6,5,1,
-        2,3,7, 7,6,2,
-        3,0,4, 4,7,3
-    };
-    std::vector<float> vertices;
-    for (int i = 0; i < 36; ++i) {
-        int vi = idx[i];
-        vertices.push_back(v[vi*3+0]);
-        vertices.push_back(v[vi*3+1]);
-        vertices.push_back(v[vi*3+2]);
-    }
+bool PopulationBars::initializeShaders(float mapThickness_) {
+    mapThickness = mapThickness_;
+    return shaderProgram.id() || createShaders();
+}
 
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+glm::vec2 PopulationBars::mapPosition(float x, float y) const {
+    return glm::vec2((x / kImageWidth * mapWidth) - (mapWidth * 0.5f), (mapHeight * 0.5f) - (y / kImageHeight * mapHeight));
+}
 
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(float), vertices.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)0);
+static float scaledBarHeight(float density, float maxDensity, bool logScale) {
+    if (maxDensity <= 0.0f) maxDensity = 1.0f;
+    return logScale
+        ? (std::log(density + 1.0f) / std::log(maxDensity + 1.0f)) * kMaxBarHeight
+        : (density / maxDensity) * kMaxBarHeight;
+}
+
+float PopulationBars::barHeight(float density) const {
+    return scaledBarHeight(density, globalMaxDensity, logScale);
+}
 
-    // Instance data: model matrix (position, scale)
-    instanceMatrices.clear();
-    instanceHeights.clear();
+void PopulationBars::countUpload(size_t bytes) {
+    ++resourceStats.uploads;
+    resourceStats.bytes += bytes;
+}
 
-    if (bars.empty()) {
-        // Upload empty buffers to OpenGL
-        if (instanceVBO) { glDeleteBuffers(1, &instanceVBO); instanceVBO = 0; }
-        if (heightVBO) { glDeleteBuffers(1, &heightVBO); heightVBO = 0; }
+// One packed BarInstance per entity; the bar's own vertices are generated in the vertex shader
+// and its height comes from the density texture. The GL objects and vertex layouts are created on the first call;
+// a later dataset only re-specifies the instance, index and visibility stores.
+bool PopulationBars::createBarGeometry() {
+    // Ids share their word with the flags; more entities would alias in picking and visibility
+    if (entities.size() > kBarEntityMask) {
+        std::cerr << "Too many entities for the bar instance format: " << entities.size() << std::endl;
+        return false;
+    }
+    const bool firstCall = vao == 0;
+    if (firstCall) {
         glGenBuffers(1, &instanceVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-        glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STATIC_DRAW);
-        glGenBuffers(1, &heightVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, heightVBO);
-        glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STATIC_DRAW);
-        glBindVertexArray(0);
-        instanceMatrices.clear();
-        instanceHeights.clear();
-        return;
+        glGenBuffers(1, &cullIndexBuffer);
+        glGenBuffers(1, &visibilityBuffer);
+        countAllocation();
     }
 
-    float maxDensity = globalMaxDensity > 0.0f ? globalMaxDensity : 1.0f;
-    const float maxBarHeight = 1.5f;
-    const float IMAGE_WIDTH = 4592.0f;
-    const float IMAGE_HEIGHT = 3196.0f;
-    for (const auto& bar : bars) {
-        float px = (bar.x / IMAGE_WIDTH * mapWidth) - (mapWidth * 0.5f);
-        float py = (mapHeight * 0.5f) - (bar.y / IMAGE_HEIGHT * mapHeight);
-        float h = logScale
-            ? (std::log(bar.density + 1.0f) / std::log(maxDensity + 1.0f)) * maxBarHeight
-            : (bar.density / maxDensity) * maxBarHeight;
-        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(px, py, mapThickness/2.0f));
-        model = glm::scale(model, glm::vec3(0.08f, 0.08f, h));
-        instanceMatrices.push_back(model);
-        instanceHeights.push_back(h / maxBarHeight); // normalized height for color
-    }
-    glGenBuffers(1, &instanceVBO);
+    // Culled draws read the instances as one RGBA32UI texel each
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    cullInstancesFit = entities.size() <= (size_t)maxTexels;
+    if (!cullInstancesFit)
+        std::cerr << entities.size() << " entities exceed the GPU texture buffer limit of " << maxTexels
+                  << ", frustum culling is disabled" << std::endl;
+
+    instances.resize(entities.size());
+    for (uint32_t e = 0; e < entities.size(); ++e) {
+        float maxDensity = -1.0f;
+        for (int year = timeSeries.minYear(); year <= timeSeries.maxYear(); ++year) {
+            float density = timeSeries.density(year, e);
+            if (!PopulationTimeSeries::isMissing(density) && density > maxDensity) maxDensity = density;
+        }
+        instances[e].position = mapPosition(entities.x(e), entities.y(e));
+        instances[e].maxDensity = maxDensity < 0.0f ? 0.0f : maxDensity;
+        instances[e].entityFlags = e | (maxDensity < 0.0f ? kBarFlagNoData : 0u);
+    }
     glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-    glBufferData(GL_ARRAY_BUFFER, instanceMatrices.size()*sizeof(glm::mat4), instanceMatrices.data(), GL_STATIC_DRAW);
-    for (int i = 0; i < 4; ++i) {
-        glEnableVertexAttribArray(1 + i);
-        glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(float)*i*4));
-        glVertexAttribDivisor(1 + i, 1);
+    glBufferData(GL_ARRAY_BUFFER, instances.size()*sizeof(BarInstance), instances.data(), GL_STATIC_DRAW);
+    countUpload(instances.size() * sizeof(BarInstance));
+    glBindBuffer(GL_ARRAY_BUFFER, cullIndexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, std::max<size_t>(instances.size(), 1) * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    buildBarBounds();
+    culledEntities.reserve(instances.size());
+    cullDirty = true;
+    lodDirty = true;
+
+    // Hidden entities are masked in the vertex shader, so toggling them never touches the geometry
+    glBindBuffer(GL_TEXTURE_BUFFER, visibilityBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, visibleBits.size() * sizeof(uint32_t), visibleBits.data(), GL_DYNAMIC_DRAW);
+    countUpload(visibleBits.size() * sizeof(uint32_t));
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    if (!firstCall) return true;
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(BarInstance), (void*)offsetof(BarInstance, position));
+    glVertexAttribDivisor(1, 1);
+    // maxDensity (location 2) is only used for CPU-side bounds
+    glEnableVertexAttribArray(3);
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(BarInstance), (void*)offsetof(BarInstance, entityFlags));
+    glVertexAttribDivisor(3, 1);
+
+    // Culled draws read a list of entity ids (location 4, pointed at the list's ring region when
+    // drawn), the vertex shader fetches each one's BarInstance
+    glGenTextures(1, &instanceTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, instanceVBO);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glGenVertexArrays(1, &cullVao);
+    glBindVertexArray(cullVao);
+    glEnableVertexAttribArray(4);
+    glVertexAttribDivisor(4, 1);
+    cullStream.initialize(std::max<size_t>(instances.size(), 1) * sizeof(uint32_t));
+
+    // Raster bars: generated boxes, instanced from the streamed LOD selection (locations 1-3)
+    glGenVertexArrays(1, &rasterVao);
+    glBindVertexArray(rasterVao);
+    for (GLuint location = 1; location <= 3; ++location) {
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+    rasterStream.initialize(std::min<size_t>(lodBudget, 16384) * sizeof(LodBar));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenTextures(1, &visibilityTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, visibilityTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, visibilityBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    countAllocation();
+    applyBarShape();
+    return true;
+}
+
+int PopulationBars::barSides() const {
+    switch (barShape) {
+    case BarShape::Box: return 4;
+    case BarShape::HexagonalPrism: return 6;
+    case BarShape::Cylinder: return cylinderSegments;
+    default: return 0;
     }
+}
 
-    glGenBuffers(1, &heightVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, heightVBO);
-    glBufferData(GL_ARRAY_BUFFER, instanceHeights.size()*sizeof(float), instanceHeights.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(5);
-    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
-    glVertexAttribDivisor(5, 1);
+void PopulationBars::setBarShape(BarShape shape, int segments) {
+    barShape = shape;
+    cylinderSegments = std::clamp(segments, 3, 256);
+    // The indirect command carries the vertex count, the next GPU cull rewrites it
+    cullDirty = true;
+    invalidatePicks();
+    if (vao) applyBarShape();
+}
 
+// Generated shapes need no vertex attribute 0; the reference mesh reads it from meshVbo
+void PopulationBars::applyBarShape() {
+    const bool mesh = barShape == BarShape::ReferenceMesh;
+    if (mesh && !meshVbo) {
+        // 8 vertices, 12 triangles (36 indices)
+        float v[] = {
+            -0.5f, -0.5f, 0.0f,
+             0.5f, -0.5f, 0.0f,
+             0.5f,  0.5f, 0.0f,
+            -0.5f,  0.5f, 0.0f,
+            -0.5f, -0.5f, 1.0f,
+             0.5f, -0.5f, 1.0f,
+             0.5f,  0.5f, 1.0f,
+            -0.5f,  0.5f, 1.0f
+        };
+        unsigned int idx[] = {
+            0,1,2, 2,3,0,
+            4,5,6, 6,7,4,
+            0,1,5, 5,4,0,
+            1,2,6, 6,5,1,
+            2,3,7, 7,6,2,
+            3,0,4, 4,7,3
+        };
+        std::vector<float> vertices;
+        for (int i = 0; i < 36; ++i) {
+            int vi = idx[i];
+            vertices.push_back(v[vi*3+0]);
+            vertices.push_back(v[vi*3+1]);
+            vertices.push_back(v[vi*3+2]);
+        }
+        glGenBuffers(1, &meshVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, meshVbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(float), vertices.data(), GL_STATIC_DRAW);
+        countUpload(vertices.size() * sizeof(float));
+        countAllocation();
+    }
+    for (GLuint array : { vao, cullVao }) {
+        glBindVertexArray(array);
+        if (mesh) {
+            glBindBuffer(GL_ARRAY_BUFFER, meshVbo);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)0);
+        } else {
+            glDisableVertexAttribArray(0);
+        }
+    }
     glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-// Vertex Shader
-static const char* vertexShaderSrc = R"(
-#version 330 core
+StreamingStats PopulationBars::getStreamingStats() const {
+    StreamingStats total = cullStream.getStats();
+    total += rasterStream.getStats();
+    return total;
+}
+
+void PopulationBars::setPersistentStreaming(bool allowed) {
+    if (!cullStream.isInitialized()) return;
+    cullStream.initialize(cullStream.regionSize(), allowed);
+    rasterStream.initialize(rasterStream.regionSize(), allowed);
+    cullDirty = true;
+    lodDirty = true;
+}
+
+// Uploads the whole year x entity matrix once as an R32F texture buffer
+bool PopulationBars::uploadTimeSeries() {
+    if (densityBuffer) { glDeleteBuffers(1, &densityBuffer); densityBuffer = 0; }
+    if (densityTexture) { glDeleteTextures(1, &densityTexture); densityTexture = 0; }
+    size_t texels = (size_t)timeSeries.yearCount() * timeSeries.entityCount();
+    if (timeSeries.empty()) texels = 0;
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    if (texels > (size_t)maxTexels) {
+        std::cerr << "Density matrix has " << texels << " values, the GPU texture buffer limit is " << maxTexels << std::endl;
+        return false;
+    }
+    glGenBuffers(1, &densityBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, densityBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, texels * sizeof(float), texels ? timeSeries.data() : nullptr, GL_STATIC_DRAW);
+    countUpload(texels * sizeof(float));
+    countAllocation();
+    glGenTextures(1, &densityTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, densityTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, densityBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    return true;
+}
+
+// Shared head of the bar vertex shaders (after FrameUniforms::kGlsl): the unit bar (xy in [-0.5, 0.5], z 0 at the base and 1
+// at the top) from gl_VertexID. An n-sided prism is one strip: the sides b0 t0 b1 t1 .. b0 t0, a
+// repeated t0 (two degenerate triangles), then the top cap zigzag t(n-1) t1 t(n-2) t2 ..; the base
+// stands on the map and is left out. uSides = 0 reads the reference mesh from aPos instead.
+static const char* barShapeShaderSrc = R"(
 layout(location = 0) in vec3 aPos;
-layout(location = 1) in mat4 instanceModel;
-layout(location = 5) in float instanceHeight; // Assuming instanceHeight is normalized (0.0 to 1.0)
-uniform mat4 uViewProj;
+uniform int uSides;
+const vec2 kBoxCorners[4] = vec2[4](vec2(-0.5, -0.5), vec2(0.5, -0.5), vec2(0.5, 0.5), vec2(-0.5, 0.5));
+
+vec3 barVertex() {
+    if (uSides == 0) return aPos;
+    int n = uSides;
+    int v = gl_VertexID;
+    int k;
+    float z = 1.0;
+    if (v < 2 * n + 2) {
+        k = (v / 2) % n;
+        z = float(v & 1);
+    } else {
+        int c = v - 2 * n - 2;
+        k = c == 0 ? 0 : ((c & 1) == 1 ? n - (c + 1) / 2 : c / 2);
+    }
+    // Exact corners for boxes, so they match the reference mesh
+    if (n == 4) return vec3(kBoxCorners[k], z);
+    float a = 6.28318531 * float(k) / float(n);
+    return vec3(0.5 * cos(a), 0.5 * sin(a), z);
+}
+)";
+
+// Vertex Shader (after barShapeShaderSrc)
+static const char* vertexShaderSrc = R"(
+layout(location = 1) in vec2 aInstancePos; // Map-space centre of the bar
+layout(location = 3) in uint aInstanceEntityFlags; // Entity id (low 24 bits) and flags
+layout(location = 4) in uint aCulledEntity; // Culled draws: entity to fetch from uInstances
+uniform bool uCulled;
+uniform usamplerBuffer uInstances; // BarInstance per entity, for culled draws
+uniform samplerBuffer uDensities; // [year][entity] densities, NaN = no data
+uniform usamplerBuffer uVisibleBits; // One bit per entity
+uniform int uYearRows[4];         // Row offsets of years floor(t)-1 .. floor(t)+2, -1 outside the data
+uniform float uYearT;             // Fraction between floor(t) and floor(t)+1
+uniform int uInterpolation;       // 0 = step, 1 = linear, 2 = monotone cubic
+uniform float uMaxDensity;
+uniform bool uLogScale;
+uniform float uMaxBarHeight;
+uniform float uBarWidth;
+uniform float uBaseZ;
+const uint kEntityMask = 0x00FFFFFFu;
+const uint kFlagNoData = 0x80000000u;
 out float vZ; // Pass model-space Z-coordinate (0.0 at bottom, 1.0 at top of bar)
-out float vHeight; // Pass instanceHeight to fragment shader
+out float vHeight; // Normalized bar height (0.0 to 1.0) for the fragment shader
+flat out uint vEntityId; // Entity id + 1 for the picking pass
+
+int entity;
+vec2 instancePos;
+uint instanceEntityFlags;
+
+float fetchDensity(int slot, out bool present) {
+    int row = uYearRows[slot];
+    float d = row >= 0 ? texelFetch(uDensities, row + entity).r : 0.0;
+    present = row >= 0 && !isnan(d);
+    return d;
+}
+
+// Fritsch-Butland tangent: zero at local extrema, so the spline stays within the samples
+float monotoneTangent(float a, float b) {
+    return a * b > 0.0 ? 2.0 * a * b / (a + b) : 0.0;
+}
+
+// A bar exists while its floor(t) sample exists and holds that value if the next year is missing
+float yearDensity(out bool present) {
+    float y0 = fetchDensity(1, present);
+    bool p1;
+    if (!present || uInterpolation == 0 || uYearT <= 0.0) return y0;
+    float y1 = fetchDensity(2, p1);
+    if (!p1) return y0;
+    if (uInterpolation == 1) return mix(y0, y1, uYearT);
+    bool pPrev, pNext;
+    float yPrev = fetchDensity(0, pPrev);
+    float yNext = fetchDensity(3, pNext);
+    float d = y1 - y0;
+    float m0 = pPrev ? monotoneTangent(y0 - yPrev, d) : d;
+    float m1 = pNext ? monotoneTangent(d, yNext - y1) : d;
+    float t = uYearT, t2 = t * t, t3 = t2 * t;
+    return (2.0 * t3 - 3.0 * t2 + 1.0) * y0 + (t3 - 2.0 * t2 + t) * m0 + (3.0 * t2 - 2.0 * t3) * y1 + (t3 - t2) * m1;
+}
+
 void main() {
-    gl_Position = uViewProj * instanceModel * vec4(aPos, 1.0);
-    vZ = aPos.z; // Model-space Z-coordinate (0.0 at bottom, 1.0 at top of bar)
-    vHeight = instanceHeight; // Pass the height of the current bar instance
+    if (uCulled) {
+        uvec4 instance = texelFetch(uInstances, int(aCulledEntity));
+        instancePos = uintBitsToFloat(instance.xy);
+        instanceEntityFlags = instance.w;
+    } else {
+        instancePos = aInstancePos;
+        instanceEntityFlags = aInstanceEntityFlags;
+    }
+    entity = int(instanceEntityFlags & kEntityMask);
+    bool present = false;
+    float density = 0.0;
+    bool visible = ((texelFetch(uVisibleBits, entity >> 5).r >> uint(entity & 31)) & 1u) != 0u;
+    if (visible && (instanceEntityFlags & kFlagNoData) == 0u) density = yearDensity(present);
+    if (!present || !visible) {
+        // Outside the clip volume, the whole instance is discarded before rasterization
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        vZ = 0.0;
+        vHeight = 0.0;
+        vEntityId = 0u;
+        return;
+    }
+    float h = uLogScale
+        ? log(density + 1.0) / log(uMaxDensity + 1.0) * uMaxBarHeight
+        : density / uMaxDensity * uMaxBarHeight;
+    vec3 pos = barVertex();
+    vec3 worldPos = vec3(instancePos + pos.xy * uBarWidth, uBaseZ + pos.z * h);
+    gl_Position = uViewProj * vec4(worldPos, 1.0);
+    vZ = pos.z; // Model-space Z-coordinate (0.0 at bottom, 1.0 at top of bar)
+    vHeight = h / uMaxBarHeight; // Pass the height of the current bar instance
+    vEntityId = uint(entity) + 1u;
 }
 )";
 
@@ -206,129 +691,665 @@ void main() {
 }
 )";
 
+// Raster bars (after barShapeShaderSrc, always boxes): footprint and mean density per instance, no time series
+static const char* rasterVertexShaderSrc = R"(
+layout(location = 1) in vec2 aCenter;
+layout(location = 2) in vec2 aHalfSize;
+layout(location = 3) in float aDensity;
+uniform float uMaxDensity;
+uniform bool uLogScale;
+uniform float uMaxBarHeight;
+uniform float uBaseZ;
+uniform float uFootprint; // Fraction of the cells covered by the bar, leaves gaps between neighbours
+out float vZ;
+out float vHeight;
+void main() {
+    float h = uLogScale
+        ? log(aDensity + 1.0) / log(uMaxDensity + 1.0) * uMaxBarHeight
+        : aDensity / uMaxDensity * uMaxBarHeight;
+    vec3 pos = barVertex();
+    vec3 worldPos = vec3(aCenter + pos.xy * 2.0 * aHalfSize * uFootprint, uBaseZ + pos.z * h);
+    gl_Position = uViewProj * vec4(worldPos, 1.0);
+    vZ = pos.z;
+    vHeight = h / uMaxBarHeight;
+}
+)";
 
-static GLuint compileShader(GLenum type, const char* src) {
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &src, nullptr);
-    glCompileShader(shader);
-    int success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
-        std::cerr << "Shader compilation error: " << infoLog << std::endl;
-        return 0;
+// GL 4.3 culling: the CPU grid's per-bar test (timeline-peak box against the frustum planes) for
+// every entity in parallel, plus an optional screen-size cut
+static const char* cullComputeShaderSrc = R"(
+#version 430 core
+layout(local_size_x = 64) in;
+struct BarInstance {
+    vec2 position;
+    float maxDensity;
+    uint entityFlags;
+};
+layout(std430, binding = 0) readonly buffer Instances { BarInstance instances[]; };
+layout(std430, binding = 1) readonly buffer VisibleBits { uint visibleBits[]; };
+layout(std430, binding = 2) readonly buffer Densities { float densities[]; };
+layout(std430, binding = 3) writeonly buffer Survivors { uint survivors[]; };
+layout(binding = 0, offset = 4) uniform atomic_uint uSurvivorCount; // instanceCount of the indirect command
+uniform vec4 uPlanes[6];
+uniform mat4 uViewProj;
+uniform uint uEntityCount;
+uniform int uYearRow;
+uniform float uMaxDensity;
+uniform bool uLogScale;
+uniform float uMaxBarHeight;
+uniform float uBarWidth;
+uniform float uBaseZ;
+uniform float uViewportHeight;
+uniform float uMinPixels;
+const uint kEntityMask = 0x00FFFFFFu;
+const uint kFlagNoData = 0x80000000u;
+
+void main() {
+    uint e = gl_GlobalInvocationID.x;
+    if (e >= uEntityCount || uYearRow < 0) return;
+    BarInstance bar = instances[e];
+    if ((bar.entityFlags & kFlagNoData) != 0u || ((visibleBits[e >> 5] >> (e & 31u)) & 1u) == 0u) return;
+    if (isnan(densities[uYearRow + int(e)])) return;
+    float h = uLogScale
+        ? log(bar.maxDensity + 1.0) / log(uMaxDensity + 1.0) * uMaxBarHeight
+        : bar.maxDensity / uMaxDensity * uMaxBarHeight;
+    vec3 boxMin = vec3(bar.position - 0.5 * uBarWidth, uBaseZ);
+    vec3 boxMax = vec3(bar.position + 0.5 * uBarWidth, uBaseZ + h);
+    for (int i = 0; i < 6; ++i) {
+        vec4 p = uPlanes[i];
+        vec3 far = vec3(p.x > 0.0 ? boxMax.x : boxMin.x, p.y > 0.0 ? boxMax.y : boxMin.y, p.z > 0.0 ? boxMax.z : boxMin.z);
+        if (p.x * far.x + p.y * far.y + p.z * far.z + p.w < 0.0) return;
     }
-    return shader;
+    if (uMinPixels > 0.0) {
+        // Largest side over the view depth of the box centre, in pixels
+        vec4 clip = uViewProj * vec4(0.5 * (boxMin + boxMax), 1.0);
+        float pixelsPerUnit = 0.5 * uViewportHeight * length(vec3(uViewProj[0][1], uViewProj[1][1], uViewProj[2][1]));
+        if (max(uBarWidth, h) * pixelsPerUnit / max(clip.w, 1e-3) < uMinPixels) return;
+    }
+    survivors[atomicCounterIncrement(uSurvivorCount)] = e & kEntityMask;
+}
+)";
+
+// Picking pass: the same bars, written as ids (0 = nothing under the cursor)
+static const char* idFragmentShaderSrc = R"(
+#version 330 core
+flat in uint vEntityId;
+out uint FragId;
+void main() {
+    FragId = vEntityId;
+}
+)";
+
+// Map top face for the picking pass, so bars behind the map are not picked (after FrameUniforms::kGlsl)
+static const char* occluderVertexShaderSrc = R"(
+layout(location = 0) in vec3 aPos;
+void main() {
+    gl_Position = uViewProj * vec4(aPos, 1.0);
+}
+)";
+
+static const char* occluderFragmentShaderSrc = R"(
+#version 330 core
+out uint FragId;
+void main() {
+    FragId = 0u;
+}
+)";
+
+// Locations of a bar program, with the uniforms that never change set once
+void PopulationBars::resolveBarProgram(GLuint program, BarProgramUniforms& u) const {
+    const float baseZ = mapThickness / 2.0f;
+    FrameUniforms::attach(program);
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "uDensities"), 0);
+    glUniform1i(glGetUniformLocation(program, "uVisibleBits"), 1);
+    glUniform1i(glGetUniformLocation(program, "uInstances"), 2);
+    glUniform1f(glGetUniformLocation(program, "uMaxBarHeight"), kMaxBarHeight);
+    glUniform1f(glGetUniformLocation(program, "uBarWidth"), kBarWidth);
+    glUniform1f(glGetUniformLocation(program, "uBaseZ"), baseZ);
+    u = BarProgramUniforms();
+    u.culled = glGetUniformLocation(program, "uCulled");
+    u.yearRows = glGetUniformLocation(program, "uYearRows");
+    u.yearT = glGetUniformLocation(program, "uYearT");
+    u.interpolation = glGetUniformLocation(program, "uInterpolation");
+    u.maxDensity = glGetUniformLocation(program, "uMaxDensity");
+    u.logScale = glGetUniformLocation(program, "uLogScale");
+    u.sides = glGetUniformLocation(program, "uSides");
+    glUseProgram(0);
 }
 
 bool PopulationBars::createShaders() {
-    GLuint vs = compileShader(GL_VERTEX_SHADER, vertexShaderSrc);
-    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSrc);
-    if (!vs || !fs) return false;
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vs);
-    glAttachShader(shaderProgram, fs);
-    glLinkProgram(shaderProgram);
-    int success;
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
-        std::cerr << "Shader link error: " << infoLog << std::endl;
-        return false;
+    // Each part can be edited as a file under the shader directory, see ShaderManager
+    const ShaderPart framePart = { "frame_uniforms.glsl", FrameUniforms::kGlsl };
+    const ShaderPart barShapePart = { "bar_shape.glsl", barShapeShaderSrc };
+    const ShaderStage barVertex = { GL_VERTEX_SHADER, { framePart, barShapePart, { "bars.vert", vertexShaderSrc } } };
+    const ShaderPart barFragment = { "bars.frag", fragmentShaderSrc };
+    bool ok = shaderProgram.create("bars", { barVertex, { GL_FRAGMENT_SHADER, { barFragment } } },
+        [this](GLuint program) { resolveBarProgram(program, barUniforms); });
+    ok = ok && idProgram.create("bar_ids", { barVertex, { GL_FRAGMENT_SHADER, { { "bar_ids.frag", idFragmentShaderSrc } } } },
+        [this](GLuint program) { resolveBarProgram(program, idUniforms); });
+    ok = ok && occluderProgram.create("bar_occluder", {
+        { GL_VERTEX_SHADER, { framePart, { "bar_occluder.vert", occluderVertexShaderSrc } } },
+        { GL_FRAGMENT_SHADER, { { "bar_occluder.frag", occluderFragmentShaderSrc } } } },
+        [](GLuint program) { FrameUniforms::attach(program); });
+    ok = ok && rasterProgram.create("bar_raster", {
+        { GL_VERTEX_SHADER, { framePart, barShapePart, { "bar_raster.vert", rasterVertexShaderSrc } } },
+        { GL_FRAGMENT_SHADER, { barFragment } } },
+        [this](GLuint program) {
+            FrameUniforms::attach(program);
+            glUseProgram(program);
+            glUniform1f(glGetUniformLocation(program, "uMaxBarHeight"), kMaxBarHeight);
+            glUniform1f(glGetUniformLocation(program, "uBaseZ"), mapThickness / 2.0f);
+            glUniform1f(glGetUniformLocation(program, "uFootprint"), 0.8f);
+            glUniform1i(glGetUniformLocation(program, "uSides"), 4);
+            rasterMaxDensityLocation = glGetUniformLocation(program, "uMaxDensity");
+            rasterLogScaleLocation = glGetUniformLocation(program, "uLogScale");
+            glUseProgram(0);
+        });
+    return ok;
+}
+
+// Map top face (bars stand on it) and the id target. Without the target pickBar stays on the CPU.
+void PopulationBars::createPickTargets() {
+    if (!occluderVao) {
+        float z = mapThickness / 2.0f;
+        float corners[] = {
+            -mapWidth / 2, -mapHeight / 2, z,
+             mapWidth / 2, -mapHeight / 2, z,
+            -mapWidth / 2,  mapHeight / 2, z,
+             mapWidth / 2,  mapHeight / 2, z
+        };
+        glGenVertexArrays(1, &occluderVao);
+        glBindVertexArray(occluderVao);
+        glGenBuffers(1, &occluderVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, occluderVbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        countUpload(sizeof(corners));
+        countAllocation();
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glBindVertexArray(0);
     }
-    glDeleteShader(vs);
-    glDeleteShader(fs);
-    return true;
+    if (!gpuPicker.isInitialized() && gpuPicker.initialize()) countAllocation();
 }
 
 void PopulationBars::draw(const glm::mat4& viewProjMatrix, int hoveredBarIdx) const {
     if (!initialized) return;
-    if (bars.size() == 0) {
+    cullStream.endFrame();
+    rasterStream.endFrame();
+    if (densityRaster) {
+        drawRaster(viewProjMatrix);
         return;
     }
-    glUseProgram(shaderProgram);
-    glBindVertexArray(vao);
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "uViewProj"), 1, GL_FALSE, glm::value_ptr(viewProjMatrix));
-    glDrawArraysInstanced(GL_TRIANGLES, 0, 36, (GLsizei)bars.size());
+    if (!currentRow || bars.empty()) {
+        cullStats.visible = cullStats.culled = 0;
+        return;
+    }
+    if (!cullingEnabled || !cullInstancesFit) {
+        cullStats.visible = bars.size();
+        cullStats.culled = 0;
+        cullStats.cullMs = 0.0;
+        drawInstances(shaderProgram.id(), viewProjMatrix, BarSource::All);
+        return;
+    }
+    if (gpuCulling && cullComputeProgram.id()) {
+        cullOnGpu(viewProjMatrix);
+        drawInstances(shaderProgram.id(), viewProjMatrix, BarSource::GpuCulled);
+        return;
+    }
+    updateCulledInstances(viewProjMatrix);
+    if (!culledEntities.empty()) drawInstances(shaderProgram.id(), viewProjMatrix, BarSource::Culled);
+}
+
+// Culls the visible bars against the frustum on the grid and streams the surviving entity ids.
+// The list is reused while the camera and the visible set stay the same.
+void PopulationBars::updateCulledInstances(const glm::mat4& viewProjMatrix) const {
+    cullStats.gpu = false;
+    if (!cullDirty && viewProjMatrix == culledViewProj) {
+        cullStats.cullMs = 0.0;
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    culledEntities.clear();
+    cullGrid.cull(Frustum::fromViewProj(viewProjMatrix), [&](uint32_t e) { return barIndexOfEntity[e] >= 0; }, culledEntities);
+    // Next ring region; only waits if the GPU still draws from the list written three updates ago
+    cullStreamOffset = cullStream.write(culledEntities.data(), culledEntities.size() * sizeof(uint32_t));
+    culledViewProj = viewProjMatrix;
+    cullDirty = false;
+    cullStats.visible = culledEntities.size();
+    cullStats.culled = bars.size() - culledEntities.size();
+    cullStats.streamedBytes += culledEntities.size() * sizeof(uint32_t);
+    cullStats.cullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Same test as the CPU grid, one invocation per entity. Survivors are appended to cullIndexBuffer
+// and counted straight into the indirect command's instanceCount, nothing comes back to the CPU.
+void PopulationBars::cullOnGpu(const glm::mat4& viewProjMatrix) const {
+    cullStats.gpu = true;
+    cullStats.visible = cullStats.culled = 0;
+    cullStats.cullMs = 0.0;
+    if (!cullDirty && viewProjMatrix == culledViewProj) return;
+    // count = the shape's vertices, instanceCount = 0 for the atomic counter
+    const GLuint counts[2] = { (GLuint)barVertexCount(), 0 };
+    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, indirectBuffer);
+    glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(counts), counts);
+    glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, indirectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceVBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visibilityBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, densityBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cullIndexBuffer);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    Frustum frustum = Frustum::fromViewProj(viewProjMatrix);
+    glUseProgram(cullComputeProgram.id());
+    glUniform4fv(cullUniforms.planes, 6, glm::value_ptr(frustum.planes[0]));
+    glUniformMatrix4fv(cullUniforms.viewProj, 1, GL_FALSE, glm::value_ptr(viewProjMatrix));
+    glUniform1ui(cullUniforms.entityCount, timeSeries.entityCount());
+    glUniform1i(cullUniforms.yearRow, currentRow ? (GLint)(currentRow - timeSeries.data()) : -1);
+    glUniform1f(cullUniforms.maxDensity, globalMaxDensity > 0.0f ? globalMaxDensity : 1.0f);
+    glUniform1i(cullUniforms.logScale, logScale ? 1 : 0);
+    glUniform1f(cullUniforms.viewportHeight, (float)viewport[3]);
+    glUniform1f(cullUniforms.minPixels, gpuCullMinPixels);
+    glDispatchCompute((timeSeries.entityCount() + 63) / 64, 1, 1);
+    // The draw reads the survivors as vertex attributes and the count as its indirect command
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    for (GLuint binding = 0; binding < 4; ++binding) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+    glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, 0);
+    glUseProgram(0);
+    culledViewProj = viewProjMatrix;
+    cullDirty = false;
+}
+
+size_t PopulationBars::readGpuCulledCount() const {
+    if (!indirectBuffer) return 0;
+    GLuint count = 0;
+    glBindBuffer(GL_COPY_READ_BUFFER, indirectBuffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, sizeof(GLuint), sizeof(GLuint), &count);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return count;
+}
+
+void PopulationBars::createGpuCulling() {
+    if (cullComputeProgram.id() || !GLAD_GL_VERSION_4_3) return;
+    bool ok = cullComputeProgram.create("bar_cull", { { GL_COMPUTE_SHADER, { { "bar_cull.comp", cullComputeShaderSrc } } } },
+        [this](GLuint program) {
+            glUseProgram(program);
+            glUniform1f(glGetUniformLocation(program, "uMaxBarHeight"), kMaxBarHeight);
+            glUniform1f(glGetUniformLocation(program, "uBarWidth"), kBarWidth);
+            glUniform1f(glGetUniformLocation(program, "uBaseZ"), mapThickness / 2.0f);
+            glUseProgram(0);
+            cullUniforms.planes = glGetUniformLocation(program, "uPlanes");
+            cullUniforms.viewProj = glGetUniformLocation(program, "uViewProj");
+            cullUniforms.entityCount = glGetUniformLocation(program, "uEntityCount");
+            cullUniforms.yearRow = glGetUniformLocation(program, "uYearRow");
+            cullUniforms.maxDensity = glGetUniformLocation(program, "uMaxDensity");
+            cullUniforms.logScale = glGetUniformLocation(program, "uLogScale");
+            cullUniforms.viewportHeight = glGetUniformLocation(program, "uViewportHeight");
+            cullUniforms.minPixels = glGetUniformLocation(program, "uMinPixels");
+        });
+    if (!ok) return;
+    // count, instanceCount, first, baseInstance
+    const GLuint command[4] = { (GLuint)barVertexCount(), 0, 0, 0 };
+    glGenBuffers(1, &indirectBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(command), command, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    countUpload(sizeof(command));
+    countAllocation();
+}
+
+// Selects the raster's LOD bars for this camera and viewport (reused while neither changes) and
+// draws them. The instance buffer only grows, up to the bar budget.
+void PopulationBars::drawRaster(const glm::mat4& viewProjMatrix) const {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (lodDirty || viewProjMatrix != lodViewProj || (float)viewport[3] != lodViewportHeight) {
+        auto start = std::chrono::steady_clock::now();
+        const float maxDensity = densityRaster->maxDensity();
+        lodStats = densityRaster->select(viewProjMatrix, (float)viewport[3], lodPixelError, lodBudget,
+            [&](float density) { return scaledBarHeight(density, maxDensity, logScale); }, lodBars);
+        rasterStreamOffset = rasterStream.write(lodBars.data(), lodBars.size() * sizeof(LodBar));
+        lodStats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        lodViewProj = viewProjMatrix;
+        lodViewportHeight = (float)viewport[3];
+        lodDirty = false;
+    }
+    if (lodBars.empty()) return;
+    frameUniforms->setViewProj(viewProjMatrix);
+    glUseProgram(rasterProgram.id());
+    glBindVertexArray(rasterVao);
+    // The selection's ring region (the ring's buffer itself changes if a selection outgrew it)
+    glBindBuffer(GL_ARRAY_BUFFER, rasterStream.name());
+    const char* base = reinterpret_cast<const char*>(rasterStreamOffset);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(LodBar), base + offsetof(LodBar, center));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(LodBar), base + offsetof(LodBar, halfSize));
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(LodBar), base + offsetof(LodBar, density));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUniform1f(rasterMaxDensityLocation, std::max(densityRaster->maxDensity(), 1.0f));
+    glUniform1i(rasterLogScaleLocation, logScale ? 1 : 0);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 14, (GLsizei)lodBars.size());
+    rasterStream.fence();
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
+void PopulationBars::setDensityRaster(DensityQuadtree* raster) {
+    densityRaster = raster;
+    if (raster) raster->setExtent(glm::vec2(-0.5f * mapWidth, -0.5f * mapHeight), glm::vec2(0.5f * mapWidth, 0.5f * mapHeight), mapThickness / 2.0f);
+    lodDirty = true;
+    invalidatePicks();
+}
+
+void PopulationBars::setRasterLod(size_t budget, float pixelError) {
+    lodBudget = std::max<size_t>(budget, 4);
+    lodPixelError = pixelError;
+    lodDirty = true;
+}
+
+// One instance per entity (or per culled entity), with the bar shader or its picking variant
+void PopulationBars::drawInstances(GLuint program, const glm::mat4& viewProjMatrix, BarSource source) const {
+    const bool culled = source != BarSource::All;
+    frameUniforms->setViewProj(viewProjMatrix);
+    glUseProgram(program);
+    glBindVertexArray(culled ? cullVao : vao);
+    if (culled) {
+        // Ids from the compute shader's buffer or the CPU list's ring region
+        glBindBuffer(GL_ARRAY_BUFFER, source == BarSource::GpuCulled ? cullIndexBuffer : cullStream.name());
+        const size_t offset = source == BarSource::GpuCulled ? 0 : cullStreamOffset;
+        glVertexAttribIPointer(4, 1, GL_UNSIGNED_INT, sizeof(uint32_t), reinterpret_cast<const void*>(offset));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    // The instance buffer is only read by culled draws, it may stay bound for the others
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, visibilityTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, densityTexture);
+    BarProgramUniforms& u = program == idProgram.id() ? idUniforms : barUniforms;
+    GLint yearRows[4];
+    for (int i = 0; i < 4; ++i) {
+        const float* row = timeSeries.row(currentYear - 1 + i);
+        yearRows[i] = row ? (GLint)(row - timeSeries.data()) : -1;
+    }
+    const GLint culledValue = culled ? 1 : 0, logScaleValue = logScale ? 1 : 0;
+    const GLint interpolationValue = (GLint)interpolation, sides = barSides();
+    const float maxDensity = globalMaxDensity > 0.0f ? globalMaxDensity : 1.0f;
+    if (!u.sent || culledValue != u.lastCulled) glUniform1i(u.culled, u.lastCulled = culledValue);
+    if (!u.sent || !std::equal(yearRows, yearRows + 4, u.lastYearRows)) {
+        std::copy(yearRows, yearRows + 4, u.lastYearRows);
+        glUniform1iv(u.yearRows, 4, yearRows);
+    }
+    if (!u.sent || yearFraction != u.lastYearT) glUniform1f(u.yearT, u.lastYearT = yearFraction);
+    if (!u.sent || interpolationValue != u.lastInterpolation) glUniform1i(u.interpolation, u.lastInterpolation = interpolationValue);
+    if (!u.sent || maxDensity != u.lastMaxDensity) glUniform1f(u.maxDensity, u.lastMaxDensity = maxDensity);
+    if (!u.sent || logScaleValue != u.lastLogScale) glUniform1i(u.logScale, u.lastLogScale = logScaleValue);
+    if (!u.sent || sides != u.lastSides) glUniform1i(u.sides, u.lastSides = sides);
+    u.sent = true;
+    const GLenum mode = barSides() ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+    if (source == BarSource::GpuCulled) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glDrawArraysIndirect(mode, nullptr);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    } else {
+        GLsizei count = culled ? (GLsizei)culledEntities.size() : (GLsizei)timeSeries.entityCount();
+        glDrawArraysInstanced(mode, 0, barVertexCount(), count);
+        if (culled) cullStream.fence();
+    }
     glBindVertexArray(0);
     glUseProgram(0);
 }
 
-// Ray picking for bar selection
-int PopulationBars::pickBar(float mouseX, float mouseY, const glm::mat4& view, const glm::mat4& proj, int screenWidth, int screenHeight) const {
-    // Convert mouse to NDC
+// Ray picking for bar selection: nearest visible bar under the cursor
+int PopulationBars::pickBar(float mouseX, float mouseY, const glm::mat4& view, const glm::mat4& proj, int screenWidth, int screenHeight,
+                            uint64_t tag) const {
+    if (densityRaster) return -1;
+    if (pickMode == PickMode::Gpu && gpuPicker.isInitialized())
+        return pickBarGpu(mouseX, mouseY, view, proj, screenWidth, screenHeight, tag);
+    // Convert mouse to NDC and unproject onto the near and far planes
     float x = (2.0f * mouseX) / screenWidth - 1.0f;
     float y = 1.0f - (2.0f * mouseY) / screenHeight;
-    glm::vec4 rayClip(x, y, -1.0f, 1.0f);
-    glm::vec4 rayEye = glm::inverse(proj) * rayClip;
-    rayEye = glm::vec4(rayEye.x, rayEye.y, -1.0f, 0.0f);
-    glm::vec3 rayWorld = glm::normalize(glm::vec3(glm::inverse(view) * rayEye));
-    glm::vec3 rayOrigin = glm::vec3(glm::inverse(view)[3]);
-    // Test intersection with each bar's AABB
-    for (int i = 0; i < (int)instanceMatrices.size(); ++i) {
-        glm::mat4 model = instanceMatrices[i];
-        glm::vec3 min = glm::vec3(model * glm::vec4(-0.5f, -0.5f, 0.0f, 1.0f));
-        glm::vec3 max = glm::vec3(model * glm::vec4(0.5f, 0.5f, 1.0f, 1.0f));
-        // Ray-AABB intersection
-        glm::vec3 t1 = (min - rayOrigin) / rayWorld;
-        glm::vec3 t2 = (max - rayOrigin) / rayWorld;
-        glm::vec3 tmin = glm::min(t1, t2);
-        glm::vec3 tmax = glm::max(t1, t2);
-        float tNear = std::max(std::max(tmin.x, tmin.y), tmin.z);
-        float tFar = std::min(std::min(tmax.x, tmax.y), tmax.z);
-        if (tNear < tFar && tFar > 0) return i;
-    }
-    return -1;
-}
-
-std::string PopulationBars::getBarName(int idx) const {
-    if (idx < 0 || idx >= (int)bars.size()) return "";
-    return bars[idx].name;
+    glm::mat4 invViewProj = glm::inverse(proj * view);
+    glm::vec4 nearPoint = invViewProj * glm::vec4(x, y, -1.0f, 1.0f);
+    glm::vec4 farPoint = invViewProj * glm::vec4(x, y, 1.0f, 1.0f);
+    glm::vec3 rayOrigin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 rayWorld = glm::normalize(glm::vec3(farPoint) / farPoint.w - rayOrigin);
+    glm::vec3 invDir = 1.0f / rayWorld;
+    // Hexagons and cylinders are prisms inside the square footprint: a box hit is refined to the prism
+    const int sides = barSides();
+    const bool prism = sides != 4 && sides != 0;
+    auto prismEntry = [&](uint32_t e, float topZ, float maxT) {
+        return rayPrismEntry(rayOrigin, rayWorld, instances[e].position, 0.5f * kBarWidth, mapThickness / 2.0f, topZ, sides, maxT);
+    };
+    // Small sets are cheaper to test exhaustively with the SIMD kernel than to traverse
+    if (bars.size() <= kKernelPickLimit) {
+        refreshPickBoxes();
+        float best = std::numeric_limits<float>::infinity();
+        if (!prism) return (int)rayBoxKernel().nearest(pickBoxes, rayOrigin, invDir, best);
+        pickDistances.resize(bars.size());
+        rayBoxKernel().distances(pickBoxes, rayOrigin, invDir, pickDistances.data());
+        int nearest = -1;
+        for (size_t i = 0; i < bars.size(); ++i) {
+            if (pickDistances[i] >= best) continue;
+            float t = prismEntry(bars[i].entity, pickBoxes.maxZ[i], best);
+            if (t < best) {
+                best = t;
+                nearest = (int)i;
+            }
+        }
+        return nearest;
+    }
+    // The BVH bounds every bar by its tallest year, the exact shape is tested at the leaves
+    int64_t entity = pickBvh.closestHit(rayOrigin, rayWorld, [&](uint32_t e, float maxT) {
+        if (barIndexOfEntity[e] < 0) return std::numeric_limits<float>::infinity();
+        glm::vec2 center = instances[e].position;
+        glm::vec3 min = glm::vec3(center - 0.5f * kBarWidth, mapThickness / 2.0f);
+        glm::vec3 max = glm::vec3(center + 0.5f * kBarWidth, mapThickness / 2.0f + barHeight(interpolatedDensity(e)));
+        float t = rayBoxEntry(rayOrigin, invDir, min, max, maxT);
+        return prism && t < maxT ? prismEntry(e, max.z, maxT) : t;
+    });
+    return entity < 0 ? -1 : barIndexOfEntity[entity];
+}
+
+// Renders the map and the bars' ids for the pixel under the cursor, and answers with the id read
+// back from an earlier call. Bar count only affects the GPU's vertex work, never the CPU.
+int PopulationBars::pickBarGpu(float mouseX, float mouseY, const glm::mat4& view, const glm::mat4& proj, int screenWidth, int screenHeight,
+                               uint64_t tag) const {
+    glm::mat4 pickMatrix;
+    if (gpuPicker.begin(mouseX, mouseY, screenWidth, screenHeight, tag, pickMatrix)) {
+        glm::mat4 viewProj = pickMatrix * proj * view;
+        const glm::mat4 frameViewProj = frameUniforms->data().viewProj;
+        frameUniforms->setViewProj(viewProj);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        glEnable(GL_DEPTH_TEST);
+        glUseProgram(occluderProgram.id());
+        glBindVertexArray(occluderVao);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        if (initialized && currentRow && !bars.empty()) drawInstances(idProgram.id(), viewProj, BarSource::All);
+        glBindVertexArray(0);
+        glUseProgram(0);
+        if (!depthTest) glDisable(GL_DEPTH_TEST);
+        // The rest of the frame draws with the frame's camera again
+        frameUniforms->setViewProj(frameViewProj);
+        gpuPicker.end();
+    }
+    uint32_t id = gpuPicker.latestId();
+    // Ids are entities, so a readback stays valid when the visible bar list was rebuilt since
+    if (id == 0 || id - 1 >= barIndexOfEntity.size()) return -1;
+    return barIndexOfEntity[id - 1];
+}
+
+bool PopulationBars::isPickCurrent(uint64_t tag) const {
+    if (densityRaster || pickMode != PickMode::Gpu || !gpuPicker.isInitialized()) return true;
+    return gpuPicker.latestTag() == tag;
+}
+
+// Exact boxes of the visible bars at the current time, rebuilt lazily after heights change
+void PopulationBars::refreshPickBoxes() const {
+    if (!pickBoxesDirty) return;
+    pickBoxesDirty = false;
+    pickBoxes.resize(bars.size());
+    for (size_t i = 0; i < bars.size(); ++i) {
+        glm::vec2 center = instances[bars[i].entity].position;
+        pickBoxes.set(i, glm::vec3(center - 0.5f * kBarWidth, mapThickness / 2.0f),
+                      glm::vec3(center + 0.5f * kBarWidth, mapThickness / 2.0f + barHeight(interpolatedDensity(bars[i].entity))));
+    }
+}
+
+// Timeline-peak boxes of every entity, for picking (BVH) and culling (grid)
+void PopulationBars::buildBarBounds() {
+    std::vector<glm::vec2> centers(instances.size());
+    for (size_t e = 0; e < instances.size(); ++e) centers[e] = instances[e].position;
+    bvhTopZ.resize(instances.size());
+    for (size_t e = 0; e < instances.size(); ++e) bvhTopZ[e] = mapThickness / 2.0f + barHeight(instances[e].maxDensity);
+    pickBvh.build(centers, 0.5f * kBarWidth, mapThickness / 2.0f, bvhTopZ);
+    cullGrid.build(centers, 0.5f * kBarWidth, mapThickness / 2.0f, bvhTopZ);
+    countAllocation();
+}
+
+uint32_t PopulationBars::getBarEntity(int idx) const {
+    if (idx < 0 || idx >= (int)bars.size()) return EntityDictionary::kInvalidId;
+    return bars[idx].entity;
 }
 
 float PopulationBars::getBarDensity(int idx) const {
     if (idx < 0 || idx >= (int)bars.size()) return 0.0f;
-    return bars[idx].density;
+    return interpolatedDensity(bars[idx].entity);
+}
+
+bool PopulationBars::isBarInterpolated(int idx) const {
+    if (idx < 0 || idx >= (int)bars.size()) return false;
+    if (interpolation == YearInterpolation::Step || yearFraction <= 0.0f) return false;
+    return !PopulationTimeSeries::isMissing(timeSeries.density(currentYear + 1, bars[idx].entity));
+}
+
+// Monotone tangent, see the vertex shader
+static float monotoneTangent(float a, float b) {
+    return a * b > 0.0f ? 2.0f * a * b / (a + b) : 0.0f;
+}
+
+// CPU copy of the vertex shader's yearDensity, for picking and tooltips
+float PopulationBars::interpolatedDensity(uint32_t entity) const {
+    float y0 = timeSeries.density(currentYear, entity);
+    if (PopulationTimeSeries::isMissing(y0) || interpolation == YearInterpolation::Step || yearFraction <= 0.0f) return y0;
+    float y1 = timeSeries.density(currentYear + 1, entity);
+    if (PopulationTimeSeries::isMissing(y1)) return y0;
+    float t = yearFraction;
+    if (interpolation == YearInterpolation::Linear) return y0 + (y1 - y0) * t;
+    float yPrev = timeSeries.density(currentYear - 1, entity);
+    float yNext = timeSeries.density(currentYear + 2, entity);
+    float d = y1 - y0;
+    float m0 = PopulationTimeSeries::isMissing(yPrev) ? d : monotoneTangent(y0 - yPrev, d);
+    float m1 = PopulationTimeSeries::isMissing(yNext) ? d : monotoneTangent(d, yNext - y1);
+    float t2 = t * t, t3 = t2 * t;
+    return (2.0f * t3 - 3.0f * t2 + 1.0f) * y0 + (t3 - 2.0f * t2 + t) * m0 + (3.0f * t2 - 2.0f * t3) * y1 + (t3 - t2) * m1;
 }
 
 glm::vec2 PopulationBars::getBarScreenPos(int idx, const glm::mat4& viewProj, int screenWidth, int screenHeight) const {
-    if (idx < 0 || idx >= (int)instanceMatrices.size()) return glm::vec2(0,0);
-    glm::vec4 pos = viewProj * instanceMatrices[idx] * glm::vec4(0,0,1,1);
+    if (idx < 0 || idx >= (int)bars.size()) return glm::vec2(0,0);
+    glm::vec2 center = instances[bars[idx].entity].position;
+    glm::vec4 pos = viewProj * glm::vec4(center, mapThickness / 2.0f + barHeight(interpolatedDensity(bars[idx].entity)), 1.0f);
     pos /= pos.w;
     float x = (pos.x * 0.5f + 0.5f) * screenWidth;
     float y = (1.0f - (pos.y * 0.5f + 0.5f)) * screenHeight;
     return glm::vec2(x, y);
 }
 
+// Scale mode and year only change draw() uniforms, the GPU data stays as uploaded
 void PopulationBars::setLogScale(bool logScale_) {
-    if (logScale != logScale_) {
-        logScale = logScale_;
-        createBarGeometry();
-    }
+    if (logScale == logScale_) return;
+    logScale = logScale_;
+    invalidatePicks();
+    lodDirty = true;
+    // Height bounds change with the scale, the BVH and grid layouts do not
+    if (pickBvh.empty()) return;
+    for (size_t e = 0; e < instances.size(); ++e) bvhTopZ[e] = mapThickness / 2.0f + barHeight(instances[e].maxDensity);
+    pickBvh.refit(bvhTopZ);
+    cullGrid.refit(bvhTopZ);
+    cullDirty = true;
 }
 
 void PopulationBars::setYear(int year) {
+    yearFraction = 0.0f;
+    applyYear(year);
+}
+
+void PopulationBars::setTime(float time) {
+    int year = (int)std::floor(time);
+    yearFraction = time - (float)year;
+    invalidatePicks();
+    // The visible set only changes at whole years
+    if (year != currentYear || !currentRow) applyYear(year);
+}
+
+void PopulationBars::applyYear(int year) {
     currentYear = year;
-    auto it = yearToBars.find(year);
-    if (it != yearToBars.end()) {
-        bars = it->second;
-        allBarsForYear = it->second;
-    } else {
-        bars.clear();
-        allBarsForYear.clear();
+    const float* previousRow = currentRow;
+    currentRow = timeSeries.row(year);
+    if (!initialized) return;
+    if (previousRow && currentRow && refreshBarDensities()) return;
+    rebuildVisibleBars();
+}
+
+// Keeps the visible bar list across a year change when the new year has data for exactly the
+// listed entities, only their densities move. Returns false, list untouched, when the set changed.
+bool PopulationBars::refreshBarDensities() {
+    size_t present = 0;
+    for (uint32_t e = 0; e < timeSeries.entityCount(); ++e) {
+        if (PopulationTimeSeries::isMissing(currentRow[e]) || !isEntityVisible(e)) continue;
+        if (barIndexOfEntity[e] < 0) return false;
+        ++present;
+    }
+    if (present != bars.size()) return false;
+    for (auto& bar : bars) bar.density = currentRow[bar.entity];
+    invalidatePicks();
+    // The CPU grid culls on timeline-peak boxes and keeps its list; compute culling reads the year row
+    if (gpuCulling) cullDirty = true;
+    return true;
+}
+
+void PopulationBars::setEntityVisible(uint32_t entity, bool visible) {
+    if (entity >= entities.size() || isEntityVisible(entity) == visible) return;
+    visibleBits[entity >> 5] ^= 1u << (entity & 31);
+    visibilityDirty = true;
+}
+
+void PopulationBars::setAllEntitiesVisible(bool visible) {
+    size_t words = (entities.size() + 31) / 32;
+    if (visibleBits.size() != words) {
+        visibleBits.assign(words, 0u);
+        countAllocation();
     }
-    if (initialized) createBarGeometry();
+    std::fill(visibleBits.begin(), visibleBits.end(), visible ? ~0u : 0u);
+    // Keep the bits past the last entity clear
+    if (visible && (entities.size() & 31)) visibleBits.back() = (1u << (entities.size() & 31)) - 1u;
+    visibilityDirty = true;
 }
 
-void PopulationBars::updateVisibleBars(const std::unordered_map<std::string, bool>& visibility) {
+void PopulationBars::flushVisibility() {
+    if (!visibilityDirty) return;
+    visibilityDirty = false;
+    if (!initialized) return;
+    glBindBuffer(GL_TEXTURE_BUFFER, visibilityBuffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, visibleBits.size() * sizeof(uint32_t), visibleBits.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    countUpload(visibleBits.size() * sizeof(uint32_t));
+    rebuildVisibleBars();
+}
+
+void PopulationBars::rebuildVisibleBars() {
+    invalidatePicks();
+    cullDirty = true;
+    for (const auto& bar : bars) barIndexOfEntity[bar.entity] = -1;
     bars.clear();
-    for (const auto& bar : allBarsForYear) {
-        auto it = visibility.find(bar.name);
-        if (it == visibility.end() || it->second) {
-            bars.push_back(bar);
-        }
+    if (!currentRow) return;
+    size_t capacity = bars.capacity();
+    for (uint32_t e = 0; e < timeSeries.entityCount(); ++e) {
+        float density = currentRow[e];
+        if (PopulationTimeSeries::isMissing(density) || !isEntityVisible(e)) continue;
+        barIndexOfEntity[e] = (int32_t)bars.size();
+        bars.push_back({ e, density });
     }
-    if (initialized) createBarGeometry();
-} 
\ No newline at end of file
+    if (bars.capacity() != capacity) countAllocation();
+}
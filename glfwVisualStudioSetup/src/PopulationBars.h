@@ -3,45 +3,307 @@
 #include <vector>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
-#include <unordered_map>
+#include <cstdint>
+#include "EntityDictionary.h"
+#include "PopulationTimeSeries.h"
+#include "BarBvh.h"
+#include "BarCullGrid.h"
+#include "DensityQuadtree.h"
+#include "GpuPicker.h"
+#include "StreamingBuffer.h"
+#include "FrameUniforms.h"
+#include "ShaderManager.h"
 
+// One visible bar of the current year. Its position is in the entity's BarInstance.
 struct PopulationBarData {
-    std::string name;
+    uint32_t entity; // id in PopulationBars::getEntities()
     float density;
-    float x, y; // image-relative coordinates
+};
+
+// Packed per-instance vertex data (16 bytes). The vertex shader builds the bar transform from
+// it, the year's height comes from the density texture.
+struct BarInstance {
+    glm::vec2 position;   // Map-space centre of the bar
+    float maxDensity;     // Peak density over all years, bounds the bar's height for culling and picking
+    uint32_t entityFlags; // Entity id in the low 24 bits, kBarFlag* in the high bits
+};
+static_assert(sizeof(BarInstance) == 16, "BarInstance must stay 16 bytes");
+constexpr uint32_t kBarEntityMask = 0x00FFFFFFu;
+constexpr uint32_t kBarFlagNoData = 1u << 31; // Entity has no sample in any year
+
+// Timing of the most recent dataset load
+struct DatasetLoadStats {
+    size_t rows = 0;
+    size_t bytes = 0;
+    unsigned threads = 1;
+    bool fromCache = false;
+    double seconds = 0.0;
+    double rowsPerSecond() const { return seconds > 0.0 ? rows / seconds : 0.0; }
+};
+
+// How bar heights are blended between the two years around a fractional time
+enum class YearInterpolation {
+    Step,         // hold the earlier year
+    Linear,
+    MonotoneCubic // Hermite spline through the neighbouring years, never overshoots the samples
+};
+
+// How pickBar finds the bar under the cursor
+enum class PickMode {
+    Cpu, // Ray cast against the bar boxes, answers immediately
+    Gpu  // Id buffer read back asynchronously: one or two calls late, but occluded by the map and other bars exactly
+};
+
+// Cross-section of the bars. All but ReferenceMesh are generated in the vertex shader from
+// gl_VertexID as one triangle strip without the base face, with no vertex buffer.
+enum class BarShape {
+    Box,            // 14 vertices
+    HexagonalPrism, // 20 vertices
+    Cylinder,       // 3 * segments + 2 vertices
+    ReferenceMesh   // The original 36-vertex cube in a vertex buffer, kept to compare against
+};
+
+// Bar-related GPU uploads and buffer (re)allocations since startup. Steady-state frames,
+// year and scale switches must not add to them.
+struct BarResourceStats {
+    uint64_t uploads = 0;
+    uint64_t bytes = 0;
+    uint64_t allocations = 0; // GL buffers/textures created plus growth of CPU-side bar arrays
+};
+
+// Frustum culling of the most recent draw(). Streamed index bytes are not part of BarResourceStats.
+struct BarCullStats {
+    size_t visible = 0;         // Bars drawn
+    size_t culled = 0;          // Bars with data outside the frustum
+    double cullMs = 0.0;        // CPU time of the culling stage, 0 when the previous list was reused
+    uint64_t streamedBytes = 0; // Index bytes streamed since startup
+    bool gpu = false;           // Culled by the compute shader, counts are only known on the GPU
 };
 
 class PopulationBars {
 public:
+    // Memory-mapped loader that tokenizes the file in place. Uses the binary .pdc cache next to
+    // the CSV when it is up to date, and writes it after parsing otherwise.
     bool loadFromCSV(const std::string& path);
+    // Original ifstream/stringstream loader, kept as a reference for benchmarks
+    bool loadFromCSVStream(const std::string& path);
+    const DatasetLoadStats& getLastLoadStats() const { return lastLoadStats; }
+    // Worker threads used by loadFromCSV for large files (0 = one per hardware thread, 1 = serial)
+    void setLoaderThreads(int threads) { loaderThreads = threads; }
+    void setUseDatasetCache(bool use) { useDatasetCache = use; }
     bool initialize(float mapWidth, float mapHeight, float mapThickness);
+    // Compiles the shaders ahead of initialize(), e.g. while the dataset is still being parsed
+    bool initializeShaders(float mapThickness);
     void draw(const glm::mat4& viewProjMatrix, int hoveredBarIdx = -1) const;
-    int pickBar(float mouseX, float mouseY, const glm::mat4& view, const glm::mat4& proj, int screenWidth, int screenHeight) const;
-    std::string getBarName(int idx) const;
+    // GPU picks answer an earlier call; tag identifies this request so isPickCurrent can tell when
+    // the answer for it has arrived
+    int pickBar(float mouseX, float mouseY, const glm::mat4& view, const glm::mat4& proj, int screenWidth, int screenHeight,
+                uint64_t tag = 0) const;
+    // Whether the last pickBar answered the request tagged tag (always true for CPU picks)
+    bool isPickCurrent(uint64_t tag) const;
+    // Gpu falls back to Cpu when the picking framebuffer could not be created
+    void setPickMode(PickMode mode) {
+        pickMode = mode;
+        invalidatePicks();
+    }
+    PickMode getPickMode() const { return pickMode; }
+    bool isGpuPickingAvailable() const { return gpuPicker.isInitialized(); }
+    // Camera block shared with the other scene renderers. draw() and picking write their matrix into
+    // it (nothing is uploaded when the frame already holds it); without one the bars use their own.
+    void setFrameUniforms(FrameUniforms* frame) { frameUniforms = frame ? frame : &ownFrameUniforms; }
+    // Shapes stay inside the bar's square footprint, so the culling and picking bounds still hold;
+    // CPU picking then tests the prism itself
+    void setBarShape(BarShape shape, int cylinderSegments = 16);
+    BarShape getBarShape() const { return barShape; }
+    int getBarVertexCount() const { return barVertexCount(); }
+    // Frustum culling in draw(): only bars whose timeline-peak box is in view are drawn
+    void setCulling(bool enabled) { cullingEnabled = enabled; }
+    bool getCulling() const { return cullingEnabled; }
+    // False when the dataset has more entities than the GL's texture buffer limit; draw() then
+    // draws every bar unculled
+    bool isCullingAvailable() const { return cullInstancesFit; }
+    const BarCullStats& getCullStats() const { return cullStats; }
+    // GL 4.3 compute culling with an indirect draw instead of the CPU grid (when the context has 4.3)
+    void setGpuCulling(bool enabled) {
+        gpuCulling = enabled;
+        cullDirty = true;
+    }
+    bool getGpuCulling() const { return gpuCulling; }
+    bool isGpuCullingAvailable() const { return cullComputeProgram.id() != 0; }
+    // GPU culling also drops bars whose footprint is below this many pixels (0 = frustum only)
+    void setGpuCullMinPixels(float pixels) {
+        gpuCullMinPixels = pixels;
+        cullDirty = true;
+    }
+    // Instances drawn by the last GPU cull. Reads the indirect command back, so it waits for the GPU.
+    size_t readGpuCulledCount() const;
+    // Culled id lists and raster LOD bars go through fenced ring buffers; frame fields cover the previous draw()
+    StreamingStats getStreamingStats() const;
+    bool isStreamingPersistent() const { return cullStream.isPersistent(); }
+    // Persistent mapping is used where the context allows it; false forces unsynchronized glMapBufferRange
+    void setPersistentStreaming(bool allowed);
+    // Gridded density raster drawn instead of the entity bars, nullptr switches back. Not owned;
+    // its extent is set to the map. Picking and tooltips only cover entity bars.
+    void setDensityRaster(DensityQuadtree* raster);
+    // At most budget raster bars per frame, refined until each spans at most pixelError pixels
+    void setRasterLod(size_t budget, float pixelError);
+    const LodSelectStats& getRasterLodStats() const { return lodStats; }
+    // Changes whenever a pick with the same cursor and camera may answer differently
+    // (heights, visibility, year, scale or pick mode changed)
+    uint64_t getPickGeneration() const { return pickGeneration; }
+    // Entity id of a bar (EntityDictionary::kInvalidId when out of range)
+    uint32_t getBarEntity(int idx) const;
+    const EntityDictionary& getEntities() const { return entities; }
+    // Density at the current (possibly fractional) time
     float getBarDensity(int idx) const;
+    // True when getBarDensity is blended between two years rather than a dataset value
+    bool isBarInterpolated(int idx) const;
     glm::vec2 getBarScreenPos(int idx, const glm::mat4& viewProj, int screenWidth, int screenHeight) const;
     int getBarCount() const { return (int)bars.size(); }
     void setLogScale(bool logScale);
     bool getLogScale() const { return logScale; }
     void setYear(int year);
+    // Continuous time in years, e.g. 1950.25 blends a quarter of the way from 1950 to 1951.
+    // Like setYear this only changes draw() uniforms.
+    void setTime(float time);
+    float getTime() const { return currentYear + yearFraction; }
+    void setInterpolation(YearInterpolation mode) {
+        interpolation = mode;
+        invalidatePicks();
+    }
+    YearInterpolation getInterpolation() const { return interpolation; }
     int getCurrentYear() const { return currentYear; }
     int minYear = 1900;
     int maxYear = 2100;
     std::pair<int, int> getYearRange() const { return {minYear, maxYear}; }
-    std::unordered_map<int, std::vector<PopulationBarData>> yearToBars;
+    float getGlobalMaxDensity() const { return globalMaxDensity; }
+    // Heap used by the density matrix and the entity dictionary
+    size_t getDatasetMemoryBytes() const;
+    const PopulationTimeSeries& getTimeSeries() const { return timeSeries; }
+    // Densities of every entity for the current year (NaN = no data), nullptr outside the data range
+    const float* getYearDensities() const { return currentRow; }
     int currentYear = 2025;
-    std::vector<PopulationBarData> allBarsForYear; // All bars for the current year (public)
-    void updateVisibleBars(const std::unordered_map<std::string, bool>& visibility);
+    // Entity visibility, one bit per entity id. Changes are batched until flushVisibility().
+    void setEntityVisible(uint32_t entity, bool visible);
+    void setAllEntitiesVisible(bool visible);
+    bool isEntityVisible(uint32_t entity) const {
+        return entity >= entities.size() || (visibleBits[entity >> 5] >> (entity & 31)) & 1u;
+    }
+    // Uploads the mask and refreshes the pickable bars if visibility changed, otherwise does nothing
+    void flushVisibility();
+    const BarResourceStats& getResourceStats() const { return resourceStats; }
 private:
-    std::vector<PopulationBarData> bars; // Only one bars vector, used everywhere
-    std::vector<glm::mat4> instanceMatrices;
-    std::vector<float> instanceHeights;
-    GLuint vao = 0, vbo = 0, instanceVBO = 0, heightVBO = 0;
-    GLuint shaderProgram = 0;
+    EntityDictionary entities;
+    PopulationTimeSeries timeSeries;
+    const float* currentRow = nullptr;
+    float yearFraction = 0.0f;
+    YearInterpolation interpolation = YearInterpolation::MonotoneCubic;
+    std::vector<uint32_t> visibleBits;
+    bool visibilityDirty = false;
+    std::vector<PopulationBarData> bars; // Visible bars of the current year, for picking and tooltips
+    std::vector<BarInstance> instances;  // CPU copy of the instance buffer, indexed by entity id
+    std::vector<int32_t> barIndexOfEntity; // Index into bars, -1 when the entity has no visible bar
+    BarBvh pickBvh;
+    mutable BoxSoA pickBoxes; // Exact boxes of the visible bars for small-set picking
+    mutable std::vector<float> pickDistances; // Box entry distances, refined for prism shapes
+    mutable bool pickBoxesDirty = true;
+    uint64_t pickGeneration = 0;
+    std::vector<float> bvhTopZ; // Per-entity height bounds fed to the BVH and the cull grid
+    BarCullGrid cullGrid;
+    mutable std::vector<uint32_t> culledEntities; // Visible entities in the frustum, streamed through cullStream
+    mutable glm::mat4 culledViewProj = glm::mat4(0.0f);
+    mutable bool cullDirty = true;
+    mutable BarCullStats cullStats;
+    bool cullingEnabled = true;
+    bool cullInstancesFit = true; // Culled draws fetch BarInstances from a texture buffer, bounded by the GL
+    bool gpuCulling = false;
+    float gpuCullMinPixels = 0.0f;
+    DensityQuadtree* densityRaster = nullptr;
+    mutable std::vector<LodBar> lodBars; // Current selection, streamed through rasterStream
+    mutable LodSelectStats lodStats;
+    mutable glm::mat4 lodViewProj = glm::mat4(0.0f);
+    mutable float lodViewportHeight = 0.0f;
+    mutable bool lodDirty = true;
+    size_t lodBudget = 200000;
+    float lodPixelError = 6.0f;
+    BarShape barShape = BarShape::Box;
+    int cylinderSegments = 16;
+    GLuint vao = 0, instanceVBO = 0;
+    GLuint meshVbo = 0; // ReferenceMesh only, created when first selected
+    GLuint instanceTexture = 0; // instanceVBO as an RGBA32UI texture buffer, read through the culled index list
+    GLuint cullVao = 0;
+    GLuint cullIndexBuffer = 0; // Survivors of the compute cull, written on the GPU
+    mutable StreamingBuffer cullStream, rasterStream;
+    mutable size_t cullStreamOffset = 0, rasterStreamOffset = 0; // Regions holding the current lists
+    GLuint rasterVao = 0;
+    GLuint densityBuffer = 0, densityTexture = 0; // Whole time series as a texture buffer
+    GLuint visibilityBuffer = 0, visibilityTexture = 0; // visibleBits as an R32UI texture buffer
+    ShaderProgram shaderProgram;
+    ShaderProgram idProgram;       // Bar shader writing entity id + 1 into an integer target
+    ShaderProgram occluderProgram; // Map top face for the id pass, writes id 0
+    ShaderProgram rasterProgram;   // LodBar instances of the density raster
+    // Per-draw uniforms of a bar program: locations resolved at link time and the values last sent,
+    // so a draw only sends what changed since the previous one
+    struct BarProgramUniforms {
+        GLint culled = -1, yearRows = -1, yearT = -1, interpolation = -1, maxDensity = -1, logScale = -1, sides = -1;
+        bool sent = false;
+        GLint lastCulled = 0, lastYearRows[4] = {}, lastInterpolation = 0, lastLogScale = 0, lastSides = 0;
+        float lastYearT = 0.0f, lastMaxDensity = 0.0f;
+    };
+    mutable BarProgramUniforms barUniforms, idUniforms;
+    GLint rasterMaxDensityLocation = -1, rasterLogScaleLocation = -1;
+    struct CullUniforms {
+        GLint planes = -1, viewProj = -1, entityCount = -1, yearRow = -1, maxDensity = -1, logScale = -1;
+        GLint viewportHeight = -1, minPixels = -1;
+    };
+    CullUniforms cullUniforms;
+    FrameUniforms ownFrameUniforms;
+    FrameUniforms* frameUniforms = &ownFrameUniforms;
+    ShaderProgram cullComputeProgram; // GL 4.3 only: frustum culls entities into cullIndexBuffer
+    GLuint indirectBuffer = 0;     // DrawArraysIndirectCommand, instanceCount is the compute shader's atomic counter
+    GLuint occluderVao = 0, occluderVbo = 0;
+    mutable GpuPicker gpuPicker;
+    PickMode pickMode = PickMode::Cpu;
+    BarResourceStats resourceStats;
     bool initialized = false;
     float mapWidth = 1.0f, mapHeight = 1.0f, mapThickness = 0.01f;
     bool logScale = true;
     float globalMaxDensity = 0.0f;
-    void createBarGeometry();
+    DatasetLoadStats lastLoadStats;
+    int loaderThreads = 0;
+    bool useDatasetCache = true;
+    bool createBarGeometry(); // False if the entity ids do not fit the instance format
+    void applyBarShape();
+    void resolveBarProgram(GLuint program, BarProgramUniforms& u) const;
+    int barSides() const; // Sides of the generated prism, 0 for the reference mesh
+    int barVertexCount() const { return barSides() ? 3 * barSides() + 2 : 36; }
+    bool uploadTimeSeries();
     bool createShaders();
+    void createPickTargets();
+    // Instances of a bar draw: every entity, the CPU-culled list or the compute shader's indirect draw
+    enum class BarSource { All, Culled, GpuCulled };
+    void drawInstances(GLuint program, const glm::mat4& viewProjMatrix, BarSource source) const;
+    void updateCulledInstances(const glm::mat4& viewProjMatrix) const;
+    void cullOnGpu(const glm::mat4& viewProjMatrix) const;
+    void createGpuCulling();
+    void drawRaster(const glm::mat4& viewProjMatrix) const;
+    int pickBarGpu(float mouseX, float mouseY, const glm::mat4& view, const glm::mat4& proj, int screenWidth, int screenHeight,
+                   uint64_t tag) const;
+    void countUpload(size_t bytes);
+    void countAllocation() { ++resourceStats.allocations; }
+    glm::vec2 mapPosition(float x, float y) const;
+    float barHeight(float density) const;
+    float interpolatedDensity(uint32_t entity) const;
+    void applyYear(int year);
+    bool refreshBarDensities();
+    bool onDatasetLoaded();
+    void rebuildVisibleBars();
+    void buildBarBounds();
+    void refreshPickBoxes() const;
+    void invalidatePicks() {
+        pickBoxesDirty = true;
+        ++pickGeneration;
+    }
+    bool loadFromDatasetCache(const std::string& csvPath);
+    bool writeDatasetCache(const std::string& csvPath) const;
 }; 
\ No newline at end of file
@@ -0,0 +1,27 @@
+#include "PopulationTimeSeries.h"
+#include <limits>
+#include <utility>
+
+float PopulationTimeSeries::missing() {
+    return std::numeric_limits<float>::quiet_NaN();
+}
+
+void PopulationTimeSeries::reset(int minYear, int maxYear, uint32_t entityCount) {
+    firstYear = minYear;
+    lastYear = maxYear;
+    entities = entityCount;
+    size_t years = maxYear >= minYear ? (size_t)((int64_t)maxYear - minYear + 1) : 0;
+    viewed = nullptr;
+    viewOwner.reset();
+    values.assign(years * entityCount, missing());
+}
+
+void PopulationTimeSeries::view(int minYear, int maxYear, uint32_t entityCount, const float* data, std::shared_ptr<const void> owner) {
+    firstYear = minYear;
+    lastYear = maxYear;
+    entities = entityCount;
+    values.clear();
+    values.shrink_to_fit();
+    viewed = data;
+    viewOwner = std::move(owner);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+
+// Dense year x entity density table. Row r holds the density of every entity for year
+// minYear + r, stored contiguously, so a year lookup is a single pointer offset.
+// Missing samples are NaN. The table is either owned, or a read-only view of memory kept alive
+// by an owner (the mapped dataset cache).
+class PopulationTimeSeries {
+public:
+    // Resizes to the given year range and entity count, every sample missing
+    void reset(int minYear, int maxYear, uint32_t entityCount);
+    void clear() { reset(0, -1, 0); }
+    // Uses the table at data in place; owner is held for as long as the table is used
+    void view(int minYear, int maxYear, uint32_t entityCount, const float* data, std::shared_ptr<const void> owner);
+
+    // Owned tables only
+    void set(int year, uint32_t entity, float density) {
+        values[(size_t)(year - firstYear) * entities + entity] = density;
+    }
+
+    // Densities of all entities for year, or nullptr when the year is out of range
+    const float* row(int year) const {
+        if (year < firstYear || year > lastYear) return nullptr;
+        return data() + (size_t)(year - firstYear) * entities;
+    }
+
+    float density(int year, uint32_t entity) const {
+        const float* r = row(year);
+        return r && entity < entities ? r[entity] : missing();
+    }
+
+    static float missing();
+    static bool isMissing(float density) { return std::isnan(density); }
+
+    int minYear() const { return firstYear; }
+    int maxYear() const { return lastYear; }
+    int yearCount() const { return lastYear - firstYear + 1; }
+    uint32_t entityCount() const { return entities; }
+    bool empty() const { return entities == 0 || lastYear < firstYear; }
+    // Whole matrix, row-major by year
+    const float* data() const { return viewed ? viewed : values.data(); }
+    // Heap held by the table; a mapped view is backed by the file instead
+    size_t memoryBytes() const { return values.capacity() * sizeof(float); }
+
+private:
+    std::vector<float> values;
+    const float* viewed = nullptr;
+    std::shared_ptr<const void> viewOwner;
+    int firstYear = 0;
+    int lastYear = -1;
+    uint32_t entities = 0;
+};
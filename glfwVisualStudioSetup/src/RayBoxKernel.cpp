@@ -0,0 +1,187 @@
+#include "RayBoxKernel.h"
+#include "CpuFeatures.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define RAYBOX_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define RAYBOX_TARGET_AVX2
+#define RAYBOX_TARGET_AVX512
+#else
+#define RAYBOX_TARGET_AVX2 __attribute__((target("avx2")))
+#define RAYBOX_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
+void BoxSoA::reserve(size_t count) {
+    for (auto* column : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ }) column->reserve(count);
+}
+
+void BoxSoA::resize(size_t count) {
+    for (auto* column : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ }) column->resize(count);
+}
+
+static inline float scalarEntry(const BoxSoA& b, size_t i, const glm::vec3& origin, const glm::vec3& invDir, float maxT) {
+    return rayBoxEntry(origin, invDir, glm::vec3(b.minX[i], b.minY[i], b.minZ[i]), glm::vec3(b.maxX[i], b.maxY[i], b.maxZ[i]), maxT);
+}
+
+static void distancesScalar(const BoxSoA& boxes, const glm::vec3& origin, const glm::vec3& invDir, float* out) {
+    for (size_t i = 0; i < boxes.size(); ++i) out[i] = scalarEntry(boxes, i, origin, invDir, std::numeric_limits<float>::infinity());
+}
+
+static int64_t nearestScalarFrom(const BoxSoA& boxes, size_t first, const glm::vec3& origin, const glm::vec3& invDir,
+                                 float& bestT, int64_t bestBox) {
+    for (size_t i = first; i < boxes.size(); ++i) {
+        float t = scalarEntry(boxes, i, origin, invDir, bestT);
+        if (t < bestT) {
+            bestT = t;
+            bestBox = (int64_t)i;
+        }
+    }
+    return bestBox;
+}
+
+static int64_t nearestScalar(const BoxSoA& boxes, const glm::vec3& origin, const glm::vec3& invDir, float& bestT) {
+    return nearestScalarFrom(boxes, 0, origin, invDir, bestT, -1);
+}
+
+#ifdef RAYBOX_X86
+// The operand order of every min/max below matches glm::min/max and std::min/max in
+// rayBoxEntry (minps/maxps return the second operand unless the comparison holds), so NaNs
+// from 0 * inf propagate exactly as in the scalar test.
+
+// Eight boxes starting at i
+RAYBOX_TARGET_AVX2 static inline __m256 entry8(const BoxSoA& b, size_t i, __m256 ox, __m256 oy, __m256 oz,
+                                               __m256 ix, __m256 iy, __m256 iz, __m256 maxT) {
+    __m256 t1x = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&b.minX[i]), ox), ix);
+    __m256 t1y = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&b.minY[i]), oy), iy);
+    __m256 t1z = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&b.minZ[i]), oz), iz);
+    __m256 t2x = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&b.maxX[i]), ox), ix);
+    __m256 t2y = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&b.maxY[i]), oy), iy);
+    __m256 t2z = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&b.maxZ[i]), oz), iz);
+    __m256 tNear = _mm256_max_ps(_mm256_max_ps(_mm256_setzero_ps(), _mm256_min_ps(t2z, t1z)),
+                                 _mm256_max_ps(_mm256_min_ps(t2y, t1y), _mm256_min_ps(t2x, t1x)));
+    __m256 tFar = _mm256_min_ps(_mm256_max_ps(t2z, t1z), _mm256_min_ps(_mm256_max_ps(t2y, t1y), _mm256_max_ps(t2x, t1x)));
+    __m256 hit = _mm256_and_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ), _mm256_cmp_ps(tNear, maxT, _CMP_LT_OQ));
+    return _mm256_blendv_ps(_mm256_set1_ps(std::numeric_limits<float>::infinity()), tNear, hit);
+}
+
+RAYBOX_TARGET_AVX2 static void distancesAVX2(const BoxSoA& boxes, const glm::vec3& origin, const glm::vec3& invDir, float* out) {
+    const __m256 ox = _mm256_set1_ps(origin.x), oy = _mm256_set1_ps(origin.y), oz = _mm256_set1_ps(origin.z);
+    const __m256 ix = _mm256_set1_ps(invDir.x), iy = _mm256_set1_ps(invDir.y), iz = _mm256_set1_ps(invDir.z);
+    const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    size_t i = 0;
+    for (; i + 8 <= boxes.size(); i += 8) _mm256_storeu_ps(out + i, entry8(boxes, i, ox, oy, oz, ix, iy, iz, inf));
+    for (; i < boxes.size(); ++i) out[i] = scalarEntry(boxes, i, origin, invDir, std::numeric_limits<float>::infinity());
+}
+
+RAYBOX_TARGET_AVX2 static int64_t nearestAVX2(const BoxSoA& boxes, const glm::vec3& origin, const glm::vec3& invDir, float& bestT) {
+    const __m256 ox = _mm256_set1_ps(origin.x), oy = _mm256_set1_ps(origin.y), oz = _mm256_set1_ps(origin.z);
+    const __m256 ix = _mm256_set1_ps(invDir.x), iy = _mm256_set1_ps(invDir.y), iz = _mm256_set1_ps(invDir.z);
+    __m256 best = _mm256_set1_ps(bestT);
+    int64_t bestBox = -1;
+    size_t i = 0;
+    for (; i + 8 <= boxes.size(); i += 8) {
+        __m256 t = entry8(boxes, i, ox, oy, oz, ix, iy, iz, best);
+        unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_cmp_ps(t, best, _CMP_LT_OQ));
+        if (!mask) continue;
+        // Lanes in box order, as the scalar loop would see them
+        alignas(32) float lanes[8];
+        _mm256_store_ps(lanes, t);
+        for (; mask; mask &= mask - 1) {
+            int lane = countTrailingZeros(mask);
+            if (lanes[lane] < bestT) {
+                bestT = lanes[lane];
+                bestBox = (int64_t)(i + lane);
+            }
+        }
+        best = _mm256_set1_ps(bestT);
+    }
+    return nearestScalarFrom(boxes, i, origin, invDir, bestT, bestBox);
+}
+
+// Sixteen boxes starting at i
+RAYBOX_TARGET_AVX512 static inline __m512 entry16(const BoxSoA& b, size_t i, __m512 ox, __m512 oy, __m512 oz,
+                                                  __m512 ix, __m512 iy, __m512 iz, __m512 maxT) {
+    __m512 t1x = _mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(&b.minX[i]), ox), ix);
+    __m512 t1y = _mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(&b.minY[i]), oy), iy);
+    __m512 t1z = _mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(&b.minZ[i]), oz), iz);
+    __m512 t2x = _mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(&b.maxX[i]), ox), ix);
+    __m512 t2y = _mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(&b.maxY[i]), oy), iy);
+    __m512 t2z = _mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(&b.maxZ[i]), oz), iz);
+    __m512 tNear = _mm512_max_ps(_mm512_max_ps(_mm512_setzero_ps(), _mm512_min_ps(t2z, t1z)),
+                                 _mm512_max_ps(_mm512_min_ps(t2y, t1y), _mm512_min_ps(t2x, t1x)));
+    __m512 tFar = _mm512_min_ps(_mm512_max_ps(t2z, t1z), _mm512_min_ps(_mm512_max_ps(t2y, t1y), _mm512_max_ps(t2x, t1x)));
+    __mmask16 hit = _mm512_cmp_ps_mask(tNear, tFar, _CMP_LE_OQ) & _mm512_cmp_ps_mask(tNear, maxT, _CMP_LT_OQ);
+    return _mm512_mask_blend_ps(hit, _mm512_set1_ps(std::numeric_limits<float>::infinity()), tNear);
+}
+
+RAYBOX_TARGET_AVX512 static void distancesAVX512(const BoxSoA& boxes, const glm::vec3& origin, const glm::vec3& invDir, float* out) {
+    const __m512 ox = _mm512_set1_ps(origin.x), oy = _mm512_set1_ps(origin.y), oz = _mm512_set1_ps(origin.z);
+    const __m512 ix = _mm512_set1_ps(invDir.x), iy = _mm512_set1_ps(invDir.y), iz = _mm512_set1_ps(invDir.z);
+    const __m512 inf = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+    size_t i = 0;
+    for (; i + 16 <= boxes.size(); i += 16) _mm512_storeu_ps(out + i, entry16(boxes, i, ox, oy, oz, ix, iy, iz, inf));
+    for (; i < boxes.size(); ++i) out[i] = scalarEntry(boxes, i, origin, invDir, std::numeric_limits<float>::infinity());
+}
+
+RAYBOX_TARGET_AVX512 static int64_t nearestAVX512(const BoxSoA& boxes, const glm::vec3& origin, const glm::vec3& invDir, float& bestT) {
+    const __m512 ox = _mm512_set1_ps(origin.x), oy = _mm512_set1_ps(origin.y), oz = _mm512_set1_ps(origin.z);
+    const __m512 ix = _mm512_set1_ps(invDir.x), iy = _mm512_set1_ps(invDir.y), iz = _mm512_set1_ps(invDir.z);
+    __m512 best = _mm512_set1_ps(bestT);
+    int64_t bestBox = -1;
+    size_t i = 0;
+    for (; i + 16 <= boxes.size(); i += 16) {
+        __m512 t = entry16(boxes, i, ox, oy, oz, ix, iy, iz, best);
+        unsigned mask = (unsigned)_mm512_cmp_ps_mask(t, best, _CMP_LT_OQ);
+        if (!mask) continue;
+        alignas(64) float lanes[16];
+        _mm512_store_ps(lanes, t);
+        for (; mask; mask &= mask - 1) {
+            int lane = countTrailingZeros(mask);
+            if (lanes[lane] < bestT) {
+                bestT = lanes[lane];
+                bestBox = (int64_t)(i + lane);
+            }
+        }
+        best = _mm512_set1_ps(bestT);
+    }
+    return nearestScalarFrom(boxes, i, origin, invDir, bestT, bestBox);
+}
+#endif
+
+bool isRayBoxPathSupported(RayBoxPath path) {
+    switch (path) {
+    case RayBoxPath::Scalar: return true;
+#ifdef RAYBOX_X86
+    case RayBoxPath::AVX2: return cpuHasAVX2();
+    case RayBoxPath::AVX512: return cpuHasAVX512();
+#endif
+    default: return false;
+    }
+}
+
+RayBoxPath detectRayBoxPath() {
+    if (isRayBoxPathSupported(RayBoxPath::AVX512)) return RayBoxPath::AVX512;
+    if (isRayBoxPathSupported(RayBoxPath::AVX2)) return RayBoxPath::AVX2;
+    return RayBoxPath::Scalar;
+}
+
+RayBoxKernel getRayBoxKernel(RayBoxPath path) {
+    if (!isRayBoxPathSupported(path)) return { distancesScalar, nearestScalar };
+    switch (path) {
+#ifdef RAYBOX_X86
+    case RayBoxPath::AVX2: return { distancesAVX2, nearestAVX2 };
+    case RayBoxPath::AVX512: return { distancesAVX512, nearestAVX512 };
+#endif
+    default: return { distancesScalar, nearestScalar };
+    }
+}
+
+const char* rayBoxPathName(RayBoxPath path) {
+    switch (path) {
+    case RayBoxPath::AVX2: return "AVX2";
+    case RayBoxPath::AVX512: return "AVX-512";
+    default: return "scalar";
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+// Distance along the ray to where it enters [boxMin, boxMax] (0 if it starts inside), or infinity
+// when it misses the box or enters at or beyond maxT. invDir is 1 / ray direction. This is the
+// reference slab test, the SIMD kernels reproduce it bit for bit.
+inline float rayBoxEntry(const glm::vec3& origin, const glm::vec3& invDir, const glm::vec3& boxMin, const glm::vec3& boxMax,
+                         float maxT = std::numeric_limits<float>::infinity()) {
+    glm::vec3 t1 = (boxMin - origin) * invDir;
+    glm::vec3 t2 = (boxMax - origin) * invDir;
+    glm::vec3 tmin = glm::min(t1, t2);
+    glm::vec3 tmax = glm::max(t1, t2);
+    float tNear = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+    float tFar = std::min(std::min(tmax.x, tmax.y), tmax.z);
+    return tNear <= tFar && tNear < maxT ? tNear : std::numeric_limits<float>::infinity();
+}
+
+// Axis-aligned boxes as structure-of-arrays, so the SIMD kernels load 8 or 16 boxes per coordinate
+struct BoxSoA {
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+    size_t size() const { return minX.size(); }
+    void reserve(size_t count);
+    void resize(size_t count);
+    void set(size_t i, const glm::vec3& boxMin, const glm::vec3& boxMax) {
+        minX[i] = boxMin.x; minY[i] = boxMin.y; minZ[i] = boxMin.z;
+        maxX[i] = boxMax.x; maxY[i] = boxMax.y; maxZ[i] = boxMax.z;
+    }
+    size_t memoryBytes() const { return 6 * minX.capacity() * sizeof(float); }
+};
+
+enum class RayBoxPath { Scalar, AVX2, AVX512 };
+
+// Batched rayBoxEntry over every box of a BoxSoA
+struct RayBoxKernel {
+    // out[i] = rayBoxEntry(origin, invDir, box i)
+    void (*distances)(const BoxSoA& boxes, const glm::vec3& origin, const glm::vec3& invDir, float* out);
+    // Box with the smallest entry distance below bestT (the first one on ties) or -1, bestT is updated
+    int64_t (*nearest)(const BoxSoA& boxes, const glm::vec3& origin, const glm::vec3& invDir, float& bestT);
+};
+
+// Widest path supported by the running CPU (detected once)
+RayBoxPath detectRayBoxPath();
+bool isRayBoxPathSupported(RayBoxPath path);
+RayBoxKernel getRayBoxKernel(RayBoxPath path);
+const char* rayBoxPathName(RayBoxPath path);
+
+// Kernel for the detected path
+inline const RayBoxKernel& rayBoxKernel() {
+    static const RayBoxKernel best = getRayBoxKernel(detectRayBoxPath());
+    return best;
+}
@@ -0,0 +1,290 @@
+#include "ShaderManager.h"
+#include "CacheFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+static const char kMagic[4] = { 'P', 'S', 'B', '1' };
+static const uint32_t kVersion = 1;
+
+struct ProgramBinaryHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t length;
+};
+
+static uint64_t fnv1a(uint64_t hash, const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+    return hash;
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Binaries are only valid for the driver that produced them
+static const std::string& driverString() {
+    static std::string driver;
+    if (driver.empty()) {
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+            const GLubyte* s = glGetString(name);
+            driver += s ? reinterpret_cast<const char*>(s) : "";
+            driver += '\n';
+        }
+    }
+    return driver;
+}
+
+static std::string hexKey(uint64_t key) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; --i, key >>= 4) hex[i] = digits[key & 15];
+    return hex;
+}
+
+static GLuint compileStage(const std::string& name, GLenum type, const std::vector<std::string>& sources) {
+    std::vector<const char*> strings;
+    for (const std::string& s : sources) strings.push_back(s.c_str());
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, (GLsizei)strings.size(), strings.data(), nullptr);
+    glCompileShader(shader);
+    int success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        char infoLog[1024];
+        glGetShaderInfoLog(shader, sizeof(infoLog), nullptr, infoLog);
+        std::cerr << "Shader compilation error (" << name << "): " << infoLog << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static bool linked(GLuint program) {
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    return success != 0;
+}
+
+ShaderProgram::~ShaderProgram() {
+    release();
+}
+
+bool ShaderProgram::create(const std::string& name_, std::vector<ShaderStage> stages_, std::function<void(GLuint)> onLink_) {
+    release();
+    name = name_;
+    stages = std::move(stages_);
+    onLink = std::move(onLink_);
+    ShaderManager& manager = ShaderManager::shared();
+    fileStamps.clear();
+    for (const ShaderStage& stage : stages)
+        for (const ShaderPart& part : stage.parts) fileStamps.push_back(manager.fileStamp(part));
+    program = manager.build(*this, true);
+    if (!program && manager.usesFiles(*this)) {
+        // A broken edit must not keep the app from starting
+        std::cerr << "Building shader " << name << " from its built-in sources" << std::endl;
+        program = manager.build(*this, false);
+    }
+    if (!program) return false;
+    manager.programs.push_back(this);
+    if (onLink) onLink(program);
+    return true;
+}
+
+void ShaderProgram::release() {
+    if (program) glDeleteProgram(program);
+    program = 0;
+    std::vector<ShaderProgram*>& programs = ShaderManager::shared().programs;
+    programs.erase(std::remove(programs.begin(), programs.end(), this), programs.end());
+}
+
+ShaderManager& ShaderManager::shared() {
+    // Never destroyed: programs owned by globals and statics unregister themselves after main returns
+    static ShaderManager* manager = new ShaderManager;
+    return *manager;
+}
+
+std::string ShaderManager::sourceOf(const ShaderPart& part, bool fromFile) const {
+    if (part.file && fromFile) {
+        std::ifstream in(fs::path(sourceDirectory) / part.file, std::ios::binary);
+        if (in.is_open()) {
+            std::ostringstream text;
+            text << in.rdbuf();
+            return text.str();
+        }
+    }
+    return part.source;
+}
+
+int64_t ShaderManager::fileStamp(const ShaderPart& part) const {
+    if (!part.file) return 0;
+    std::error_code ec;
+    auto time = fs::last_write_time(fs::path(sourceDirectory) / part.file, ec);
+    return ec ? 0 : (int64_t)time.time_since_epoch().count();
+}
+
+bool ShaderManager::usesFiles(const ShaderProgram& target) const {
+    return std::any_of(target.fileStamps.begin(), target.fileStamps.end(), [](int64_t stamp) { return stamp != 0; });
+}
+
+bool ShaderManager::cacheAvailable() {
+    if (binaryFormats < 0) {
+        binaryFormats = 0;
+        if (GLAD_GL_VERSION_4_1 || GLAD_GL_ARB_get_program_binary) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    }
+    return binaryFormats > 0 && !cacheDirectory.empty();
+}
+
+GLuint ShaderManager::build(const ShaderProgram& target, bool fromFiles) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::vector<std::string>> sources;
+    uint64_t key = fnv1a(1469598103934665603ull, driverString().data(), driverString().size());
+    for (const ShaderStage& stage : target.stages) {
+        key = fnv1a(key, reinterpret_cast<const char*>(&stage.type), sizeof(stage.type));
+        sources.emplace_back();
+        for (const ShaderPart& part : stage.parts) {
+            sources.back().push_back(sourceOf(part, fromFiles));
+            const std::string& s = sources.back().back();
+            key = fnv1a(fnv1a(key, s.data(), s.size()), "", 1);
+        }
+    }
+
+    const bool useCache = cacheAvailable();
+    const fs::path cachePath = fs::path(cacheDirectory) / (target.name + "-" + hexKey(key) + ".bin");
+    if (useCache) {
+        std::ifstream in(cachePath, std::ios::binary);
+        ProgramBinaryHeader header = {};
+        std::error_code ec;
+        const uint64_t fileSize = (uint64_t)fs::file_size(cachePath, ec);
+        // The binary must be exactly the rest of the file before its length sizes anything
+        if (in.read(reinterpret_cast<char*>(&header), sizeof(header)) && std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+            header.version == kVersion && header.key == key && !ec && header.length == fileSize - sizeof(header)) {
+            std::vector<char> binary(header.length);
+            if (in.read(binary.data(), (std::streamsize)binary.size())) {
+                GLuint program = glCreateProgram();
+                glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+                if (linked(program)) {
+                    ++stats.cacheHits;
+                    stats.cacheMs += elapsedMs(start);
+                    return program;
+                }
+                // Rejected by the driver, rebuilt from source and overwritten below
+                glDeleteProgram(program);
+            }
+        }
+    }
+
+    std::vector<GLuint> shaders;
+    for (size_t i = 0; i < target.stages.size(); ++i) {
+        GLuint shader = compileStage(target.name, target.stages[i].type, sources[i]);
+        if (!shader) {
+            for (GLuint s : shaders) glDeleteShader(s);
+            return 0;
+        }
+        shaders.push_back(shader);
+    }
+    GLuint program = glCreateProgram();
+    for (GLuint s : shaders) glAttachShader(program, s);
+    if (useCache) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+    for (GLuint s : shaders) glDeleteShader(s);
+    if (!linked(program)) {
+        char infoLog[1024];
+        glGetProgramInfoLog(program, sizeof(infoLog), nullptr, infoLog);
+        std::cerr << "Shader link error (" << target.name << "): " << infoLog << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    ++stats.compiled;
+    stats.compileMs += elapsedMs(start);
+    if (!useCache) return program;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return program;
+    std::vector<char> binary((size_t)length);
+    ProgramBinaryHeader header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.key = key;
+    glGetProgramBinary(program, length, nullptr, &header.format, binary.data());
+    header.length = (uint32_t)length;
+
+    // Older binaries of this program (previous sources or driver) are never hit again
+    std::error_code ec;
+    fs::create_directories(cacheDirectory, ec);
+    const std::string prefix = target.name + "-";
+    for (const fs::directory_entry& entry : fs::directory_iterator(cacheDirectory, ec)) {
+        const std::string file = entry.path().filename().string();
+        if (file.size() == prefix.size() + 20 && file.compare(0, prefix.size(), prefix) == 0 && entry.path() != cachePath)
+            fs::remove(entry.path(), ec);
+    }
+    // Written via a temporary file, so a concurrent start never reads a partial binary
+    writeFileAtomically(cachePath.string(), "shader cache", [&](std::ofstream& out) {
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(binary.data(), (std::streamsize)binary.size());
+        return true;
+    });
+    return program;
+}
+
+int ShaderManager::reloadChanged() {
+    const double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (lastPollSeconds >= 0.0 && now - lastPollSeconds < 0.25) return 0;
+    lastPollSeconds = now;
+    int reloaded = 0;
+    for (ShaderProgram* target : programs) {
+        std::vector<int64_t> stamps;
+        for (const ShaderStage& stage : target->stages)
+            for (const ShaderPart& part : stage.parts) stamps.push_back(fileStamp(part));
+        if (stamps == target->fileStamps) continue;
+        // Remembered before building, so a broken edit is reported once and not on every poll
+        target->fileStamps = stamps;
+        GLuint program = build(*target, true);
+        if (!program) {
+            std::cerr << "Keeping the previous version of shader " << target->name << std::endl;
+            continue;
+        }
+        glDeleteProgram(target->program);
+        target->program = program;
+        if (target->onLink) target->onLink(program);
+        ++stats.reloads;
+        ++reloaded;
+        std::cout << "Reloaded shader " << target->name << std::endl;
+    }
+    return reloaded;
+}
+
+int ShaderManager::exportSources() {
+    int written = 0;
+    std::error_code ec;
+    fs::create_directories(sourceDirectory, ec);
+    for (const ShaderProgram* target : programs) {
+        for (const ShaderStage& stage : target->stages) {
+            for (const ShaderPart& part : stage.parts) {
+                if (!part.file) continue;
+                const fs::path path = fs::path(sourceDirectory) / part.file;
+                if (fs::exists(path, ec)) continue;
+                std::ofstream out(path, std::ios::binary);
+                out << part.source;
+                if (out.good()) ++written;
+                else std::cerr << "Failed to write shader source: " << path.string() << std::endl;
+            }
+        }
+    }
+    // The exported files hold the sources the programs were built from, nothing to reload
+    for (ShaderProgram* target : programs) {
+        target->fileStamps.clear();
+        for (const ShaderStage& stage : target->stages)
+            for (const ShaderPart& part : stage.parts) target->fileStamps.push_back(fileStamp(part));
+    }
+    return written;
+}
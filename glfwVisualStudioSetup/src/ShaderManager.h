@@ -0,0 +1,87 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// One source string of a shader stage. It is read from file (relative to the shader directory)
+// when that file exists, otherwise the embedded default is compiled.
+struct ShaderPart {
+    const char* file;   // nullptr for parts that only exist embedded
+    const char* source; // Embedded default
+};
+
+// Stage sources are concatenated in order, the first part holds the #version line
+struct ShaderStage {
+    GLenum type;
+    std::vector<ShaderPart> parts;
+};
+
+struct ShaderLoadStats {
+    uint32_t compiled = 0;    // Programs compiled and linked from source
+    uint32_t cacheHits = 0;   // Programs restored with glProgramBinary
+    uint32_t reloads = 0;     // Hot reloads after a source file changed
+    double compileMs = 0.0;
+    double cacheMs = 0.0;
+};
+
+// A linked program built through ShaderManager. onLink runs after every successful link, the
+// first one and each hot reload, and is where owners resolve uniform locations and set the
+// uniforms that never change: a reloaded program starts with fresh state and a new name.
+class ShaderProgram {
+public:
+    ShaderProgram() = default;
+    ShaderProgram(const ShaderProgram&) = delete;
+    ShaderProgram& operator=(const ShaderProgram&) = delete;
+    ~ShaderProgram();
+
+    bool create(const std::string& name, std::vector<ShaderStage> stages, std::function<void(GLuint)> onLink = {});
+    void release();
+    GLuint id() const { return program; }
+
+private:
+    friend class ShaderManager;
+    std::string name;
+    std::vector<ShaderStage> stages;
+    std::function<void(GLuint)> onLink;
+    std::vector<int64_t> fileStamps; // Modification time of each file part, 0 while it does not exist
+    GLuint program = 0;
+};
+
+// Builds every program of the app. Linked programs are cached on disk with glGetProgramBinary,
+// keyed by a hash of their sources and the driver strings, so warm starts skip compilation;
+// a driver update or an edited shader simply misses the cache. Programs whose source files
+// change on disk are rebuilt by reloadChanged() while the app runs.
+class ShaderManager {
+public:
+    static ShaderManager& shared();
+
+    // Directory of the editable sources ("shaders" by default)
+    void setSourceDirectory(const std::string& directory) { sourceDirectory = directory; }
+    // Directory of the program binaries ("shader_cache" by default), empty disables the cache
+    void setCacheDirectory(const std::string& directory) { cacheDirectory = directory; }
+    // Writes the embedded default of every file part of the created programs that does not
+    // exist yet in the source directory, as a starting point for editing
+    int exportSources();
+    // Rebuilds the programs whose source files changed; checks the files at most every 250 ms.
+    // A program that fails to build keeps running with its previous version.
+    int reloadChanged();
+    const ShaderLoadStats& getStats() const { return stats; }
+
+private:
+    friend class ShaderProgram;
+    std::string sourceDirectory = "shaders";
+    std::string cacheDirectory = "shader_cache";
+    std::vector<ShaderProgram*> programs;
+    ShaderLoadStats stats;
+    double lastPollSeconds = -1.0;
+    int binaryFormats = -1; // Unknown until the first build
+
+    // fromFiles = false compiles the embedded defaults even where a file exists
+    GLuint build(const ShaderProgram& program, bool fromFiles);
+    std::string sourceOf(const ShaderPart& part, bool fromFile) const;
+    int64_t fileStamp(const ShaderPart& part) const;
+    bool usesFiles(const ShaderProgram& program) const;
+    bool cacheAvailable();
+};
@@ -1,75 +1,281 @@
 #include "Skybox.h"
-#include <stb_image/stb_image.h>
+#include "CacheFile.h"
+#include "FrameUniforms.h"
+#include "DecodedImage.h"
+#include "CompressedTexture.h"
+#include "ThreadPool.h"
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <vector>
 
+namespace fs = std::filesystem;
+
+// Cached faces (.psc): this header, then the BC1 blocks of the six faces back to back
+struct SkyboxCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint32_t faceSize;
+    uint32_t reserved;
+};
+
+static const char kCacheMagic[4] = { 'P', 'S', 'C', '1' };
+static const uint32_t kCacheVersion = 1;
+static const uint32_t kMaxFaceSize = 1024;
+
 Skybox::Skybox() {}
 Skybox::~Skybox() {
     if (vao) glDeleteVertexArrays(1, &vao);
-    if (vbo) glDeleteBuffers(1, &vbo);
     if (texture) glDeleteTextures(1, &texture);
-    if (shaderProgram) glDeleteProgram(shaderProgram);
+    if (referenceVao) glDeleteVertexArrays(1, &referenceVao);
+    if (referenceVbo) glDeleteBuffers(1, &referenceVbo);
+    if (referenceTexture) glDeleteTextures(1, &referenceTexture);
+}
+
+std::string Skybox::cachePathFor(const std::string& imagePath) {
+    return fs::path(imagePath).replace_extension(".psc").string();
+}
+
+static bool readCache(const std::string& cachePath, const std::string& sourcePath, SkyboxFaces& faces) {
+    SkyboxCacheHeader header;
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    if (!sourceStamp(sourcePath, sourceSize, sourceMtime)) return false;
+    std::ifstream in(cachePath, std::ios::binary);
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (std::memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 || header.version != kCacheVersion ||
+        header.sourceSize != sourceSize || header.sourceMtime != sourceMtime ||
+        header.faceSize == 0 || header.faceSize > kMaxFaceSize || header.faceSize % 4 != 0)
+        return false;
+    faces.size = header.faceSize;
+    faces.blocks.resize(6 * faces.faceBytes());
+    // The blocks must fill the rest of the file exactly
+    if (!in.read(reinterpret_cast<char*>(faces.blocks.data()), (std::streamsize)faces.blocks.size()) ||
+        in.peek() != std::ifstream::traits_type::eof()) {
+        faces = SkyboxFaces();
+        return false;
+    }
+    return true;
+}
+
+static bool writeCache(const std::string& cachePath, const std::string& sourcePath, const SkyboxFaces& faces) {
+    SkyboxCacheHeader header = {};
+    std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+    header.version = kCacheVersion;
+    header.faceSize = faces.size;
+    if (!sourceStamp(sourcePath, header.sourceSize, header.sourceMtime)) return false;
+    return writeFileAtomically(cachePath, "skybox cache", [&](std::ofstream& out) {
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(faces.blocks.data()), (std::streamsize)faces.blocks.size());
+        return true;
+    });
+}
+
+bool Skybox::loadTexture(const std::string& path, bool useCache) {
+    SkyboxFaces faces;
+    if (!prepareTexture(path, faces, useCache)) return false;
+    return uploadTexture(faces);
 }
 
-bool Skybox::loadTexture(const std::string& path) {
-    int texWidth, texHeight, nrChannels;
-    stbi_set_flip_vertically_on_load(0);
-    unsigned char* data = stbi_load(path.c_str(), &texWidth, &texHeight, &nrChannels, 4);
-    if (!data) {
+bool Skybox::prepareTexture(const std::string& path, SkyboxFaces& faces, bool useCache) {
+    const std::string cachePath = cachePathFor(path);
+    if (useCache && readCache(cachePath, path, faces)) return true;
+    DecodedImage image;
+    if (!decodeImage(path, false, image)) {
         std::cerr << "Failed to load background texture: " << path << std::endl;
         return false;
     }
+    if (!convertEquirect(image, faces)) return false;
+    if (useCache) writeCache(cachePath, path, faces);
+    return true;
+}
+
+// World direction (z up) through texel coordinates a, b in [-1, 1] of a GL cubemap face
+static void faceDirection(int face, float a, float b, float dir[3]) {
+    switch (face) {
+    case 0: dir[0] = 1.0f;  dir[1] = -b;    dir[2] = -a;    break; // +X
+    case 1: dir[0] = -1.0f; dir[1] = -b;    dir[2] = a;     break; // -X
+    case 2: dir[0] = a;     dir[1] = 1.0f;  dir[2] = b;     break; // +Y
+    case 3: dir[0] = a;     dir[1] = -1.0f; dir[2] = -b;    break; // -Y
+    case 4: dir[0] = a;     dir[1] = -b;    dir[2] = 1.0f;  break; // +Z
+    default: dir[0] = -a;   dir[1] = -b;    dir[2] = -1.0f; break; // -Z
+    }
+}
+
+// Bilinear lookup of the panorama in the direction dir, the same mapping the per-pixel shader used:
+// longitude wraps around the image, latitude runs from the top row (up) to the bottom row (down)
+static void sampleEquirect(const DecodedImage& image, const float dir[3], float rgb[3]) {
+    const float pi = 3.14159265f;
+    float longitude = std::atan2(-dir[1], dir[0]);
+    float latitude = std::atan2(dir[2], std::sqrt(dir[0] * dir[0] + dir[1] * dir[1]));
+    float x = (0.5f + longitude / (2.0f * pi)) * image.width - 0.5f;
+    float y = (0.5f - latitude / pi) * image.height - 0.5f;
+    float fx = x - std::floor(x), fy = y - std::floor(y);
+    int x0 = ((int)std::floor(x) % image.width + image.width) % image.width;
+    int x1 = (x0 + 1) % image.width;
+    int y0 = std::clamp((int)std::floor(y), 0, image.height - 1);
+    int y1 = std::min(y0 + 1, image.height - 1);
+    if (y < 0.0f) fy = 0.0f;
+    const unsigned char* p = image.pixels.get();
+    const unsigned char* p00 = p + ((size_t)y0 * image.width + x0) * 4;
+    const unsigned char* p10 = p + ((size_t)y0 * image.width + x1) * 4;
+    const unsigned char* p01 = p + ((size_t)y1 * image.width + x0) * 4;
+    const unsigned char* p11 = p + ((size_t)y1 * image.width + x1) * 4;
+    for (int c = 0; c < 3; ++c) {
+        float top = p00[c] + (p10[c] - p00[c]) * fx;
+        float bottom = p01[c] + (p11[c] - p01[c]) * fx;
+        rgb[c] = top + (bottom - top) * fy;
+    }
+}
+
+bool Skybox::convertEquirect(const DecodedImage& image, SkyboxFaces& faces, unsigned threadCount) {
+    if (image.empty()) return false;
+    // A face spans a quarter of the panorama's width, rounded to whole BC1 blocks
+    faces.size = std::min(kMaxFaceSize, std::max(4u, ((uint32_t)image.width / 4 + 3) & ~3u));
+    faces.blocks.assign(6 * faces.faceBytes(), 0);
+
+    // Gamma correction baked into the texels, indexed by the filtered value in quarter steps
+    std::vector<uint8_t> gamma(4 * 255 + 1);
+    for (size_t i = 0; i < gamma.size(); ++i)
+        gamma[i] = (uint8_t)std::lround(std::pow(i / (4.0 * 255.0), 1.0 / 2.2) * 255.0);
+
+    // A face texel spans about as much of the sky as a texel on the panorama's equator, so one
+    // bilinear sample per texel, like the per-pixel pass took, keeps the detail
+    const uint32_t size = faces.size, blocksPerSide = size / 4;
+    ThreadPool pool(ThreadPool::resolveThreadCount((int)threadCount));
+    pool.parallelFor(6 * (size_t)blocksPerSide, [&](size_t task) {
+        const int face = (int)(task / blocksPerSide);
+        const uint32_t blockY = (uint32_t)(task % blocksPerSide);
+        uint8_t* out = faces.blocks.data() + face * faces.faceBytes() + (size_t)blockY * blocksPerSide * 8;
+        uint8_t pixels[16][4];
+        for (uint32_t blockX = 0; blockX < blocksPerSide; ++blockX, out += 8) {
+            for (int k = 0; k < 16; ++k) {
+                float a = 2.0f * (blockX * 4 + k % 4 + 0.5f) / size - 1.0f;
+                float b = 2.0f * (blockY * 4 + k / 4 + 0.5f) / size - 1.0f;
+                float dir[3], rgb[3];
+                faceDirection(face, a, b, dir);
+                sampleEquirect(image, dir, rgb);
+                for (int c = 0; c < 3; ++c) pixels[k][c] = gamma[(size_t)std::lround(rgb[c] * 4.0f)];
+                pixels[k][3] = 255;
+            }
+            encodeBc1Block(pixels, out);
+        }
+    });
+    return true;
+}
+
+bool Skybox::uploadTexture(const SkyboxFaces& faces) {
+    if (faces.empty()) return false;
     glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texWidth, texHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    stbi_image_free(data);
-    this->texWidth = texWidth;
-    this->texHeight = texHeight;
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+    const bool compressed = CompressedTexture::isFormatSupported();
+    const uint32_t size = faces.size;
+    std::vector<uint8_t> rgba;
+    for (int face = 0; face < 6; ++face) {
+        const uint8_t* blocks = faces.blocks.data() + face * faces.faceBytes();
+        if (compressed) {
+            glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, size, size, 0,
+                                   (GLsizei)faces.faceBytes(), blocks);
+            continue;
+        }
+        // No S3TC: decode the blocks and upload plain RGBA8
+        rgba.resize((size_t)size * size * 4);
+        uint8_t block[64];
+        for (uint32_t by = 0; by < size / 4; ++by)
+            for (uint32_t bx = 0; bx < size / 4; ++bx, blocks += 8) {
+                decodeBc1Block(blocks, block);
+                for (int row = 0; row < 4; ++row)
+                    std::memcpy(&rgba[(((size_t)by * 4 + row) * size + bx * 4) * 4], block + row * 16, 16);
+            }
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    }
+    // A face covers ~90 degrees at a few hundred pixels, so the base level is all the sky ever samples
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    // Filter across face edges instead of showing the seams
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
     return true;
 }
 
 bool Skybox::initialize() {
-    // Fullscreen quad (NDC)
-    float quadVertices[] = {
-        // positions   // texCoords
-        -1.0f, -1.0f,  0.0f, 0.0f,
-         1.0f, -1.0f,  1.0f, 0.0f,
-         1.0f,  1.0f,  1.0f, 1.0f,
-        -1.0f,  1.0f,  0.0f, 1.0f
-    };
-    unsigned int indices[] = { 0, 1, 2, 2, 3, 0 };
+    // The cube's corners come from gl_VertexID, the VAO only has to exist
     glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
-    glBindVertexArray(0);
     return createShaders();
 }
 
-void Skybox::draw(const glm::mat4& viewMatrix) const {
+void Skybox::draw() const {
+    if (referenceTexture) {
+        glDepthMask(GL_FALSE);
+        glUseProgram(referenceProgram.id());
+        glBindVertexArray(referenceVao);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, referenceTexture);
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        glBindVertexArray(0);
+        glUseProgram(0);
+        glDepthMask(GL_TRUE);
+        return;
+    }
     if (!initialized) return;
+    // Depth 1.0 passes only where the scene left the cleared far plane
+    glDepthFunc(GL_LEQUAL);
     glDepthMask(GL_FALSE);
-    glUseProgram(shaderProgram);
+    glUseProgram(shaderProgram.id());
     glBindVertexArray(vao);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glUniform1i(glGetUniformLocation(shaderProgram, "uTexture"), 0);
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "uView"), 1, GL_FALSE, glm::value_ptr(viewMatrix));
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 14);
     glBindVertexArray(0);
     glUseProgram(0);
     glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+}
+
+// Compiled after FrameUniforms::kGlsl. A unit cube as one 14-vertex strip: every bit of the three
+// masks says whether that vertex sits at +1 on the axis. Only the camera's rotation is applied and
+// z = w puts every fragment on the far plane.
+static const char* cubeVertexShaderSrc = R"(
+out vec3 vDirection;
+void main() {
+    int bit = 1 << gl_VertexID;
+    vec3 corner = vec3((0x287a & bit) != 0, (0x02af & bit) != 0, (0x31e3 & bit) != 0) * 2.0 - 1.0;
+    vDirection = corner;
+    gl_Position = (uProj * vec4(mat3(uView) * corner, 1.0)).xyww;
+}
+)";
+
+static const char* cubeFragmentShaderSrc = R"(
+#version 330 core
+in vec3 vDirection;
+out vec4 FragColor;
+uniform samplerCube uSky;
+void main() {
+    // Gamma is baked into the faces
+    FragColor = vec4(texture(uSky, vDirection).rgb, 1.0);
+}
+)";
+
+bool Skybox::createShaders() {
+    initialized = shaderProgram.create("skybox", {
+        { GL_VERTEX_SHADER, { { "frame_uniforms.glsl", FrameUniforms::kGlsl }, { "skybox.vert", cubeVertexShaderSrc } } },
+        { GL_FRAGMENT_SHADER, { { "skybox.frag", cubeFragmentShaderSrc } } } },
+        [](GLuint program) {
+            FrameUniforms::attach(program);
+            glUseProgram(program);
+            glUniform1i(glGetUniformLocation(program, "uSky"), 0);
+            glUseProgram(0);
+        });
+    return initialized;
 }
 
 static const char* quadVertexShaderSrc = R"(
@@ -83,12 +289,11 @@ void main() {
 }
 )";
 
+// Compiled after FrameUniforms::kGlsl
 static const char* quadFragmentShaderSrc = R"(
-#version 330 core
 in vec2 vTexCoord;
 out vec4 FragColor;
 uniform sampler2D uTexture;
-uniform mat4 uView;
 void main() {
     // Reconstruct NDC direction (z = -1 for OpenGL camera looking down -Z)
     vec3 dir = normalize(vec3(vTexCoord.x, vTexCoord.y, -1.0));
@@ -114,39 +319,47 @@ void main() {
 }
 )";
 
-static GLuint compileQuadShader(GLenum type, const char* src) {
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &src, nullptr);
-    glCompileShader(shader);
-    int success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
-        std::cerr << "Quad shader compilation error: " << infoLog << std::endl;
-        return 0;
+bool Skybox::setReferenceEquirect(const DecodedImage& image) {
+    if (referenceTexture) glDeleteTextures(1, &referenceTexture);
+    referenceTexture = 0;
+    if (image.empty()) return true;
+    if (!referenceVao) {
+        // Fullscreen quad (NDC)
+        float quadVertices[] = {
+            // positions   // texCoords
+            -1.0f, -1.0f,  0.0f, 0.0f,
+             1.0f, -1.0f,  1.0f, 0.0f,
+             1.0f,  1.0f,  1.0f, 1.0f,
+            -1.0f,  1.0f,  0.0f, 1.0f
+        };
+        glGenVertexArrays(1, &referenceVao);
+        glGenBuffers(1, &referenceVbo);
+        glBindVertexArray(referenceVao);
+        glBindBuffer(GL_ARRAY_BUFFER, referenceVbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+        glBindVertexArray(0);
     }
-    return shader;
-}
-
-bool Skybox::createShaders() {
-    GLuint vs = compileQuadShader(GL_VERTEX_SHADER, quadVertexShaderSrc);
-    GLuint fs = compileQuadShader(GL_FRAGMENT_SHADER, quadFragmentShaderSrc);
-    if (!vs || !fs) return false;
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vs);
-    glAttachShader(shaderProgram, fs);
-    glLinkProgram(shaderProgram);
-    int success;
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
-        std::cerr << "Quad shader link error: " << infoLog << std::endl;
+    if (!referenceProgram.id() && !referenceProgram.create("skybox_equirect", {
+            { GL_VERTEX_SHADER, { { "skybox_equirect.vert", quadVertexShaderSrc } } },
+            { GL_FRAGMENT_SHADER, { { "frame_uniforms.glsl", FrameUniforms::kGlsl }, { "skybox_equirect.frag", quadFragmentShaderSrc } } } },
+            [](GLuint program) {
+                FrameUniforms::attach(program);
+                glUseProgram(program);
+                glUniform1i(glGetUniformLocation(program, "uTexture"), 0);
+                glUseProgram(0);
+            }))
         return false;
-    }
-    glDeleteShader(vs);
-    glDeleteShader(fs);
-    initialized = true;
+    glGenTextures(1, &referenceTexture);
+    glBindTexture(GL_TEXTURE_2D, referenceTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.get());
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     return true;
-} 
\ No newline at end of file
+}
@@ -1,7 +1,20 @@
 #pragma once
 #include <string>
+#include <vector>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include "ShaderManager.h"
+#include "DecodedImage.h"
+
+// Sky prepared off the GL thread: the six cubemap faces (+X, -X, +Y, -Y, +Z, -Z in world space,
+// z up), size x size texels each, gamma already applied, as BC1 blocks
+struct SkyboxFaces {
+    uint32_t size = 0;
+    std::vector<uint8_t> blocks;
+
+    bool empty() const { return blocks.empty(); }
+    size_t faceBytes() const { return (size_t)size * size / 2; }
+};
 
 // Class responsible for rendering a panoramic sky background
 class Skybox {
@@ -9,21 +22,37 @@ public:
     Skybox();
     ~Skybox();
 
+    // assets/skybox.jpg -> assets/skybox.psc
+    static std::string cachePathFor(const std::string& imagePath);
+
     // Loads the background texture from file (returns true on success)
-    bool loadTexture(const std::string& path);
+    bool loadTexture(const std::string& path, bool useCache = true);
+    // The two halves of loadTexture. prepareTexture needs no GL context and may run on any thread:
+    // it reads the cached faces, or decodes the equirectangular image, converts it and caches the result.
+    static bool prepareTexture(const std::string& path, SkyboxFaces& faces, bool useCache = true);
+    bool uploadTexture(const SkyboxFaces& faces);
+    // Resamples an equirectangular panorama into cubemap faces on threadCount workers (0 = all
+    // hardware threads)
+    static bool convertEquirect(const DecodedImage& image, SkyboxFaces& faces, unsigned threadCount = 0);
 
     // Initializes OpenGL buffers and shaders
     bool initialize();
 
-    // Renders the panoramic background using the camera view matrix
-    void draw(const glm::mat4& viewMatrix) const;
+    // Renders the sky around the camera of the bound FrameUniforms block. It lies on the far plane
+    // and is depth tested, so draw it after the scene: covered pixels are rejected before shading.
+    void draw() const;
+
+    // The original pass that maps every pixel into the equirectangular image, kept to compare
+    // against. While an image is set draw() uses it; it ignores depth, so draw it before the scene.
+    bool setReferenceEquirect(const DecodedImage& image);
 
 private:
-    GLuint vao = 0, vbo = 0;
+    GLuint vao = 0;
     GLuint texture = 0;
-    GLuint shaderProgram = 0;
+    ShaderProgram shaderProgram;
     bool initialized = false;
-    int texWidth = 0, texHeight = 0;
+    GLuint referenceVao = 0, referenceVbo = 0, referenceTexture = 0;
+    ShaderProgram referenceProgram;
 
     bool createShaders();
-}; 
\ No newline at end of file
+};
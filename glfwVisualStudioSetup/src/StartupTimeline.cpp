@@ -0,0 +1,79 @@
+#include "StartupTimeline.h"
+#include <cstdio>
+
+StartupTimeline::StartupTimeline()
+    : origin(std::chrono::steady_clock::now()), mainThread(std::this_thread::get_id()) {}
+
+double StartupTimeline::elapsedMs() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count();
+}
+
+size_t StartupTimeline::begin(const std::string& name, std::vector<std::string> after) {
+    StartupPhase phase;
+    phase.name = name;
+    phase.after = std::move(after);
+    phase.start = elapsedMs();
+    phase.worker = std::this_thread::get_id() != mainThread;
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.push_back(std::move(phase));
+    return entries.size() - 1;
+}
+
+void StartupTimeline::end(size_t phase) {
+    double now = elapsedMs();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (phase < entries.size()) entries[phase].end = now;
+}
+
+std::vector<StartupPhase> StartupTimeline::phases() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries;
+}
+
+std::vector<std::string> StartupTimeline::criticalPath(const std::string& last) const {
+    std::vector<StartupPhase> all = phases();
+    auto find = [&](const std::string& name) -> const StartupPhase* {
+        for (const StartupPhase& p : all) if (p.name == name) return &p;
+        return nullptr;
+    };
+    std::vector<std::string> path;
+    const StartupPhase* phase = find(last);
+    while (phase && path.size() <= all.size()) {
+        path.insert(path.begin(), phase->name);
+        const StartupPhase* gate = nullptr;
+        for (const std::string& dep : phase->after) {
+            const StartupPhase* p = find(dep);
+            if (p && (!gate || p->end > gate->end)) gate = p;
+        }
+        // The main thread runs its phases one after another, so the previous one gates too
+        if (!phase->worker) {
+            for (const StartupPhase& p : all) {
+                if (&p == phase || p.worker || p.end < 0.0 || p.end > phase->start) continue;
+                if (!gate || p.end > gate->end) gate = &p;
+            }
+        }
+        phase = gate;
+    }
+    return path;
+}
+
+void StartupTimeline::print(std::ostream& out, const std::string& last) const {
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-22s %9s %9s %9s  %s\n", "Startup phase", "start ms", "end ms", "wall ms", "thread");
+    out << line;
+    for (const StartupPhase& p : phases()) {
+        std::snprintf(line, sizeof(line), "%-22s %9.1f %9.1f %9.1f  %s\n", p.name.c_str(), p.start, p.end, p.end - p.start,
+            p.worker ? "worker" : "main");
+        out << line;
+    }
+    std::vector<std::string> path = criticalPath(last);
+    double pathWall = 0.0, total = 0.0;
+    for (const StartupPhase& p : phases()) {
+        for (const std::string& name : path) if (p.name == name) pathWall += p.end - p.start;
+        if (p.name == last) total = p.end;
+    }
+    out << "Critical path:";
+    for (size_t i = 0; i < path.size(); ++i) out << (i ? " -> " : " ") << path[i];
+    std::snprintf(line, sizeof(line), " (%.1f ms busy of %.1f ms)\n", pathWall, total);
+    out << line;
+}
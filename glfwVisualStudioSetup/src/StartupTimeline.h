@@ -0,0 +1,40 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One startup phase. Times are ms since the timeline was created; end < 0 while it runs.
+struct StartupPhase {
+    std::string name;
+    std::vector<std::string> after; // Phases that had to finish before this one could start
+    double start = 0.0;
+    double end = -1.0;
+    bool worker = false;            // Ran off the main thread
+};
+
+// Wall-clock record of the startup phases, written from the main thread and the loader workers.
+// The critical path of a phase follows, from the phase back to the start, whichever of its
+// dependencies (or, on the main thread, the main-thread phase before it) finished last:
+// shortening anything off that path does not start the app sooner.
+class StartupTimeline {
+public:
+    StartupTimeline();
+
+    size_t begin(const std::string& name, std::vector<std::string> after = {});
+    void end(size_t phase);
+    double elapsedMs() const;
+
+    std::vector<StartupPhase> phases() const;
+    std::vector<std::string> criticalPath(const std::string& last) const;
+    // Per-phase table followed by the critical path ending at last
+    void print(std::ostream& out, const std::string& last) const;
+
+private:
+    std::chrono::steady_clock::time_point origin;
+    std::thread::id mainThread;
+    mutable std::mutex mutex;
+    std::vector<StartupPhase> entries;
+};
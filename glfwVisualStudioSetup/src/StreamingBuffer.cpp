@@ -0,0 +1,115 @@
+#include "StreamingBuffer.h"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+StreamingBuffer::~StreamingBuffer() {
+    release();
+}
+
+bool StreamingBuffer::initialize(size_t bytes, bool allowPersistent) {
+    persistentAllowed = allowPersistent;
+    release();
+    return allocate(std::max<size_t>(bytes, 256));
+}
+
+void StreamingBuffer::release() {
+    for (GLsync& f : fences) {
+        if (f) glDeleteSync(f);
+        f = nullptr;
+    }
+    if (buffer) {
+        if (mapped) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+    buffer = 0;
+    mapped = nullptr;
+    current = kRegions - 1;
+}
+
+bool StreamingBuffer::allocate(size_t bytes) {
+    regionBytes = bytes;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    const GLsizeiptr total = (GLsizeiptr)(regionBytes * kRegions);
+    if (persistentAllowed && (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage)) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, total, nullptr, flags);
+        mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, flags);
+        if (mapped) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            return true;
+        }
+        // Immutable storage cannot be re-specified, start over with a mutable buffer
+        std::cerr << "Persistent mapping failed, streaming through glMapBufferRange" << std::endl;
+        glDeleteBuffers(1, &buffer);
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    }
+    glBufferData(GL_COPY_WRITE_BUFFER, total, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return true;
+}
+
+void StreamingBuffer::waitForRegion(int region) {
+    GLsync& f = fences[region];
+    if (!f) return;
+    GLenum status = glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        auto start = std::chrono::steady_clock::now();
+        while (status == GL_TIMEOUT_EXPIRED) status = glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        ++stats.fenceWaits;
+        stats.fenceWaitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    glDeleteSync(f);
+    f = nullptr;
+}
+
+size_t StreamingBuffer::write(const void* data, size_t bytes) {
+    if (bytes > regionBytes) {
+        // Every region may still be read, let them all drain before replacing the buffer
+        for (int r = 0; r < kRegions; ++r) waitForRegion(r);
+        release();
+        allocate(std::max(bytes, regionBytes * 2));
+        ++stats.reallocations;
+    }
+    current = (current + 1) % kRegions;
+    waitForRegion(current);
+    const size_t offset = (size_t)current * regionBytes;
+    if (bytes > 0) {
+        if (mapped) {
+            std::memcpy(static_cast<char*>(mapped) + offset, data, bytes);
+        } else {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            void* range = glMapBufferRange(GL_COPY_WRITE_BUFFER, (GLintptr)offset, (GLsizeiptr)bytes,
+                                           GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+            if (range) {
+                std::memcpy(range, data, bytes);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+    }
+    ++stats.writes;
+    stats.bytes += bytes;
+    return offset;
+}
+
+void StreamingBuffer::fence() {
+    if (!buffer) return;
+    GLsync& f = fences[current];
+    if (f) glDeleteSync(f);
+    f = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void StreamingBuffer::endFrame() {
+    stats.frameBytes = stats.bytes - frameStartBytes;
+    stats.frameFenceWaitMs = stats.fenceWaitMs - frameStartWaitMs;
+    frameStartBytes = stats.bytes;
+    frameStartWaitMs = stats.fenceWaitMs;
+}
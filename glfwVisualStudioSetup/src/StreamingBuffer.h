@@ -0,0 +1,68 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <cstddef>
+
+// Totals of a StreamingBuffer. The frame fields describe the last frame closed by endFrame().
+struct StreamingStats {
+    uint64_t writes = 0;
+    uint64_t bytes = 0;
+    uint64_t fenceWaits = 0;      // Writes that found their region still in use by the GPU
+    double fenceWaitMs = 0.0;     // Time spent blocked on those fences
+    uint64_t reallocations = 0;   // Regions grown for a write larger than their size
+    uint64_t frameBytes = 0;
+    double frameFenceWaitMs = 0.0;
+
+    StreamingStats& operator+=(const StreamingStats& other) {
+        writes += other.writes;
+        bytes += other.bytes;
+        fenceWaits += other.fenceWaits;
+        fenceWaitMs += other.fenceWaitMs;
+        reallocations += other.reallocations;
+        frameBytes += other.frameBytes;
+        frameFenceWaitMs += other.frameFenceWaitMs;
+        return *this;
+    }
+};
+
+// One GL buffer split into kRegions regions written in turn, for data rewritten every frame or
+// so. Each region is fenced after the draws reading it, and a write only waits for that fence,
+// so the GPU can still be drawing from the other regions. With GL 4.4 / ARB_buffer_storage
+// the buffer is mapped once, persistently and coherently; otherwise every write maps its range
+// unsynchronized, the fences doing the synchronisation the driver would otherwise do.
+class StreamingBuffer {
+public:
+    StreamingBuffer() = default;
+    StreamingBuffer(const StreamingBuffer&) = delete;
+    StreamingBuffer& operator=(const StreamingBuffer&) = delete;
+    ~StreamingBuffer();
+    // regionBytes is the largest single write expected; larger writes grow the buffer
+    bool initialize(size_t regionBytes, bool allowPersistent = true);
+    bool isInitialized() const { return buffer != 0; }
+    bool isPersistent() const { return mapped != nullptr; }
+    GLuint name() const { return buffer; }
+    size_t regionSize() const { return regionBytes; }
+
+    // Copies data into the next region and returns its byte offset in name()
+    size_t write(const void* data, size_t bytes);
+    // Fences the last written region; call after every draw that reads it
+    void fence();
+    void endFrame();
+    const StreamingStats& getStats() const { return stats; }
+
+private:
+    static const int kRegions = 3;
+    GLuint buffer = 0;
+    size_t regionBytes = 0;
+    bool persistentAllowed = true;
+    void* mapped = nullptr;
+    GLsync fences[kRegions] = {};
+    int current = kRegions - 1; // Region of the last write
+    uint64_t frameStartBytes = 0;
+    double frameStartWaitMs = 0.0;
+    StreamingStats stats;
+
+    bool allocate(size_t bytes);
+    void release();
+    void waitForRegion(int region);
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+// Fixed-size pool of worker threads consuming a shared FIFO task queue
+class ThreadPool {
+public:
+    // threadCount = 0 uses one worker per hardware thread
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return (unsigned)workers.size(); }
+
+    // Queues a task, the returned future becomes ready once it has run
+    template <typename F>
+    auto submit(F&& task) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace([packaged]() { (*packaged)(); });
+        }
+        wake.notify_one();
+        return result;
+    }
+
+    // Runs body(i) for every i in [0, count) on the workers and blocks until all are done
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+    // Number of workers to use for a user supplied thread count (0 or less = all hardware threads)
+    static unsigned resolveThreadCount(int requested);
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void workerLoop();
+};
@@ -0,0 +1,294 @@
+#include "TilePyramid.h"
+#include "CacheFile.h"
+#include "CompressedTexture.h"
+#include "DecodedImage.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+static const char kMagic[4] = { 'P', 'T', 'P', '1' };
+static const uint32_t kVersion = 1;
+
+struct PyramidHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t tileSize;
+    uint32_t border;
+    uint32_t levelCount;
+    uint32_t tileCount;
+};
+
+static std::vector<TilePyramid::Level> levelsFor(uint32_t width, uint32_t height) {
+    const uint32_t T = TilePyramid::kTileSize;
+    std::vector<TilePyramid::Level> levels;
+    uint32_t firstTile = 0;
+    for (;;) {
+        TilePyramid::Level level = { width, height, (width + T - 1) / T, (height + T - 1) / T, firstTile };
+        levels.push_back(level);
+        firstTile += level.tilesX * level.tilesY;
+        if (width <= T && height <= T) break;
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+    return levels;
+}
+
+namespace {
+
+// Rows of one level on their way into tiles and into the next level
+struct LevelRows {
+    TilePyramid::Level info;
+    std::vector<uint8_t> rows; // RGBA8 rows [firstRow, firstRow + rowCount)
+    uint32_t firstRow = 0, rowCount = 0;
+    uint32_t nextTileRow = 0;
+    uint32_t nextHalfRow = 0;  // Next row of the following level to produce
+
+    const uint8_t* row(uint32_t y) const { return rows.data() + (size_t)(y - firstRow) * info.width * 4; }
+};
+
+class PyramidWriter {
+public:
+    PyramidWriter(std::ofstream& out, uint64_t dataOffset, const std::vector<TilePyramid::Level>& levels, unsigned threadCount)
+        : out(out), offset(dataOffset), pool(ThreadPool::resolveThreadCount((int)threadCount)) {
+        for (const TilePyramid::Level& level : levels) {
+            LevelRows rows;
+            rows.info = level;
+            bands.push_back(std::move(rows));
+        }
+        offsets.assign(levels.back().firstTile + levels.back().tilesX * levels.back().tilesY, 0);
+    }
+
+    // Appends rowCount rows to a level, writes every tile row they complete and halves them into
+    // the next level
+    bool push(size_t levelIndex, const uint8_t* rgba, uint32_t rowCount) {
+        LevelRows& level = bands[levelIndex];
+        const uint32_t T = TilePyramid::kTileSize, B = TilePyramid::kBorder;
+        const uint32_t width = level.info.width, height = level.info.height;
+        level.rows.insert(level.rows.end(), rgba, rgba + (size_t)rowCount * width * 4);
+        level.rowCount += rowCount;
+        const uint32_t available = level.firstRow + level.rowCount;
+        while (level.nextTileRow < level.info.tilesY && available >= std::min(height, (level.nextTileRow + 1) * T + B)) {
+            if (!writeTileRow(level)) return false;
+            ++level.nextTileRow;
+        }
+        uint32_t keep = level.nextTileRow < level.info.tilesY ? std::max(level.nextTileRow * T, B) - B : height;
+        if (levelIndex + 1 < bands.size()) {
+            // 2x2 box filter, the last row/column of odd sizes is reused
+            const uint32_t halfWidth = bands[levelIndex + 1].info.width, halfHeight = bands[levelIndex + 1].info.height;
+            std::vector<uint8_t> half;
+            uint32_t halfRows = 0;
+            while (level.nextHalfRow < halfHeight && std::min(2 * level.nextHalfRow + 1, height - 1) < available) {
+                const uint8_t* row0 = level.row(2 * level.nextHalfRow);
+                const uint8_t* row1 = level.row(std::min(2 * level.nextHalfRow + 1, height - 1));
+                size_t base = half.size();
+                half.resize(base + (size_t)halfWidth * 4);
+                for (uint32_t x = 0; x < halfWidth; ++x) {
+                    const uint32_t x0 = 2 * x * 4, x1 = std::min(2 * x + 1, width - 1) * 4;
+                    for (int c = 0; c < 4; ++c)
+                        half[base + x * 4 + c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+                }
+                ++level.nextHalfRow;
+                ++halfRows;
+            }
+            keep = std::min(keep, 2 * level.nextHalfRow);
+            if (halfRows && !push(levelIndex + 1, half.data(), halfRows)) return false;
+        }
+        if (keep > level.firstRow) {
+            uint32_t drop = std::min(keep, available) - level.firstRow;
+            level.rows.erase(level.rows.begin(), level.rows.begin() + (size_t)drop * width * 4);
+            level.firstRow += drop;
+            level.rowCount -= drop;
+        }
+        return true;
+    }
+
+    bool complete() const {
+        for (const LevelRows& level : bands)
+            if (level.nextTileRow != level.info.tilesY) return false;
+        return true;
+    }
+
+    std::vector<uint64_t> offsets;
+
+private:
+    std::ofstream& out;
+    uint64_t offset;
+    ThreadPool pool;
+    std::vector<LevelRows> bands;
+    std::vector<uint8_t> tileRow;
+
+    bool writeTileRow(const LevelRows& level) {
+        const int T = (int)TilePyramid::kTileSize, B = (int)TilePyramid::kBorder;
+        const int blocksPerSide = (int)TilePyramid::storedTileTexels() / 4;
+        const size_t tileBytes = TilePyramid::storedTileBytes();
+        const int width = (int)level.info.width, height = (int)level.info.height;
+        const int ty = (int)level.nextTileRow;
+        tileRow.resize(tileBytes * level.info.tilesX);
+        pool.parallelFor(level.info.tilesX, [&](size_t tx) {
+            uint8_t pixels[16][4];
+            uint8_t* blocks = tileRow.data() + tx * tileBytes;
+            for (int by = 0; by < blocksPerSide; ++by) {
+                for (int bx = 0; bx < blocksPerSide; ++bx) {
+                    for (int i = 0; i < 16; ++i) {
+                        int x = std::clamp((int)tx * T - B + bx * 4 + i % 4, 0, width - 1);
+                        int y = std::clamp(ty * T - B + by * 4 + i / 4, 0, height - 1);
+                        std::memcpy(pixels[i], level.row((uint32_t)y) + (size_t)x * 4, 4);
+                    }
+                    encodeBc1Block(pixels, blocks + ((size_t)by * blocksPerSide + bx) * 8);
+                }
+            }
+        });
+        for (uint32_t tx = 0; tx < level.info.tilesX; ++tx) offsets[level.info.firstTile + ty * level.info.tilesX + tx] = offset + tx * tileBytes;
+        out.write(reinterpret_cast<const char*>(tileRow.data()), (std::streamsize)tileRow.size());
+        offset += tileRow.size();
+        return out.good();
+    }
+};
+
+} // namespace
+
+bool TilePyramid::build(const std::string& path, uint32_t width, uint32_t height, const RowReader& read, unsigned threadCount) {
+    if (width == 0 || height == 0) return false;
+    std::vector<Level> levels = levelsFor(width, height);
+    PyramidHeader header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.tileSize = kTileSize;
+    header.border = kBorder;
+    header.levelCount = (uint32_t)levels.size();
+    header.tileCount = levels.back().firstTile + levels.back().tilesX * levels.back().tilesY;
+    const uint64_t tableOffset = sizeof(header) + levels.size() * sizeof(Level);
+    const uint64_t dataOffset = tableOffset + header.tileCount * sizeof(uint64_t);
+
+    return writeFileAtomically(path, "tile pyramid", [&](std::ofstream& out) {
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(levels.data()), (std::streamsize)(levels.size() * sizeof(Level)));
+        std::vector<uint64_t> placeholder(header.tileCount, 0);
+        out.write(reinterpret_cast<const char*>(placeholder.data()), (std::streamsize)(placeholder.size() * sizeof(uint64_t)));
+
+        PyramidWriter writer(out, dataOffset, levels, threadCount);
+        const uint32_t rowsPerRead = 64;
+        std::vector<uint8_t> chunk;
+        bool ok = out.good();
+        for (uint32_t y = 0; ok && y < height; y += rowsPerRead) {
+            uint32_t rows = std::min(rowsPerRead, height - y);
+            chunk.resize((size_t)rows * width * 4);
+            ok = read(y, rows, chunk.data()) && writer.push(0, chunk.data(), rows);
+        }
+        if (!ok || !writer.complete()) return false;
+        out.seekp((std::streamoff)tableOffset);
+        out.write(reinterpret_cast<const char*>(writer.offsets.data()), (std::streamsize)(writer.offsets.size() * sizeof(uint64_t)));
+        return true;
+    });
+}
+
+bool TilePyramid::buildFromImages(const std::string& path, const std::vector<std::string>& images, uint32_t columns,
+                                  unsigned threadCount) {
+    if (images.empty() || columns == 0 || images.size() % columns != 0) {
+        std::cerr << "Tile pyramid mosaic needs rows of " << columns << " images" << std::endl;
+        return false;
+    }
+    const size_t rowCount = images.size() / columns;
+    std::vector<uint32_t> columnWidths(columns), rowHeights(rowCount);
+    for (size_t i = 0; i < images.size(); ++i) {
+        int w = 0, h = 0;
+        if (!readImageSize(images[i], w, h)) {
+            std::cerr << "Failed to load texture: " << images[i] << std::endl;
+            return false;
+        }
+        uint32_t& columnWidth = columnWidths[i % columns];
+        uint32_t& rowHeight = rowHeights[i / columns];
+        if ((columnWidth && columnWidth != (uint32_t)w) || (rowHeight && rowHeight != (uint32_t)h)) {
+            std::cerr << "Mosaic image does not line up with its row and column: " << images[i] << std::endl;
+            return false;
+        }
+        columnWidth = (uint32_t)w;
+        rowHeight = (uint32_t)h;
+    }
+    uint32_t width = 0, height = 0;
+    for (uint32_t w : columnWidths) width += w;
+    for (uint32_t h : rowHeights) height += h;
+
+    // Rows are read top to bottom, so only the images of the current mosaic row are kept decoded
+    std::vector<DecodedImage> decoded(columns);
+    size_t decodedRow = (size_t)-1;
+    auto read = [&](uint32_t y, uint32_t rows, uint8_t* rgba) {
+        for (uint32_t r = 0; r < rows; ++r, ++y) {
+            size_t mosaicRow = 0;
+            uint32_t rowTop = 0;
+            while (y >= rowTop + rowHeights[mosaicRow]) rowTop += rowHeights[mosaicRow++];
+            if (mosaicRow != decodedRow) {
+                for (uint32_t c = 0; c < columns; ++c) {
+                    decoded[c] = DecodedImage();
+                    const std::string& image = images[mosaicRow * columns + c];
+                    if (!decodeImage(image, false, decoded[c])) {
+                        std::cerr << "Failed to load texture: " << image << std::endl;
+                        return false;
+                    }
+                }
+                decodedRow = mosaicRow;
+            }
+            uint8_t* out = rgba + (size_t)r * width * 4;
+            for (uint32_t c = 0; c < columns; ++c) {
+                const size_t rowBytes = (size_t)columnWidths[c] * 4;
+                std::memcpy(out, decoded[c].pixels.get() + (y - rowTop) * rowBytes, rowBytes);
+                out += rowBytes;
+            }
+        }
+        return true;
+    };
+    return build(path, width, height, read, threadCount);
+}
+
+bool TilePyramid::open(const std::string& pyramidPath) {
+    levels.clear();
+    tileOffsets.clear();
+    std::ifstream in(pyramidPath, std::ios::binary);
+    PyramidHeader header = {};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kVersion || header.tileSize != kTileSize || header.border != kBorder ||
+        header.levelCount == 0 || header.levelCount > 32) {
+        std::cerr << "Not a tile pyramid: " << pyramidPath << std::endl;
+        return false;
+    }
+    // The tables must fit in the file before anything is sized from the counts it claims
+    std::error_code ec;
+    const uint64_t fileSize = (uint64_t)fs::file_size(pyramidPath, ec);
+    if (ec || sizeof(header) + (uint64_t)header.levelCount * sizeof(Level) + (uint64_t)header.tileCount * sizeof(uint64_t) > fileSize) {
+        std::cerr << "Corrupt tile pyramid: " << pyramidPath << std::endl;
+        return false;
+    }
+    std::vector<Level> stored(header.levelCount);
+    std::vector<uint64_t> offsets(header.tileCount);
+    in.read(reinterpret_cast<char*>(stored.data()), (std::streamsize)(stored.size() * sizeof(Level)));
+    in.read(reinterpret_cast<char*>(offsets.data()), (std::streamsize)(offsets.size() * sizeof(uint64_t)));
+    // The levels must be the ones the builder derives from the full size, every tile inside the file
+    bool valid = in.good() && stored[0].width > 0 && stored[0].height > 0;
+    if (valid) {
+        std::vector<Level> expected = levelsFor(stored[0].width, stored[0].height);
+        valid = expected.size() == stored.size() && std::memcmp(expected.data(), stored.data(), stored.size() * sizeof(Level)) == 0 &&
+                expected.back().firstTile + expected.back().tilesX * expected.back().tilesY == header.tileCount;
+    }
+    for (size_t i = 0; valid && i < offsets.size(); ++i) valid = offsets[i] <= fileSize && storedTileBytes() <= fileSize - offsets[i];
+    if (!valid) {
+        std::cerr << "Corrupt tile pyramid: " << pyramidPath << std::endl;
+        return false;
+    }
+    path = pyramidPath;
+    levels = std::move(stored);
+    tileOffsets = std::move(offsets);
+    return true;
+}
+
+bool TilePyramid::readTile(uint32_t index, std::vector<uint8_t>& blocks) const {
+    if (index >= tileOffsets.size()) return false;
+    std::ifstream in(path, std::ios::binary);
+    blocks.resize(storedTileBytes());
+    in.seekg((std::streamoff)tileOffsets[index]);
+    return (bool)in.read(reinterpret_cast<char*>(blocks.data()), (std::streamsize)blocks.size());
+}
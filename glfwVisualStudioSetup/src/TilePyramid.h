@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Basemap too large for one texture, pre-cut into a tile pyramid (.ptp). Level 0 is the full image,
+// each next level halves the one before (rounding up) until the image fits in a single tile. A
+// stored tile holds kTileSize x kTileSize texels plus a kBorder frame copied from its neighbours
+// (clamped at the image edge) so bilinear filtering never reaches into another tile, as BC1 blocks
+// with the top row first. The header and a table of tile offsets come first, then the tiles.
+class TilePyramid {
+public:
+    static const uint32_t kTileSize = 256;
+    static const uint32_t kBorder = 4; // Keeps the stored tile a whole number of BC1 blocks
+
+    struct Level {
+        uint32_t width, height; // Texels
+        uint32_t tilesX, tilesY;
+        uint32_t firstTile;     // Index of tile (0, 0), tiles are row by row
+    };
+
+    // Fills rows [y, y + rows) of the full image, RGBA8 with the top row first
+    using RowReader = std::function<bool(uint32_t y, uint32_t rows, uint8_t* rgba)>;
+
+    // Cuts a width x height image into a pyramid at path. The image is pulled through read from
+    // top to bottom and every level only keeps the rows of its current tile row, so memory stays
+    // a few tile rows of the widest level whatever the image size. Tiles are compressed on
+    // threadCount workers (0 = all hardware threads).
+    static bool build(const std::string& path, uint32_t width, uint32_t height, const RowReader& read,
+                      unsigned threadCount = 0);
+    // build() over a mosaic of images, row by row with columns images per row (all images of a row
+    // share their height, all images of a column their width). One row of images is decoded at a time.
+    static bool buildFromImages(const std::string& path, const std::vector<std::string>& images, uint32_t columns,
+                                unsigned threadCount = 0);
+
+    // Reads the header and tile table (no GL, any thread)
+    bool open(const std::string& path);
+    bool isOpen() const { return !levels.empty(); }
+    uint32_t width() const { return levels.empty() ? 0 : levels[0].width; }
+    uint32_t height() const { return levels.empty() ? 0 : levels[0].height; }
+    uint32_t levelCount() const { return (uint32_t)levels.size(); }
+    const Level& level(uint32_t index) const { return levels[index]; }
+    uint32_t tileCount() const { return (uint32_t)tileOffsets.size(); }
+    uint32_t tileIndex(uint32_t level, uint32_t x, uint32_t y) const {
+        return levels[level].firstTile + y * levels[level].tilesX + x;
+    }
+
+    static uint32_t storedTileTexels() { return kTileSize + 2 * kBorder; }
+    static size_t storedTileBytes() { return (size_t)(storedTileTexels() / 4) * (storedTileTexels() / 4) * 8; }
+
+    // Reads the BC1 blocks of one tile; safe to call from several threads at once
+    bool readTile(uint32_t index, std::vector<uint8_t>& blocks) const;
+
+private:
+    std::string path;
+    std::vector<Level> levels;
+    std::vector<uint64_t> tileOffsets;
+};
@@ -0,0 +1,434 @@
+#include "VirtualTexture.h"
+#include "CompressedTexture.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+void TileCache::setBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    limit = bytes;
+    evict();
+}
+
+TileCache::Tile TileCache::find(uint32_t tile) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(tile);
+    if (it == entries.end()) return nullptr;
+    order.splice(order.begin(), order, it->second.position);
+    return it->second.data;
+}
+
+void TileCache::insert(uint32_t tile, Tile data) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(tile);
+    if (it != entries.end()) {
+        used -= it->second.data->size();
+        order.erase(it->second.position);
+        entries.erase(it);
+    }
+    used += data->size();
+    order.push_front(tile);
+    entries[tile] = { std::move(data), order.begin() };
+    evict();
+}
+
+size_t TileCache::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return used;
+}
+
+size_t TileCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+void TileCache::evict() {
+    while (used > limit && !order.empty()) {
+        auto it = entries.find(order.back());
+        used -= it->second.data->size();
+        entries.erase(it);
+        order.pop_back();
+    }
+}
+
+// Compiled before the fragment shaders that sample the virtual texture or write its feedback
+const char* const VirtualTexture::kGlsl = R"(#version 330 core
+uniform usampler2D uPageTable;
+uniform sampler2D uTileAtlas;
+uniform vec4 uVirtualLayout; // level-0 width, height, tile size, tile border (texels)
+uniform vec4 uVirtualAtlas;  // atlas width, height (texels), level count, LOD bias
+
+// Level-0 texel position, top row first like the pyramid
+vec2 virtualTexel(vec2 uv) {
+    return clamp(vec2(uv.x, 1.0 - uv.y), 0.0, 1.0) * uVirtualLayout.xy;
+}
+int virtualLevel(vec2 texel) {
+    vec2 dx = dFdx(texel), dy = dFdy(texel);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + uVirtualAtlas.w;
+    return clamp(int(floor(lod + 0.5)), 0, int(uVirtualAtlas.z) - 1);
+}
+ivec2 virtualTile(vec2 texel, int level) {
+    return ivec2(min(texel, uVirtualLayout.xy - 0.5) / (exp2(float(level)) * uVirtualLayout.z));
+}
+vec4 sampleVirtual(vec2 uv) {
+    vec2 texel = virtualTexel(uv);
+    int level = virtualLevel(texel);
+    ivec2 tile = virtualTile(texel, level);
+    // The page entry is the tile's slot, or the slot of the ancestor standing in for it
+    uvec4 page = texelFetch(uPageTable, tile, level);
+    int resident = int(page.b);
+    vec2 inTile = texel / exp2(float(resident)) - vec2(tile >> (resident - level)) * uVirtualLayout.z;
+    vec2 atlasTexel = vec2(page.rg) * (uVirtualLayout.z + 2.0 * uVirtualLayout.w) + uVirtualLayout.w + inTile;
+    return texture(uTileAtlas, atlasTexel / uVirtualAtlas.xy);
+}
+// Level (5 bits), row (13) and column (14) of the tile uv needs
+uint virtualTileId(vec2 uv) {
+    vec2 texel = virtualTexel(uv);
+    int level = virtualLevel(texel);
+    ivec2 tile = virtualTile(texel, level);
+    return uint(level) << 27 | uint(tile.y) << 14 | uint(tile.x);
+}
+)";
+
+static const uint32_t kNoTile = 0xFFFFFFFFu;
+// Widest and tallest level 0 the feedback ids above can name
+static const uint32_t kMaxTilesX = 1u << 14, kMaxTilesY = 1u << 13;
+
+static uint32_t nextPowerOfTwo(uint32_t value) {
+    uint32_t power = 1;
+    while (power < value) power *= 2;
+    return power;
+}
+
+static uint32_t packPage(uint32_t slotX, uint32_t slotY, uint32_t level) {
+    return slotX | slotY << 8 | level << 16 | 0xFFu << 24;
+}
+
+// BC1 tile to RGBA8, for GLs without S3TC
+static std::vector<uint8_t> decodeTile(const std::vector<uint8_t>& blocks) {
+    const uint32_t side = TilePyramid::storedTileTexels(), blocksPerSide = side / 4;
+    std::vector<uint8_t> rgba((size_t)side * side * 4);
+    uint8_t pixels[64];
+    for (uint32_t by = 0; by < blocksPerSide; ++by) {
+        for (uint32_t bx = 0; bx < blocksPerSide; ++bx) {
+            decodeBc1Block(blocks.data() + ((size_t)by * blocksPerSide + bx) * 8, pixels);
+            for (uint32_t row = 0; row < 4; ++row)
+                std::memcpy(&rgba[(((size_t)by * 4 + row) * side + bx * 4) * 4], pixels + row * 16, 16);
+        }
+    }
+    return rgba;
+}
+
+VirtualTexture::~VirtualTexture() {
+    closing = true;
+    loaders.reset();
+    if (pageTable) glDeleteTextures(1, &pageTable);
+    if (atlas) glDeleteTextures(1, &atlas);
+    if (feedbackFbo) glDeleteFramebuffers(1, &feedbackFbo);
+    if (feedbackColor) glDeleteRenderbuffers(1, &feedbackColor);
+    if (feedbackDepth) glDeleteRenderbuffers(1, &feedbackDepth);
+    if (feedbackPbos[0]) glDeleteBuffers(2, feedbackPbos);
+}
+
+bool VirtualTexture::open(const TilePyramid& source, const VirtualTextureSettings& settings) {
+    if (isOpen() || !source.isOpen()) return false;
+    if (source.level(0).tilesX >= kMaxTilesX || source.level(0).tilesY >= kMaxTilesY) {
+        std::cerr << "Tile pyramid is too large for a virtual texture: " << source.level(0).tilesX << " x "
+                  << source.level(0).tilesY << " tiles (at most " << kMaxTilesX - 1 << " x " << kMaxTilesY - 1 << ")"
+                  << std::endl;
+        return false;
+    }
+    pyramid = source;
+    config = settings;
+    compressed = CompressedTexture::isFormatSupported();
+    // The coarsest level is one tile that is never evicted
+    const uint32_t topTile = pyramid.tileCount() - 1;
+    std::vector<uint8_t> top;
+    if (!pyramid.readTile(topTile, top)) {
+        std::cerr << "Failed to read tile pyramid" << std::endl;
+        return false;
+    }
+    if (!compressed) top = decodeTile(top);
+
+    // Physical tile atlas: a grid of slots, at most 256 per side so a page entry holds one in two bytes
+    const uint32_t side = TilePyramid::storedTileTexels();
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    const uint32_t maxSlotsPerSide = std::min<uint32_t>(256, (uint32_t)maxTextureSize / side);
+    uint32_t slotCount = std::clamp<uint32_t>(settings.physicalTiles, 2, maxSlotsPerSide * maxSlotsPerSide);
+    slotsPerRow = std::min(maxSlotsPerSide, (uint32_t)std::ceil(std::sqrt((double)slotCount)));
+    const uint32_t slotRows = (slotCount + slotsPerRow - 1) / slotsPerRow;
+    atlasWidth = slotsPerRow * side;
+    atlasHeight = slotRows * side;
+    slots.assign(slotCount, Slot());
+    glGenTextures(1, &atlas);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    if (compressed) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, (GLsizei)atlasWidth, (GLsizei)atlasHeight, 0,
+                               (GLsizei)((size_t)atlasWidth * atlasHeight / 2), nullptr);
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, (GLsizei)atlasWidth, (GLsizei)atlasHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // Page table: level 0 rounded up to powers of two, so mip L has room for every tile of level L
+    // and the mip chain ends with the single top tile
+    const uint32_t levelCount = pyramid.levelCount();
+    const uint32_t pageWidth = nextPowerOfTwo(pyramid.level(0).tilesX), pageHeight = nextPowerOfTwo(pyramid.level(0).tilesY);
+    glGenTextures(1, &pageTable);
+    glBindTexture(GL_TEXTURE_2D, pageTable);
+    pageLevels.resize(levelCount);
+    pageWidths.resize(levelCount);
+    pageHeights.resize(levelCount);
+    for (uint32_t level = 0; level < levelCount; ++level) {
+        pageWidths[level] = std::max(pageWidth >> level, 1u);
+        pageHeights[level] = std::max(pageHeight >> level, 1u);
+        pageLevels[level].assign((size_t)pageWidths[level] * pageHeights[level], 0);
+        glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_RGBA8UI, (GLsizei)pageWidths[level], (GLsizei)pageHeights[level], 0,
+                     GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, pageLevels[level].data());
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    tileSlot.assign(pyramid.tileCount(), -1);
+    const size_t tileBytes = top.size();
+    cache.setBudget(std::max(settings.cacheBytes, (size_t)std::max(settings.uploadsPerFrame, 1u) * tileBytes));
+    loaders = std::make_unique<ThreadPool>(std::max(settings.loaderThreads, 1u));
+    uploadTile(topTile, top);
+    slots[tileSlot[topTile]].lastUsed = UINT64_MAX;
+    stats = VirtualTextureStats();
+    rebuildPageTable();
+    return true;
+}
+
+void VirtualTexture::setUniforms(GLuint program, bool feedback) const {
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "uPageTable"), 0);
+    glUniform1i(glGetUniformLocation(program, "uTileAtlas"), 1);
+    glUniform4f(glGetUniformLocation(program, "uVirtualLayout"), (float)pyramid.width(), (float)pyramid.height(),
+                (float)TilePyramid::kTileSize, (float)TilePyramid::kBorder);
+    float lodBias = feedback ? -std::log2((float)std::max(config.feedbackDivisor, 1u)) : 0.0f;
+    glUniform4f(glGetUniformLocation(program, "uVirtualAtlas"), (float)atlasWidth, (float)atlasHeight,
+                (float)pyramid.levelCount(), lodBias);
+    glUseProgram(0);
+}
+
+void VirtualTexture::bindTextures() const {
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, pageTable);
+}
+
+void VirtualTexture::beginFeedback(int viewportWidth, int viewportHeight) {
+    const int divisor = (int)std::max(config.feedbackDivisor, 1u);
+    const int width = std::max(viewportWidth / divisor, 1), height = std::max(viewportHeight / divisor, 1);
+    if (!feedbackFbo) {
+        glGenFramebuffers(1, &feedbackFbo);
+        glGenRenderbuffers(1, &feedbackColor);
+        glGenRenderbuffers(1, &feedbackDepth);
+        glGenBuffers(2, feedbackPbos);
+    }
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &savedFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFbo);
+    if (width != feedbackWidth || height != feedbackHeight) {
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackColor);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_R32UI, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, feedbackColor);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        feedbackWidth = width;
+        feedbackHeight = height;
+    }
+    glViewport(0, 0, width, height);
+    const GLuint noTile[4] = { kNoTile, kNoTile, kNoTile, kNoTile };
+    const GLfloat farDepth = 1.0f;
+    glClearBufferuiv(GL_COLOR, 0, noTile);
+    glClearBufferfv(GL_DEPTH, 0, &farDepth);
+    viewport[0] = viewportWidth;
+    viewport[1] = viewportHeight;
+}
+
+void VirtualTexture::endFeedback() {
+    // Read into a buffer object: the copy completes on the GPU and is mapped two passes later
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackPbos[nextPbo]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)feedbackWidth * feedbackHeight * 4, nullptr, GL_STREAM_READ);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    pboSizes[nextPbo][0] = feedbackWidth;
+    pboSizes[nextPbo][1] = feedbackHeight;
+    nextPbo ^= 1;
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)savedFramebuffer);
+    glViewport(0, 0, viewport[0], viewport[1]);
+}
+
+void VirtualTexture::update() {
+    if (!isOpen()) return;
+    ++frame;
+    // The older of the two feedback buffers, about to be reused by this frame's pass
+    int* size = pboSizes[nextPbo];
+    if (size[0] > 0) {
+        std::unordered_map<uint32_t, uint32_t> wanted; // Tile id from the shader -> pixels
+        const size_t count = (size_t)size[0] * size[1];
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackPbos[nextPbo]);
+        const uint32_t* ids = static_cast<const uint32_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)(count * 4), GL_MAP_READ_BIT));
+        if (ids) {
+            for (size_t i = 0; i < count; ++i)
+                if (ids[i] != kNoTile) ++wanted[ids[i]];
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        size[0] = size[1] = 0;
+
+        // Every wanted tile brings its ancestors, so a blurrier stand-in streams in first
+        std::unordered_map<uint32_t, Request> requested;
+        for (const auto& [id, pixels] : wanted) {
+            uint32_t level = id >> 27, y = (id >> 14) & 0x1FFF, x = id & 0x3FFF;
+            if (level >= pyramid.levelCount() || x >= pyramid.level(level).tilesX || y >= pyramid.level(level).tilesY) continue;
+            for (; level < pyramid.levelCount(); ++level, x /= 2, y /= 2) {
+                Request& request = requested[pyramid.tileIndex(level, x, y)];
+                request.level = level;
+                request.pixels += pixels;
+            }
+        }
+        requests.clear();
+        for (auto& [tile, request] : requested) {
+            request.tile = tile;
+            requests.push_back(request);
+        }
+        std::sort(requests.begin(), requests.end(), [](const Request& a, const Request& b) {
+            return a.level != b.level ? a.level > b.level : a.pixels > b.pixels;
+        });
+    }
+
+    // Keep what is in view, then upload what has arrived and queue reads for the rest
+    std::vector<uint32_t> missing;
+    for (const Request& request : requests) {
+        int32_t slot = tileSlot[request.tile];
+        if (slot >= 0) slots[slot].lastUsed = std::max(slots[slot].lastUsed, frame);
+        else missing.push_back(request.tile);
+    }
+    uint32_t uploads = 0;
+    for (uint32_t tile : missing) {
+        TileCache::Tile data = cache.find(tile);
+        if (!data) {
+            requestTile(tile);
+        } else if (uploads < config.uploadsPerFrame) {
+            if (!uploadTile(tile, *data)) break; // Every slot holds a tile in view
+            ++uploads;
+        }
+    }
+    stats.requested = requests.size();
+    stats.missing = missing.size() - uploads;
+    if (pageTableDirty) rebuildPageTable();
+}
+
+void VirtualTexture::requestTile(uint32_t tile) {
+    std::lock_guard<std::mutex> lock(loadMutex);
+    if (loading.count(tile) || failed.count(tile) || loading.size() >= 8 * loaders->size()) return;
+    loading.insert(tile);
+    loaders->submit([this, tile]() {
+        bool ok = true;
+        if (!closing) {
+            std::vector<uint8_t> blocks;
+            ok = pyramid.readTile(tile, blocks);
+            if (ok) {
+                cache.insert(tile, std::make_shared<const std::vector<uint8_t>>(compressed ? std::move(blocks) : decodeTile(blocks)));
+                ++loads;
+            }
+        }
+        std::lock_guard<std::mutex> lock(loadMutex);
+        loading.erase(tile);
+        if (!ok) failed.insert(tile);
+    });
+}
+
+bool VirtualTexture::uploadTile(uint32_t tile, const std::vector<uint8_t>& data) {
+    // A free slot, otherwise the least recently used one not needed this frame
+    int best = -1;
+    for (size_t i = 0; i < slots.size(); ++i) {
+        if (slots[i].tile < 0) {
+            best = (int)i;
+            break;
+        }
+        if (slots[i].lastUsed < frame && (best < 0 || slots[i].lastUsed < slots[best].lastUsed)) best = (int)i;
+    }
+    if (best < 0) return false;
+    Slot& slot = slots[best];
+    if (slot.tile >= 0) {
+        tileSlot[slot.tile] = -1;
+        ++stats.evictions;
+    }
+    slot.tile = (int32_t)tile;
+    slot.lastUsed = frame;
+    tileSlot[tile] = best;
+
+    const GLint side = (GLint)TilePyramid::storedTileTexels();
+    const GLint x = (best % (int)slotsPerRow) * side, y = (best / (int)slotsPerRow) * side;
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    if (compressed) {
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, side, side, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, (GLsizei)data.size(), data.data());
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, side, side, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+    }
+    ++stats.uploads;
+    pageTableDirty = true;
+    return true;
+}
+
+void VirtualTexture::rebuildPageTable() {
+    // Coarsest first: a tile without a slot of its own inherits its parent's entry
+    glBindTexture(GL_TEXTURE_2D, pageTable);
+    for (uint32_t level = pyramid.levelCount(); level-- > 0;) {
+        const TilePyramid::Level& info = pyramid.level(level);
+        std::vector<uint32_t>& page = pageLevels[level];
+        bool changed = false;
+        for (uint32_t y = 0; y < info.tilesY; ++y) {
+            for (uint32_t x = 0; x < info.tilesX; ++x) {
+                int32_t slot = tileSlot[pyramid.tileIndex(level, x, y)];
+                uint32_t entry = slot >= 0 ? packPage((uint32_t)slot % slotsPerRow, (uint32_t)slot / slotsPerRow, level)
+                                           : pageLevels[level + 1][(size_t)(y / 2) * pageWidths[level + 1] + x / 2];
+                uint32_t& current = page[(size_t)y * pageWidths[level] + x];
+                changed = changed || current != entry;
+                current = entry;
+            }
+        }
+        if (changed) {
+            glTexSubImage2D(GL_TEXTURE_2D, (GLint)level, 0, 0, (GLsizei)pageWidths[level], (GLsizei)pageHeights[level],
+                            GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, page.data());
+        }
+    }
+    pageTableDirty = false;
+}
+
+VirtualTextureStats VirtualTexture::getStats() const {
+    VirtualTextureStats result = stats;
+    result.physicalTiles = slots.size();
+    for (const Slot& slot : slots) {
+        if (slot.tile < 0) continue;
+        ++result.residentTiles;
+        int level = 0;
+        while (level + 1 < (int)pyramid.levelCount() && (uint32_t)slot.tile >= pyramid.level(level + 1).firstTile) ++level;
+        if (result.finestLevel < 0 || level < result.finestLevel) result.finestLevel = level;
+    }
+    result.cachedTiles = cache.size();
+    result.cacheBytes = cache.bytes();
+    result.cacheBudget = cache.budget();
+    {
+        std::lock_guard<std::mutex> lock(loadMutex);
+        result.loading = loading.size();
+    }
+    result.loads = loads;
+    result.gpuBytes = compressed ? (size_t)atlasWidth * atlasHeight / 2 : (size_t)atlasWidth * atlasHeight * 4;
+    for (const std::vector<uint32_t>& page : pageLevels) result.gpuBytes += page.size() * 4;
+    return result;
+}
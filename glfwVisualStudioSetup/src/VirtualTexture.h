@@ -0,0 +1,140 @@
+#pragma once
+#include "TilePyramid.h"
+#include "ThreadPool.h"
+#include <glad/glad.h>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Thread-safe LRU of loaded tiles, ready for upload, that evicts down to a byte budget
+class TileCache {
+public:
+    using Tile = std::shared_ptr<const std::vector<uint8_t>>;
+
+    explicit TileCache(size_t budgetBytes = 0) : limit(budgetBytes) {}
+    void setBudget(size_t bytes);
+    size_t budget() const { return limit; }
+
+    // Returns null if the tile is not cached, otherwise marks it most recently used
+    Tile find(uint32_t tile);
+    void insert(uint32_t tile, Tile data);
+    size_t bytes() const;
+    size_t size() const;
+
+private:
+    struct Entry {
+        Tile data;
+        std::list<uint32_t>::iterator position;
+    };
+    mutable std::mutex mutex;
+    std::list<uint32_t> order; // Most recently used first
+    std::unordered_map<uint32_t, Entry> entries;
+    size_t used = 0;
+    size_t limit;
+
+    void evict();
+};
+
+struct VirtualTextureSettings {
+    size_t cacheBytes = (size_t)128 << 20; // Loaded tiles kept in memory
+    uint32_t physicalTiles = 256;          // Tiles resident on the GPU at once
+    unsigned loaderThreads = 2;
+    uint32_t uploadsPerFrame = 16;
+    uint32_t feedbackDivisor = 8;          // The feedback pass renders at 1/divisor of the viewport
+};
+
+struct VirtualTextureStats {
+    size_t residentTiles = 0, physicalTiles = 0;
+    size_t cachedTiles = 0, cacheBytes = 0, cacheBudget = 0;
+    size_t loading = 0;   // Tile reads queued or running
+    size_t requested = 0; // Tiles the last feedback asked for, with their ancestors
+    size_t missing = 0;   // ... of which not resident yet
+    uint64_t loads = 0, uploads = 0, evictions = 0;
+    size_t gpuBytes = 0;  // Physical tile cache and page table
+    int finestLevel = -1; // Finest level with a resident tile
+};
+
+// Virtual texture over a TilePyramid: GPU memory is a fixed atlas of physical tile slots plus a page
+// table (one texel per tile, one mip per pyramid level) pointing every tile at its slot, or at the
+// slot of its nearest resident ancestor. Each frame a feedback pass renders, at a fraction of the
+// viewport, which tile every pixel wants; update() reads it back a couple of frames later, has the
+// missing tiles read on loader threads into a TileCache and uploads the ones that arrived. The
+// coarsest level is a single tile that stays resident, so every lookup resolves.
+class VirtualTexture {
+public:
+    // Fragment shader helpers (with the #version line): sampleVirtual(uv) and virtualTileId(uv)
+    static const char* const kGlsl;
+
+    VirtualTexture() = default;
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+    ~VirtualTexture();
+
+    // Needs a current GL context; pyramid must be open
+    bool open(const TilePyramid& pyramid, const VirtualTextureSettings& settings);
+    bool isOpen() const { return pageTable != 0; }
+    const TilePyramid& getPyramid() const { return pyramid; }
+
+    // Points a linked program's samplers and layout uniforms at this texture. The feedback
+    // program passes the log2 of the feedback divisor as a negative LOD bias.
+    void setUniforms(GLuint program, bool feedback) const;
+    // Binds the page table to unit 0 and the tile atlas to unit 1
+    void bindTextures() const;
+
+    // Feedback pass: everything drawn in between writes the tile it needs
+    void beginFeedback(int viewportWidth, int viewportHeight);
+    void endFeedback();
+    // Reads back an earlier feedback pass, queues the missing tiles and uploads loaded ones
+    void update();
+
+    VirtualTextureStats getStats() const;
+
+private:
+    struct Slot {
+        int32_t tile = -1;
+        uint64_t lastUsed = 0;
+    };
+    struct Request {
+        uint32_t tile = 0, level = 0, pixels = 0;
+    };
+
+    TilePyramid pyramid;
+    VirtualTextureSettings config;
+    bool compressed = false;
+    GLuint pageTable = 0, atlas = 0;
+    uint32_t slotsPerRow = 0, atlasWidth = 0, atlasHeight = 0;
+    std::vector<Slot> slots;
+    std::vector<int32_t> tileSlot;                 // Slot of every pyramid tile, -1 if not resident
+    std::vector<std::vector<uint32_t>> pageLevels; // CPU copy of the page table mips
+    std::vector<uint32_t> pageWidths, pageHeights;
+    bool pageTableDirty = true;
+    uint64_t frame = 1;
+    std::vector<Request> requests;                 // From the last feedback, coarsest level first
+
+    GLuint feedbackFbo = 0, feedbackColor = 0, feedbackDepth = 0;
+    GLuint feedbackPbos[2] = {};
+    int feedbackWidth = 0, feedbackHeight = 0;
+    int pboSizes[2][2] = {};
+    int nextPbo = 0;
+    GLint savedFramebuffer = 0;
+    int viewport[2] = {};
+
+    TileCache cache;
+    mutable std::mutex loadMutex;
+    std::unordered_set<uint32_t> loading, failed;
+    std::atomic<bool> closing{ false };
+    VirtualTextureStats stats;
+    std::atomic<uint64_t> loads{ 0 };
+
+    // Declared last: destroyed (joined) first, while the tasks' state is still alive
+    std::unique_ptr<ThreadPool> loaders;
+
+    void requestTile(uint32_t tile);
+    bool uploadTile(uint32_t tile, const std::vector<uint8_t>& data);
+    void rebuildPageTable();
+};
@@ -7,26 +7,99 @@
 #include <glm/gtc/constants.hpp>
 #include "MapPlane.h"
 #include "PopulationBars.h"
+#include "HoverPicker.h"
+#include "DensityQuadtree.h"
+#include "Benchmarks.h"
+#include "FrameUniforms.h"
+#include "GlCallCounter.h"
+#include "ShaderManager.h"
+#include "StartupTimeline.h"
+#include "ThreadPool.h"
 // ImGui
 #include "imgui.h"
 #include "backends/imgui_impl_glfw.h"
 #include "backends/imgui_impl_opengl3.h"
 #include "Skybox.h"
 #include "imguiThemes.h"
-#include <unordered_map>
-#include <set>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
 
 static void error_callback(int error, const char *description)
 {
 	std::cout << "Error: " << description << "\n";
 }
 
+// Parses the whole of text as a count no larger than max; "5x", "1e6", "-1" and values that overflow
+// are rejected with an error naming option
+template <typename T>
+static bool parseCount(const std::string& option, const char* text, T& value, T max = std::numeric_limits<T>::max())
+{
+	const char* end = text + std::strlen(text);
+	T parsed = 0;
+	std::from_chars_result result = std::from_chars(text, end, parsed);
+	if (!std::isdigit((unsigned char)*text) || result.ec != std::errc() || result.ptr != end || parsed > max) {
+		std::cerr << "Invalid value for " << option << ": " << text << std::endl;
+		return false;
+	}
+	value = parsed;
+	return true;
+}
+
+// Whether the argument after i is meant as a count for the option at i
+static bool nextIsCount(int i, int argc, char** argv)
+{
+	return i + 1 < argc && std::isdigit((unsigned char)argv[i + 1][0]);
+}
+
 constexpr float MAP_WIDTH = 4.592f;
 constexpr float MAP_HEIGHT = 3.196f;
 constexpr float MAP_THICKNESS = 0.02f;
 MapPlane* g_mapPlane = nullptr;
 PopulationBars* g_populationBars = nullptr;
-Skybox skybox;
+
+// Phases of the startup pipeline, the loading screen's progress is measured against it
+constexpr size_t STARTUP_PHASES = 9;
+
+// One frame of the loading screen, shown while the workers decode and parse
+static void drawStartupProgress(GLFWwindow* window, const StartupTimeline& startup)
+{
+	glfwPollEvents();
+	int width, height;
+	glfwGetFramebufferSize(window, &width, &height);
+	glViewport(0, 0, width, height);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	ImGui_ImplOpenGL3_NewFrame();
+	ImGui_ImplGlfw_NewFrame();
+	ImGui::NewFrame();
+	ImGui::SetNextWindowPos(ImVec2(width * 0.5f, height * 0.5f), ImGuiCond_Always, ImVec2(0.5f, 0.5f));
+	ImGui::SetNextWindowSize(ImVec2(360.0f, 0.0f));
+	ImGui::Begin("Loading", nullptr, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse);
+	std::vector<StartupPhase> phases = startup.phases();
+	size_t finished = 0;
+	for (const StartupPhase& phase : phases) {
+		if (phase.end >= 0.0) {
+			++finished;
+			ImGui::Text("%-16s %8.1f ms", phase.name.c_str(), phase.end - phase.start);
+		} else {
+			ImGui::Text("%-16s ...", phase.name.c_str());
+		}
+	}
+	ImGui::ProgressBar((float)finished / STARTUP_PHASES);
+	ImGui::End();
+	ImGui::Render();
+	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+	glfwSwapBuffers(window);
+}
 
 struct CameraState {
 	glm::vec3 position = glm::vec3(0, -4, 2);
@@ -40,18 +113,220 @@ struct CameraState {
 	}
 };
 
-int main()
+int main(int argc, char** argv)
 {
+	// --- Command line ---
+	int loaderThreads = 0;
+	bool useDatasetCache = true;
+	bool useTextureCache = true;
+	std::string basemapPath = "assets/map.png";
+	VirtualTextureSettings tileSettings;
+	bool benchmarkCsv = false;
+	std::string gpuCheckCsv;
+	uint32_t barShapeBenchmarkBars = 0;
+	std::string mapTextureBenchmarkImage;
+	std::string skyboxBenchmarkImage;
+	uint32_t virtualTextureCheckSize[2] = {};
+	std::vector<size_t> benchmarkRowCounts;
+	size_t syntheticRasterCells = 0;
+	bool exportShaders = false;
+	bool startupBenchmark = false;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--loader-threads" && i + 1 < argc) {
+			// 0 uses every hardware thread
+			if (!parseCount(arg, argv[++i], loaderThreads, 1024)) return 1;
+		} else if (arg == "--no-dataset-cache") {
+			useDatasetCache = false;
+		} else if (arg == "--no-texture-cache") {
+			useTextureCache = false;
+		} else if (arg == "--basemap" && i + 1 < argc) {
+			// An image, or a .ptp tile pyramid for basemaps too large for one texture
+			basemapPath = argv[++i];
+		} else if (arg == "--tile-cache-mb" && i + 1 < argc) {
+			size_t megabytes = 0;
+			if (!parseCount(arg, argv[++i], megabytes, std::numeric_limits<size_t>::max() >> 20)) return 1;
+			tileSettings.cacheBytes = megabytes << 20;
+		} else if (arg == "--build-tile-pyramid" && i + 2 < argc) {
+			// --build-tile-pyramid out.ptp [columns] image... (a mosaic of images, row by row)
+			std::string pyramidPath = argv[++i];
+			uint32_t columns = 1;
+			// Only an all-digit argument is a column count, so "2024_world.png" stays an image
+			std::string next = argv[i + 1];
+			if (!next.empty() && std::all_of(next.begin(), next.end(), [](unsigned char c) { return std::isdigit(c); }) &&
+				!parseCount(arg, argv[++i], columns))
+				return 1;
+			std::vector<std::string> images;
+			while (i + 1 < argc && argv[i + 1][0] != '-') images.push_back(argv[++i]);
+			return TilePyramid::buildFromImages(pyramidPath, images, columns, (unsigned)std::max(loaderThreads, 0)) ? 0 : 1;
+		} else if (arg == "--no-shader-cache") {
+			ShaderManager::shared().setCacheDirectory("");
+		} else if (arg == "--startup-benchmark") {
+			// Prints the startup timeline and exits after the first complete frame
+			startupBenchmark = true;
+		} else if (arg == "--export-shaders") {
+			// Writes the built-in shaders to shaders/ for editing; edits are picked up while running
+			exportShaders = true;
+		} else if (arg == "--verify-dataset-cache") {
+			std::string csvPath = "dataset/dataset.csv";
+			if (i + 1 < argc && argv[i + 1][0] != '-') csvPath = argv[++i];
+			return runDatasetCacheCheck(csvPath);
+		} else if (arg == "--verify-gpu-timeline") {
+			gpuCheckCsv = "dataset/dataset.csv";
+			if (i + 1 < argc && argv[i + 1][0] != '-') gpuCheckCsv = argv[++i];
+		} else if (arg == "--benchmark-bar-shapes") {
+			barShapeBenchmarkBars = 200000;
+			if (nextIsCount(i, argc, argv) && !parseCount(arg, argv[++i], barShapeBenchmarkBars)) return 1;
+		} else if (arg == "--verify-virtual-texture") {
+			virtualTextureCheckSize[0] = 16384;
+			virtualTextureCheckSize[1] = 8192;
+			if (nextIsCount(i, argc, argv)) {
+				if (!parseCount(arg, argv[++i], virtualTextureCheckSize[0])) return 1;
+				if (!nextIsCount(i, argc, argv)) {
+					std::cerr << arg << " takes a width and a height" << std::endl;
+					return 1;
+				}
+				if (!parseCount(arg, argv[++i], virtualTextureCheckSize[1])) return 1;
+			}
+		} else if (arg == "--benchmark-skybox") {
+			skyboxBenchmarkImage = "assets/skybox.jpg";
+			if (i + 1 < argc && argv[i + 1][0] != '-') skyboxBenchmarkImage = argv[++i];
+		} else if (arg == "--benchmark-map-texture") {
+			mapTextureBenchmarkImage = "assets/map.png";
+			if (i + 1 < argc && argv[i + 1][0] != '-') mapTextureBenchmarkImage = argv[++i];
+		} else if (arg == "--benchmark-csv-scan") {
+			size_t megabytes = 256;
+			if (nextIsCount(i, argc, argv) && !parseCount(arg, argv[++i], megabytes)) return 1;
+			return runCsvScanBenchmark(megabytes);
+		} else if (arg == "--benchmark-year-scrub") {
+			std::vector<uint32_t> entityCounts;
+			while (nextIsCount(i, argc, argv)) {
+				uint32_t count = 0;
+				if (!parseCount(arg, argv[++i], count)) return 1;
+				entityCounts.push_back(count);
+			}
+			if (entityCounts.empty()) entityCounts = { 46, 1000, 10000 };
+			return runYearScrubBenchmark(entityCounts);
+		} else if (arg == "--benchmark-raybox") {
+			size_t boxCount = 1000000;
+			if (nextIsCount(i, argc, argv) && !parseCount(arg, argv[++i], boxCount)) return 1;
+			return runRayBoxBenchmark(boxCount);
+		} else if (arg == "--benchmark-pick") {
+			std::vector<size_t> barCounts;
+			while (nextIsCount(i, argc, argv)) {
+				size_t count = 0;
+				if (!parseCount(arg, argv[++i], count)) return 1;
+				barCounts.push_back(count);
+			}
+			if (barCounts.empty()) barCounts = { 1000, 100000, 1000000 };
+			return runPickBenchmark(barCounts);
+		} else if (arg == "--synthetic-raster") {
+			// Draws a generated gridded raster through the quadtree LOD instead of the dataset bars
+			syntheticRasterCells = 10000000;
+			if (nextIsCount(i, argc, argv) && !parseCount(arg, argv[++i], syntheticRasterCells)) return 1;
+		} else if (arg == "--benchmark-lod") {
+			std::vector<size_t> cellCounts;
+			while (nextIsCount(i, argc, argv)) {
+				size_t count = 0;
+				if (!parseCount(arg, argv[++i], count)) return 1;
+				cellCounts.push_back(count);
+			}
+			if (cellCounts.empty()) cellCounts = { 10000000, 100000000 };
+			return runLodBenchmark(cellCounts);
+		} else if (arg == "--benchmark-cull") {
+			std::vector<size_t> barCounts;
+			while (nextIsCount(i, argc, argv)) {
+				size_t count = 0;
+				if (!parseCount(arg, argv[++i], count)) return 1;
+				barCounts.push_back(count);
+			}
+			if (barCounts.empty()) barCounts = { 10000, 100000, 1000000 };
+			return runCullBenchmark(barCounts);
+		} else if (arg == "--benchmark-csv") {
+			// Optional row counts follow the switch, e.g. --benchmark-csv 10000 1000000
+			benchmarkCsv = true;
+			while (nextIsCount(i, argc, argv)) {
+				size_t count = 0;
+				if (!parseCount(arg, argv[++i], count)) return 1;
+				benchmarkRowCounts.push_back(count);
+			}
+		}
+	}
+	if (benchmarkCsv) {
+		if (benchmarkRowCounts.empty()) benchmarkRowCounts = { 10000, 1000000, 50000000 };
+		return runCsvLoaderBenchmark(benchmarkRowCounts, loaderThreads);
+	}
+
+	StartupTimeline startup;
+	size_t windowPhase = startup.begin("window");
 	glfwSetErrorCallback(error_callback);
 	if (!glfwInit()) return -1;
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	if (!gpuCheckCsv.empty() || barShapeBenchmarkBars || !mapTextureBenchmarkImage.empty() || !skyboxBenchmarkImage.empty() ||
+		virtualTextureCheckSize[0])
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 	GLFWwindow *window = glfwCreateWindow(1280, 800, "Population Density Map", NULL, NULL);
 	if (!window) { glfwTerminate(); return -1; }
 	glfwMakeContextCurrent(window);
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) { glfwTerminate(); return -1; }
+	if (!gpuCheckCsv.empty()) {
+		int result = runGpuTimelineCheck(gpuCheckCsv);
+		glfwTerminate();
+		return result;
+	}
+	if (barShapeBenchmarkBars) {
+		int result = runBarShapeBenchmark(barShapeBenchmarkBars);
+		glfwTerminate();
+		return result;
+	}
+	if (!mapTextureBenchmarkImage.empty()) {
+		int result = runMapTextureBenchmark(mapTextureBenchmarkImage);
+		glfwTerminate();
+		return result;
+	}
+	if (!skyboxBenchmarkImage.empty()) {
+		int result = runSkyboxBenchmark(skyboxBenchmarkImage);
+		glfwTerminate();
+		return result;
+	}
+	if (virtualTextureCheckSize[0]) {
+		int result = runVirtualTextureCheck(virtualTextureCheckSize[0], virtualTextureCheckSize[1]);
+		glfwTerminate();
+		return result;
+	}
+	startup.end(windowPhase);
+
+	// Image decoding and dataset parsing run on workers while the GL side is set up
+	g_mapPlane = new MapPlane(MAP_WIDTH, MAP_HEIGHT, MAP_THICKNESS);
+	g_populationBars = new PopulationBars();
+	g_populationBars->setLoaderThreads(loaderThreads);
+	g_populationBars->setUseDatasetCache(useDatasetCache);
+	g_mapPlane->setTileSettings(tileSettings);
+	MapTextureSource mapSource;
+	SkyboxFaces skyboxFaces;
+	ThreadPool startupWorkers(3);
+	std::future<bool> mapLoaded = startupWorkers.submit([&]() {
+		size_t phase = startup.begin("load map");
+		bool ok = MapPlane::prepareTexture(basemapPath, mapSource, useTextureCache);
+		startup.end(phase);
+		return ok;
+	});
+	std::future<bool> skyboxLoaded = startupWorkers.submit([&]() {
+		size_t phase = startup.begin("load skybox");
+		bool ok = Skybox::prepareTexture("assets/skybox.jpg", skyboxFaces, useTextureCache);
+		startup.end(phase);
+		return ok;
+	});
+	std::future<bool> datasetParsed = startupWorkers.submit([&]() {
+		size_t phase = startup.begin("parse dataset");
+		bool ok = g_populationBars->loadFromCSV("dataset/dataset.csv");
+		startup.end(phase);
+		return ok;
+	});
 
 	// ImGui setup
+	size_t imguiPhase = startup.begin("imgui", { "window" });
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
 	ImGuiIO& io = ImGui::GetIO(); (void)io;
@@ -61,25 +336,100 @@ int main()
 
 	// Apply a custom ImGui theme
 	imguiThemes::embraceTheDarkness();
+	startup.end(imguiPhase);
 
-	// Map and bars
-	g_mapPlane = new MapPlane(MAP_WIDTH, MAP_HEIGHT, MAP_THICKNESS);
-	if (!g_mapPlane->loadTexture("assets/map.png") || !g_mapPlane->initialize()) {
+	// Camera block shared by the map, skybox and bar shaders, then every program. The loader
+	// thread only touches the bars' dataset, never their GL state.
+	size_t shaderPhase = startup.begin("shaders", { "window" });
+	// Freed before glfwTerminate, like the skybox, so its buffer is deleted with a current context
+	std::unique_ptr<FrameUniforms> frameUniforms = std::make_unique<FrameUniforms>();
+	frameUniforms->initialize();
+	g_populationBars->setFrameUniforms(frameUniforms.get());
+	if (!g_mapPlane->initialize()) {
 		std::cerr << "Failed to load or initialize map plane!\n";
 		return -1;
 	}
-	g_populationBars = new PopulationBars();
-	if (!g_populationBars->loadFromCSV("dataset/dataset.csv") ||
-		!g_populationBars->initialize(MAP_WIDTH, MAP_HEIGHT, MAP_THICKNESS)) {
+	// Freed before glfwTerminate, while its GL objects still have a context
+	std::unique_ptr<Skybox> skybox = std::make_unique<Skybox>();
+	if (!skybox->initialize()) {
+		std::cerr << "Failed to initialize skybox!" << std::endl;
+		return -1;
+	}
+	if (!g_populationBars->initializeShaders(MAP_THICKNESS)) {
 		std::cerr << "Failed to load or initialize population bars!\n";
 		return -1;
 	}
+	startup.end(shaderPhase);
 
-	// Initialize skybox
-	if (!skybox.loadTexture("assets/skybox.jpg") || !skybox.initialize()) {
-		std::cerr << "Failed to initialize skybox!" << std::endl;
-		return -1;
+	// The window shows the loading screen until every worker result is on the GPU
+	auto isReady = [](const std::future<bool>& f) { return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready; };
+	bool mapReady = false, skyboxReady = false, barsReady = false;
+	while (!mapReady || !skyboxReady || !barsReady) {
+		if (glfwWindowShouldClose(window)) return 0;
+		if (!mapReady && isReady(mapLoaded)) {
+			size_t phase = startup.begin("upload map", { "load map", "shaders" });
+			if (!mapLoaded.get() || !g_mapPlane->uploadTexture(mapSource)) {
+				std::cerr << "Failed to load or initialize map plane!\n";
+				return -1;
+			}
+			mapSource.tiles = TilePyramid();
+			mapSource.compressed.close();
+			mapSource.image = DecodedImage();
+			startup.end(phase);
+			mapReady = true;
+		}
+		if (!skyboxReady && isReady(skyboxLoaded)) {
+			size_t phase = startup.begin("upload skybox", { "load skybox", "shaders" });
+			if (!skyboxLoaded.get() || !skybox->uploadTexture(skyboxFaces)) {
+				std::cerr << "Failed to initialize skybox!" << std::endl;
+				return -1;
+			}
+			skyboxFaces = SkyboxFaces();
+			startup.end(phase);
+			skyboxReady = true;
+		}
+		if (!barsReady && isReady(datasetParsed)) {
+			size_t phase = startup.begin("init bars", { "parse dataset", "shaders" });
+			if (!datasetParsed.get() || !g_populationBars->initialize(MAP_WIDTH, MAP_HEIGHT, MAP_THICKNESS)) {
+				std::cerr << "Failed to load or initialize population bars!\n";
+				return -1;
+			}
+			startup.end(phase);
+			barsReady = true;
+		}
+		if (!mapReady || !skyboxReady || !barsReady) drawStartupProgress(window, startup);
+	}
+	DensityQuadtree densityRaster;
+	if (syntheticRasterCells > 0) {
+		uint32_t rasterWidth = (uint32_t)std::sqrt((double)syntheticRasterCells * MAP_WIDTH / MAP_HEIGHT);
+		uint32_t rasterHeight = (uint32_t)(syntheticRasterCells / std::max(rasterWidth, 1u));
+		densityRaster.build(makeSyntheticDensityRaster(rasterWidth, rasterHeight), rasterWidth, rasterHeight);
+		g_populationBars->setDensityRaster(&densityRaster);
+		std::cout << "Synthetic raster: " << rasterWidth << " x " << rasterHeight << " cells, "
+			<< densityRaster.memoryBytes() / (1024 * 1024) << " MB with " << densityRaster.levelCount() << " LOD levels\n";
 	}
+	const DatasetLoadStats& loadStats = g_populationBars->getLastLoadStats();
+	std::cout << "Loaded " << loadStats.rows << " dataset rows in " << loadStats.seconds * 1000.0
+		<< " ms (" << (size_t)loadStats.rowsPerSecond() << " rows/s, "
+		<< (loadStats.fromCache ? std::string("from cache") : std::to_string(loadStats.threads) + " threads") << ")\n";
+	if (loadStats.rows > 0) {
+		std::cout << "Dataset memory: " << g_populationBars->getDatasetMemoryBytes() / loadStats.rows << " bytes/row ("
+			<< sizeof(PopulationBarData) << " per bar, " << g_populationBars->getEntities().size() << " entities)\n";
+	}
+
+	if (const VirtualTexture* tiles = g_mapPlane->getVirtualTexture()) {
+		const TilePyramid& pyramid = tiles->getPyramid();
+		std::cout << "Map texture: " << pyramid.width() << " x " << pyramid.height() << " tiled, " << pyramid.levelCount()
+			<< " levels, " << g_mapPlane->getTextureBytes() / (1024.0 * 1024.0) << " MB GPU for "
+			<< tiles->getStats().physicalTiles << " tiles, " << tileSettings.cacheBytes / (1024 * 1024) << " MB tile cache\n";
+	} else {
+		std::cout << "Map texture: " << g_mapPlane->getTextureBytes() / (1024.0 * 1024.0) << " MB with mip levels ("
+			<< (g_mapPlane->isTextureCompressed() ? "BC1" : "RGBA8") << ")\n";
+	}
+	const ShaderLoadStats& shaderStats = ShaderManager::shared().getStats();
+	std::cout << "Shaders: " << shaderStats.compiled << " compiled in " << shaderStats.compileMs << " ms, "
+		<< shaderStats.cacheHits << " from cache in " << shaderStats.cacheMs << " ms\n";
+	if (exportShaders) std::cout << "Exported " << ShaderManager::shared().exportSources() << " shader files\n";
 
 	CameraState camera;
 	static int selectedYear = 2025;
@@ -87,28 +437,22 @@ int main()
 	int minYear = g_populationBars->minYear;
 	int maxYear = g_populationBars->maxYear;
 
-	// --- Country visibility state ---
-	static std::unordered_map<std::string, bool> countryVisibility;
+	// --- Country visibility state (bitset inside PopulationBars, indexed by entity id) ---
+	const EntityDictionary& entities = g_populationBars->getEntities();
 	static int lastYearForVisibility = -1;
-	static std::vector<std::string> countryNames;
-	// Helper to update country list and visibility when year changes
+	static std::vector<uint32_t> countryIds;
+	// Helper to update country list when year changes (visibility persists across years)
 	auto updateCountryList = [&]() {
-		countryNames.clear();
-		std::set<std::string> uniqueNames;
-		for (const auto& bar : g_populationBars->allBarsForYear) {
-			if (uniqueNames.insert(bar.name).second) {
-				countryNames.push_back(bar.name);
-				// Only set to true if not already present (preserve user toggles)
-				if (countryVisibility.find(bar.name) == countryVisibility.end()) {
-					countryVisibility[bar.name] = true;
-				}
-			}
+		countryIds.clear();
+		const float* densities = g_populationBars->getYearDensities();
+		if (!densities) return;
+		for (uint32_t id = 0; id < entities.size(); ++id) {
+			if (!PopulationTimeSeries::isMissing(densities[id])) countryIds.push_back(id);
 		}
 	};
 	if (lastYearForVisibility != selectedYear) {
 		updateCountryList();
 		lastYearForVisibility = selectedYear;
-		g_populationBars->updateVisibleBars(countryVisibility);
 	}
 
 	// Declare and assign all layout variables before use
@@ -123,6 +467,8 @@ int main()
 	calculatedWindowHeight += (ImGui::GetFontSize() + 2 * ImGui::GetStyle().FramePadding.y);
 	calculatedWindowHeight += bottomMargin;
 
+	HoverPicker hoverPicker;
+	size_t firstFramePhase = startup.begin("first frame", { "imgui", "upload map", "upload skybox", "init bars" });
 	while (!glfwWindowShouldClose(window))
 	{
 		static float timelapseYear = 0.0f;
@@ -188,10 +534,14 @@ int main()
 		glm::mat4 proj = glm::perspective(glm::radians(45.0f), (float)width/height, 0.1f, 100.0f);
 		glm::mat4 viewProj = proj * view;
 
-		// Remove translation from view matrix for skybox
-		glm::mat4 viewNoTrans = glm::mat4(glm::mat3(view));
-		glm::mat4 skyboxVP = proj * viewNoTrans;
-		skybox.draw(viewNoTrans);
+		// Programs whose files under shaders/ were edited are rebuilt before drawing
+		ShaderManager::shared().reloadChanged();
+		// One upload of the camera block serves every scene shader this frame
+		static uint64_t sceneGlCalls = 0;
+		uint64_t callsBefore = glCallCount();
+		frameUniforms->update(view, proj, glm::vec4(0.0f, 0.0f, (float)width, (float)height), (float)glfwGetTime(), timelapseYear);
+		g_mapPlane->updateTiles(width, height);
+		uint64_t frameSetupCalls = glCallCount() - callsBefore;
 
 		// --- ImGui frame start ---
 		ImGui_ImplOpenGL3_NewFrame();
@@ -236,10 +586,70 @@ int main()
 		}
 		ImGui::Checkbox("Animate camera around map", &animateCamera);
 		static bool timelapse = false;
+		static float timelapseSpeed = 5.0f; // years per second
 		ImGui::Checkbox("Timelapse year", &timelapse);
+		ImGui::SliderFloat("Years/s", &timelapseSpeed, 0.5f, 50.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+		static int interpolationMode = (int)YearInterpolation::MonotoneCubic;
+		if (ImGui::Combo("Blend", &interpolationMode, "Step\0Linear\0Monotone cubic\0")) {
+			g_populationBars->setInterpolation((YearInterpolation)interpolationMode);
+		}
+		// The id buffer is exact where bars overlap or hide behind the map, at a frame or two of latency
+		bool gpuPicking = g_populationBars->getPickMode() == PickMode::Gpu;
+		if (g_populationBars->isGpuPickingAvailable() && ImGui::Checkbox("GPU picking", &gpuPicking)) {
+			g_populationBars->setPickMode(gpuPicking ? PickMode::Gpu : PickMode::Cpu);
+		}
 		if (ImGui::Button("Reset Camera") || glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) {
 			camera.reset();
 		}
+		const BarResourceStats& barStats = g_populationBars->getResourceStats();
+		ImGui::Text("GPU uploads: %llu (%.1f KB), allocations: %llu", (unsigned long long)barStats.uploads,
+			barStats.bytes / 1024.0, (unsigned long long)barStats.allocations);
+		int barShape = (int)g_populationBars->getBarShape();
+		if (ImGui::Combo("Bar shape", &barShape, "Box\0Hexagonal prism\0Cylinder\0")) {
+			g_populationBars->setBarShape((BarShape)barShape);
+		}
+		bool culling = g_populationBars->getCulling() && g_populationBars->isCullingAvailable();
+		if (g_populationBars->isCullingAvailable() && ImGui::Checkbox("Frustum culling", &culling)) {
+			g_populationBars->setCulling(culling);
+		}
+		bool gpuCulling = g_populationBars->getGpuCulling();
+		if (culling && g_populationBars->isGpuCullingAvailable() && ImGui::Checkbox("GPU culling (compute)", &gpuCulling)) {
+			g_populationBars->setGpuCulling(gpuCulling);
+		}
+		const BarCullStats& cullStats = g_populationBars->getCullStats();
+		if (cullStats.gpu) {
+			// The survivor count stays on the GPU, it is the indirect draw's instance count
+			ImGui::Text("Bars drawn: culled on the GPU");
+		} else {
+			ImGui::Text("Bars drawn: %zu, culled: %zu (%.3f ms)", cullStats.visible, cullStats.culled, cullStats.cullMs);
+		}
+		const StreamingStats streamStats = g_populationBars->getStreamingStats();
+		ImGui::Text("Streamed: %.1f KB/frame, fence waits: %.3f ms/frame (%s)", streamStats.frameBytes / 1024.0,
+			streamStats.frameFenceWaitMs, g_populationBars->isStreamingPersistent() ? "persistent" : "mapped per write");
+		if (!densityRaster.empty()) {
+			const LodSelectStats& lodStats = g_populationBars->getRasterLodStats();
+			ImGui::Text("Raster LOD: %zu bars, %zu nodes (%.2f ms)%s", lodStats.bars, lodStats.nodesVisited, lodStats.ms,
+				lodStats.budgetReached ? ", budget reached" : "");
+		}
+		if (const VirtualTexture* tiles = g_mapPlane->getVirtualTexture()) {
+			VirtualTextureStats tileStats = tiles->getStats();
+			ImGui::Text("Basemap tiles: %zu/%zu resident, %zu loading, finest level %d", tileStats.residentTiles,
+				tileStats.physicalTiles, tileStats.loading, tileStats.finestLevel);
+			ImGui::Text("Tile cache: %.1f/%.0f MB, %llu evictions", tileStats.cacheBytes / (1024.0 * 1024.0),
+				tileStats.cacheBudget / (1024.0 * 1024.0), (unsigned long long)tileStats.evictions);
+		}
+		bool countGlCalls = isGlCallCounterInstalled();
+		if (ImGui::Checkbox("Count GL calls", &countGlCalls)) {
+			if (countGlCalls) installGlCallCounter();
+			else uninstallGlCallCounter();
+		}
+		if (countGlCalls) {
+			ImGui::SameLine();
+			ImGui::Text("scene: %llu/frame", (unsigned long long)sceneGlCalls);
+		}
+		const HoverPickStats& pickStats = hoverPicker.getStats();
+		ImGui::Text("Hover picks: %llu, cached: %llu, debounced: %llu", (unsigned long long)pickStats.picks,
+			(unsigned long long)pickStats.cached, (unsigned long long)pickStats.debounced);
 		ImGui::Text("Camera controls:");
 		ImGui::BulletText("WASD: Move in view plane");
 		ImGui::BulletText("Arrow keys: Rotate");
@@ -250,29 +660,26 @@ int main()
 			float countryListHeight = ImGui::GetContentRegionAvail().y;
 			if (countryListHeight < 100.0f) countryListHeight = 100.0f;
 			if (ImGui::Button("Select All")) {
-				for (auto& kv : countryVisibility) kv.second = true;
-				g_populationBars->updateVisibleBars(countryVisibility);
+				g_populationBars->setAllEntitiesVisible(true);
 			}
 			ImGui::SameLine();
 			if (ImGui::Button("Uncheck All")) {
-				for (auto& kv : countryVisibility) kv.second = false;
-				g_populationBars->updateVisibleBars(countryVisibility);
+				g_populationBars->setAllEntitiesVisible(false);
 			}
 			ImGui::BeginChild("CountryList", ImVec2(0, countryListHeight), true, ImGuiWindowFlags_HorizontalScrollbar);
-			for (const auto& name : countryNames) {
-				bool& visible = countryVisibility[name];
-				ImGui::Checkbox(name.c_str(), &visible);
+			for (uint32_t id : countryIds) {
+				bool visible = g_populationBars->isEntityVisible(id);
+				if (ImGui::Checkbox(entities.name(id).c_str(), &visible)) g_populationBars->setEntityVisible(id, visible);
 			}
 			ImGui::EndChild();
 		}
 		ImGui::End();
 
-		// Ensure bar visibility matches checkboxes every frame
-		g_populationBars->updateVisibleBars(countryVisibility);
+		// Upload visibility only if a checkbox changed this frame
+		g_populationBars->flushVisibility();
 
-		// Timelapse logic
+		// Timelapse logic: continuous time, the bars blend between years on the GPU
 		double currentTime = glfwGetTime();
-		float timelapseSpeed = 5.0f; // years per second
 		static bool prevTimelapse = false;
 		if (timelapse && !prevTimelapse) {
 			timelapseYear = static_cast<float>(minYear);
@@ -283,25 +690,44 @@ int main()
 			float delta = static_cast<float>(currentTime - lastTime);
 			lastTime = currentTime;
 			timelapseYear += timelapseSpeed * delta;
-			if (timelapseYear > static_cast<float>(maxYear) + 0.999f) timelapseYear = static_cast<float>(minYear);
+			if (timelapseYear > static_cast<float>(maxYear)) timelapseYear = static_cast<float>(minYear);
+			g_populationBars->setTime(timelapseYear);
 			selectedYear = static_cast<int>(timelapseYear);
+			if (lastAppliedYear != selectedYear) {
+				updateCountryList();
+				lastAppliedYear = selectedYear;
+			}
 		} else {
 			lastTime = currentTime;
+			if (timelapseYear != static_cast<float>(selectedYear)) g_populationBars->setYear(selectedYear);
 			timelapseYear = static_cast<float>(selectedYear);
 		}
 
-		// --- Picking ---
+		// --- Picking (cached until the cursor, camera or bars change) ---
 		double mouseX, mouseY;
 		glfwGetCursorPos(window, &mouseX, &mouseY);
-		int hoveredBar = g_populationBars->pickBar((float)mouseX, (float)mouseY, view, proj, width, height);
+		int hoveredBar = hoverPicker.update(*g_populationBars, (float)mouseX, (float)mouseY, view, proj, width, height);
 
 		// --- Render scene ---
-		g_mapPlane->draw(viewProj);
+		callsBefore = glCallCount();
+		g_mapPlane->draw();
 		g_populationBars->draw(viewProj, hoveredBar);
+		// Last, so the depth test skips every pixel the map and bars already cover
+		skybox->draw();
+		sceneGlCalls = frameSetupCalls + glCallCount() - callsBefore;
 
 		// --- Tooltip ---
 		if (hoveredBar >= 0) {
-			std::string label = g_populationBars->getBarName(hoveredBar) + "\nDensity: " + std::to_string(g_populationBars->getBarDensity(hoveredBar));
+			// Rebuilt only when the bar or its height changes
+			static std::string label;
+			static int labelBar = -1;
+			static uint64_t labelGeneration = 0;
+			if (hoveredBar != labelBar || g_populationBars->getPickGeneration() != labelGeneration) {
+				label = entities.name(g_populationBars->getBarEntity(hoveredBar)) + "\nDensity: " + std::to_string(g_populationBars->getBarDensity(hoveredBar));
+				if (g_populationBars->isBarInterpolated(hoveredBar)) label += " (interpolated)";
+				labelBar = hoveredBar;
+				labelGeneration = g_populationBars->getPickGeneration();
+			}
 			ImGui::SetNextWindowBgAlpha(0.8f);
 			ImGui::BeginTooltip();
 			ImGui::TextUnformatted(label.c_str());
@@ -313,15 +739,27 @@ int main()
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
 		glfwSwapBuffers(window);
+		if (firstFramePhase != (size_t)-1) {
+			startup.end(firstFramePhase);
+			firstFramePhase = (size_t)-1;
+			startup.print(std::cout, "first frame");
+			if (startupBenchmark) break;
+		}
 		glfwPollEvents();
 	}
 
 	// Cleanup
+	const HoverPickStats& pickStats = hoverPicker.getStats();
+	std::cout << "Hover picking: " << pickStats.picks << " picks, " << pickStats.cached << " cached, "
+		<< pickStats.debounced << " debounced over " << pickStats.frames() << " frames" << std::endl;
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
+	skybox.reset();
 	delete g_mapPlane;
 	delete g_populationBars;
+	// After the bars, which keep a pointer to the camera block
+	frameUniforms.reset();
 	glfwTerminate();
 	return 0;
 }